@@ -3,6 +3,7 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QDateTime>
 #include "BoolPropertyHandler.hpp"
@@ -61,6 +62,19 @@ void XmlHierarchyWriter::writeHierarchy(SimulationItem* item, QString filename)
 
 ////////////////////////////////////////////////////////////////////
 
+QByteArray XmlHierarchyWriter::serializeHierarchy(SimulationItem* item)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    _writer.setDevice(&buffer);
+    _writer.setAutoFormatting(false);
+    writeProperties(item);
+    _writer.setDevice(0);
+    return buffer.data();
+}
+
+////////////////////////////////////////////////////////////////////
+
 void XmlHierarchyWriter::writeProperties(SimulationItem* item)
 {
     // start an element for the item
@@ -29,6 +29,12 @@ public:
         occurs, the function throws a fatal error. */
     void writeHierarchy(SimulationItem* item, QString filename);
 
+    /** Returns the structure and properties of the specified simulation hierarchy as an XML
+        fragment in memory. In contrast to the file written by writeHierarchy(), the fragment has
+        no document header, so that it depends only on the hierarchy itself; it can for example
+        be hashed to identify a configuration. */
+    QByteArray serializeHierarchy(SimulationItem* item);
+
     /** Writes appropriate XML information on the specified property, as part of the visitor
         pattern initiated by the writeProperties() function. */
     void visitPropertyHandler(BoolPropertyHandler* handler);
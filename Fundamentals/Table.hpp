@@ -41,6 +41,9 @@ template <N> class Table
     // Returns the number of items in the indicated dimension.
     size_t size(size_t dim) const;
 
+    // Exchanges the contents of this table with those of the specified table, without copying the values.
+    void swap(Table<N>& other);
+
     // Returns a (readonly or writable) reference to the value at the specified N indices.
     const double& operator()(size_t i_0, ..., size_t i_Nm1) const;
     double& operator()(size_t i_0, ..., size_t i_Nm1);
@@ -76,6 +79,9 @@ public:
 
     // Sets all values in the table to zero.
     void clear() { _v = 0; }
+
+    // Exchanges the contents of this table with those of the specified table, without copying the values.
+    void swap(Table_Base<NDIM>& other) { _v.swap(other._v); std::swap_ranges(_n, _n+NDIM, other._n); }
 };
 
 ////////////////////////////////////////////////////////////////////
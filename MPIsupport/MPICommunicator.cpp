@@ -0,0 +1,101 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifdef BUILDING_WITH_MPI
+#include <mpi.h>
+#endif
+
+#include "MPICommunicator.hpp"
+
+////////////////////////////////////////////////////////////////////
+
+MPICommunicator::MPICommunicator()
+    : _size(worldSize()), _rank(worldRank())
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+int MPICommunicator::worldSize()
+{
+    int size = 1;
+#ifdef BUILDING_WITH_MPI
+    int initialized;
+    MPI_Initialized(&initialized);
+    if (initialized) MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+    return size;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int MPICommunicator::worldRank()
+{
+    int rank = 0;
+#ifdef BUILDING_WITH_MPI
+    int initialized;
+    MPI_Initialized(&initialized);
+    if (initialized) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+    return rank;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int MPICommunicator::size() const
+{
+    return _size;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int MPICommunicator::rank() const
+{
+    return _rank;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void MPICommunicator::sum(double* data, size_t count)
+{
+#ifdef BUILDING_WITH_MPI
+    if (_size > 1)
+    {
+        const size_t maxcount = 1 << 28;
+        while (count > 0)
+        {
+            size_t n = qMin(count, maxcount);
+            MPI_Allreduce(MPI_IN_PLACE, data, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            data += n;
+            count -= n;
+        }
+    }
+#else
+    Q_UNUSED(data) Q_UNUSED(count)
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+
+void MPICommunicator::broadcast(double* data, size_t count, int sender)
+{
+#ifdef BUILDING_WITH_MPI
+    if (_size > 1)
+    {
+        const size_t maxcount = 1 << 28;
+        while (count > 0)
+        {
+            size_t n = qMin(count, maxcount);
+            MPI_Bcast(data, n, MPI_DOUBLE, sender, MPI_COMM_WORLD);
+            data += n;
+            count -= n;
+        }
+    }
+#else
+    Q_UNUSED(data) Q_UNUSED(count) Q_UNUSED(sender)
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
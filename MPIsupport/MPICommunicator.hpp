@@ -0,0 +1,72 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef MPICOMMUNICATOR_HPP
+#define MPICOMMUNICATOR_HPP
+
+#include "ProcessCommunicator.hpp"
+
+////////////////////////////////////////////////////////////////////
+
+/** An MPICommunicator object represents the group of all processes launched under MPI control
+    (i.e. the processes in the MPI_COMM_WORLD communicator), and implements the collective
+    operations defined by the ProcessCommunicator interface using MPI. If the code was compiled
+    without MPI support, or if MPI has not been initialized (see
+    MasterSlaveManager::initialize()), the object represents a single process, just like its
+    base class.
+
+    All processes in the group must perform the same simulation(s) in the same order, so that the
+    collective operations invoked by the simulation code match up between processes. Multiple
+    simulations may therefore not be run in parallel within a process when more than one process
+    participates. */
+class MPICommunicator : public ProcessCommunicator
+{
+    Q_OBJECT
+
+    //============= Construction - Setup - Destruction =============
+
+public:
+    /** Constructs a communicator for the processes in the MPI_COMM_WORLD communicator. */
+    MPICommunicator();
+
+    //====================== Other Functions =======================
+
+public:
+    /** Returns the number of processes in the MPI_COMM_WORLD communicator, or one if MPI is not
+        available. This is a static function so that it can be used before any communicator
+        object has been constructed. */
+    static int worldSize();
+
+    /** Returns the rank of the calling process in the MPI_COMM_WORLD communicator, or zero if MPI
+        is not available. */
+    static int worldRank();
+
+    /** Returns the number of processes in the group. */
+    int size() const;
+
+    /** Returns the rank of the calling process in the group. */
+    int rank() const;
+
+    /** Replaces each of the \em count values starting at the specified address by the sum of the
+        corresponding values over all processes in the group, using an in-place MPI_Allreduce
+        operation. Large arrays are processed in pieces to stay within the range of the MPI count
+        argument. */
+    void sum(double* data, size_t count);
+
+    /** Copies the \em count values starting at the specified address in the process with the
+        specified rank to the corresponding memory locations in all other processes of the group,
+        using an MPI_Bcast operation. Large arrays are processed in pieces as for sum(). */
+    void broadcast(double* data, size_t count, int sender);
+
+    //======================== Data Members ========================
+
+private:
+    int _size;
+    int _rank;
+};
+
+////////////////////////////////////////////////////////////////////
+
+#endif // MPICOMMUNICATOR_HPP
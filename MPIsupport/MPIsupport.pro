@@ -41,7 +41,9 @@ isEmpty(MPI_COMPILER) {
 #--------------------------------------------------
 
 HEADERS += \
-    MasterSlaveManager.hpp
+    MasterSlaveManager.hpp \
+    MPICommunicator.hpp
 
 SOURCES += \
-    MasterSlaveManager.cpp
+    MasterSlaveManager.cpp \
+    MPICommunicator.cpp
@@ -0,0 +1,36 @@
+#-------------------------------------------------
+#  SKIRT -- an advanced radiative transfer code
+#  © Astronomical Observatory, Ghent University
+#-------------------------------------------------
+
+#---------------------------------------------------------------------
+# This is a console application that measures the performance of
+# selected computational kernels in the SKIRT core library.
+# It is not needed for running simulations and is not part of the
+# regular build; it uses only header files from the Fundamentals and
+# SKIRTcore directories and does not depend on Qt.
+#---------------------------------------------------------------------
+
+# overall setup
+TEMPLATE = app
+TARGET   = skirtbench
+CONFIG  -= qt app_bundle
+CONFIG  *= console c++11
+
+# compile C++ with maximum optimization
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+# include header-only code internal to the project
+INCLUDEPATH += $$PWD/../Fundamentals $$PWD/../SKIRTcore
+DEPENDPATH += $$PWD/../Fundamentals $$PWD/../SKIRTcore
+
+#--------------------------------------------------
+# source and header files: maintained by Qt creator
+#--------------------------------------------------
+
+HEADERS += \
+    SkirtBench.hpp
+
+SOURCES += \
+    SkirtBench.cpp
@@ -0,0 +1,304 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "Array.hpp"
+#include "NR.hpp"
+#include "SkirtBench.hpp"
+#include "TransientHeating.hpp"
+
+using namespace std;
+using namespace TransientHeating;
+
+//////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // physical constants (SI units)
+    const double h = 6.62607e-34;
+    const double c = 2.99792458e8;
+    const double k = 1.38065e-23;
+    const double hc = h*c;
+
+    // temperature grids, with the same parameters as those used by TransientDustEmissivity
+    const double Tlower = 2.;
+    const double Tupper = 3000.;
+    const int NTA = 20;
+    const double ratioA = 500.;
+    const double widthB = 4.;
+    const double ratioB = 1.;
+    const double widthC = 2.;
+    const double ratioC = 3.;
+    const double deltaTmedium = 200.;
+    const double deltaTeq = 10.;
+
+    // returns the black-body intensity at the specified wavelength and temperature
+    double planck(double lambda, double T)
+    {
+        double lambda5 = lambda*lambda*lambda*lambda*lambda;
+        return 2*hc*c / lambda5 / (exp(hc/(lambda*k*T))-1.);
+    }
+
+    // synthetic grain type: Debye-like enthalpy with the given Debye temperature, and an absorption
+    // cross section per atom proportional to lambda^(-beta) at long wavelengths, with an optional
+    // Drude-profile bump in the ultraviolet
+    struct GrainType
+    {
+        const char* name;
+        double Td;      // Debye temperature (K)
+        double beta;    // spectral index of the absorption cross section
+        double bump;    // strength of the ultraviolet bump relative to the continuum at its central wavelength
+    };
+
+    // the wavelength grid, indexed on ell
+    struct WavelengthGrid
+    {
+        Array lambdav;
+        Array dlambdav;
+        int Nlambda;
+
+        WavelengthGrid(double lambdamin, double lambdamax, int n) : Nlambda(n)
+        {
+            NR::loggrid(lambdav, lambdamin, lambdamax, n-1);
+            dlambdav.resize(n);
+            for (int ell=0; ell<n; ell++)
+            {
+                double left = ell>0 ? sqrt(lambdav[ell-1]*lambdav[ell]) : lambdav[ell];
+                double right = ell<n-1 ? sqrt(lambdav[ell]*lambdav[ell+1]) : lambdav[ell];
+                dlambdav[ell] = right - left;
+            }
+        }
+
+        // returns the index of the grid point nearest to the specified wavelength, or -1 if the
+        // wavelength lies outside of the grid
+        int nearest(double lambda) const
+        {
+            if (lambda < lambdav[0] || lambda > lambdav[Nlambda-1]) return -1;
+            int ell = NR::locate_clip(lambdav, lambda);
+            return (lambda/lambdav[ell] < lambdav[ell+1]/lambda) ? ell : ell+1;
+        }
+    };
+
+    // the heating and cooling rates of a synthetic dust population on a particular temperature grid,
+    // calculated in the same way as by TDE_Calculator in TransientDustEmissivity
+    class Population
+    {
+    public:
+        const Array& _Tv;
+        Triangle<double> _HRm;
+        Triangle<short> _ELLm;
+        Array _CRv;
+
+        Population(const Array& Tv, const WavelengthGrid& lambdagrid, const GrainType& type, double Natoms)
+            : _Tv(Tv), _HRm(Tv.size()), _ELLm(Tv.size()), _CRv(Tv.size())
+        {
+            int NT = Tv.size();
+            int Nlambda = lambdagrid.Nlambda;
+
+            // absorption cross section
+            Array sigmav(Nlambda);
+            for (int ell=0; ell<Nlambda; ell++)
+            {
+                double x = 1e-6/lambdagrid.lambdav[ell];
+                double lambda0 = 0.2175e-6;
+                double gamma = 0.2;
+                double y = lambdagrid.lambdav[ell]/lambda0 - lambda0/lambdagrid.lambdav[ell];
+                sigmav[ell] = 1e-25 * Natoms * pow(x, type.beta) * (1. + type.bump*gamma*gamma/(y*y+gamma*gamma));
+            }
+
+            // enthalpy and enthalpy bin widths
+            Array Hv(NT);
+            Array dHv(NT);
+            for (int i=0; i<NT; i++) Hv[i] = enthalpy(Tv[i], type.Td, Natoms);
+            dHv[0] = Hv[1]-Hv[0];
+            for (int i=1; i<NT-1; i++)
+                dHv[i] = enthalpy((Tv[i+1]+Tv[i])/2., type.Td, Natoms) - enthalpy((Tv[i-1]+Tv[i])/2., type.Td, Natoms);
+            dHv[NT-1] = Hv[NT-1]-Hv[NT-2];
+
+            // heating rates, barring the dependency on the radiation field
+            for (int f=1; f<NT; f++)
+            {
+                for (int i=0; i<f; i++)
+                {
+                    double Hdiff = Hv[f] - Hv[i];
+                    int ell = lambdagrid.nearest(hc / Hdiff);
+                    if (ell>=0) _HRm(f,i) = hc * sigmav[ell] * dHv[f] / (Hdiff*Hdiff*Hdiff);
+                    _ELLm(f,i) = ell;
+                }
+            }
+
+            // cooling rates
+            for (int i=1; i<NT; i++)
+            {
+                double sum = 0.;
+                for (int ell=0; ell<Nlambda; ell++)
+                    sum += sigmav[ell] * planck(lambdagrid.lambdav[ell], Tv[i]) * lambdagrid.dlambdav[ell];
+                _CRv[i] = sum / (Hv[i]-Hv[i-1]);
+            }
+        }
+
+        // returns the Debye-like enthalpy of a grain with the specified number of atoms
+        static double enthalpy(double T, double Td, double Natoms)
+        {
+            return 3.*Natoms*k*T*T*T*T/(T*T*T+Td*Td*Td);
+        }
+
+        // returns the index offset and the number of bins of the portion of the temperature grid
+        // covering the specified temperature range
+        void range(double Tmin, double Tmax, int& ioff, int& NT) const
+        {
+            ioff = NR::locate_clip(_Tv, Tmin);
+            NT = NR::locate_clip(_Tv, Tmax) - ioff + 2;
+        }
+
+        // determines the temperature range where the probabilities are above a given fraction of
+        // their maximum, in the same way as TDE_Calculator::calcprobs()
+        void cutoff(const Array& Pv, int ioff, double& Tmin, double& Tmax) const
+        {
+            int NT = Pv.size();
+            double frac = 1e-20 * Pv.max();
+            int q;
+            for (q=0; q!=NT-2; q++) if (Pv[q]>frac) break;
+            Tmin = _Tv[q+ioff];
+            for (q=NT-2; q!=1; q--) if (Pv[q]>frac) break;
+            Tmax = _Tv[q+1+ioff];
+        }
+
+        // calculates the probabilities with the straightforward implementation that was replaced by
+        // TransientHeating::probabilities(): it first fills the transition matrix, then accumulates it
+        // in a separate pass, and finally evaluates each dot product with a single running sum
+        void probabilitiesreference(Array& Pv, Square<double>& Am, int ioff, int NT, const Array& Jv) const
+        {
+            Am.resize(NT);
+            for (int f=1; f<NT; f++)
+            {
+                const short* ELLv = &_ELLm(f+ioff,ioff);
+                const double* HRv = &_HRm(f+ioff,ioff);
+                for (int i=0; i<f; i++)
+                {
+                    int ell = ELLv[i];
+                    Am(f,i) = ell>=0 ? HRv[i] * Jv[ell] : 0.;
+                }
+            }
+            for (int i=1; i<NT; i++)
+            {
+                Am(i-1,i) = _CRv[i+ioff];
+            }
+            for (int f=NT-2; f>0; f--)
+            {
+                for (int i=0; i<f; i++)
+                {
+                    Am(f,i) += Am(f+1,i);
+                }
+            }
+            Pv.resize(NT);
+            Pv[0] = 1.;
+            for (int i=1; i<NT; i++)
+            {
+                double sum = 0.;
+                for (int j=0; j<i; j++) sum += Am(i,j) * Pv[j];
+                Pv[i] = sum / Am(i-1,i);
+                if (Pv[i] > 1e10) for (int j=0; j<=i; j++) Pv[j]/=Pv[i];
+            }
+            Pv /= Pv.sum();
+        }
+    };
+
+    // returns the number of seconds elapsed since the specified time point
+    double elapsed(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+    int Nrepeat = argc > 1 ? atoi(argv[1]) : 100;
+    if (Nrepeat < 1) Nrepeat = 100;
+
+    // wavelength grid and radiation field: a 5000 K black body diluted to roughly the local interstellar field
+    WavelengthGrid lambdagrid(1e-7, 1e-3, 200);
+    Array J0v(lambdagrid.Nlambda);
+    for (int ell=0; ell<lambdagrid.Nlambda; ell++) J0v[ell] = 1e-14 * planck(lambdagrid.lambdav[ell], 5000.);
+    const double Uv[] = { 0.1, 1., 10., 100., 1e3, 1e4 };
+    const int NU = sizeof(Uv)/sizeof(Uv[0]);
+
+    // temperature grids
+    Array TAv, TBv, TCv;
+    NR::powgrid(TAv, Tlower, Tupper, NTA-1, ratioA);
+    NR::powgrid(TBv, Tlower, Tupper, int(Tupper/widthB)-1, ratioB);
+    NR::powgrid(TCv, Tlower, Tupper, int(Tupper/widthC)-1, ratioC);
+    Square<double> Am(TCv.size());
+
+    // synthetic populations: graphite-like, silicate-like and PAH-like grains of increasing size
+    const GrainType types[] = { {"graphite", 420., 2., 1.}, {"silicate", 500., 1.6, 0.}, {"PAH", 300., 1., 3.} };
+    const int Ntypes = sizeof(types)/sizeof(types[0]);
+    const double Natomsv[] = { 50., 200., 1000., 5000., 25000. };
+    const int Nsizes = sizeof(Natomsv)/sizeof(Natomsv[0]);
+
+    printf("Transient heating solver: %d populations, %d field strengths, %d repetitions per evaluation\n",
+           Ntypes*Nsizes, NU, Nrepeat);
+    double totaltime = 0.;
+    double totaltimeref = 0.;
+    int Ncalc = 0;
+    double maxdiff = 0.;
+    for (int t=0; t<Ntypes; t++)
+    {
+        double time = 0.;
+        double timeref = 0.;
+        int Ntransient = 0;
+        for (int s=0; s<Nsizes; s++)
+        {
+            Population popA(TAv, lambdagrid, types[t], Natomsv[s]);
+            Population popB(TBv, lambdagrid, types[t], Natomsv[s]);
+            Population popC(TCv, lambdagrid, types[t], Natomsv[s]);
+            for (int u=0; u<NU; u++)
+            {
+                Array Jv = J0v * Uv[u];
+
+                // determine the temperature range on the coarse grid, as TransientDustEmissivity::emissivity() does
+                Array Pv, Prefv;
+                int ioff, NT;
+                double Tmin, Tmax;
+                popA.range(Tlower, Tupper, ioff, NT);
+                probabilities(Pv, Am, popA._ELLm, popA._HRm, popA._CRv, ioff, NT, Jv);
+                popA.cutoff(Pv, ioff, Tmin, Tmax);
+                if (!(Tmax-Tmin > deltaTeq)) continue;
+                const Population& pop = (Tmax-Tmin > deltaTmedium) ? popB : popC;
+                pop.range(Tmin, Tmax, ioff, NT);
+
+                // time both implementations on identical input
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                for (int r=0; r<Nrepeat; r++) probabilities(Pv, Am, pop._ELLm, pop._HRm, pop._CRv, ioff, NT, Jv);
+                time += elapsed(start);
+                start = chrono::steady_clock::now();
+                for (int r=0; r<Nrepeat; r++) pop.probabilitiesreference(Prefv, Am, ioff, NT, Jv);
+                timeref += elapsed(start);
+
+                // compare the probabilities above the cutoff used for determining the temperature range
+                double frac = 1e-20 * Prefv.max();
+                for (int i=0; i<NT; i++)
+                    if (Prefv[i] > frac) maxdiff = max(maxdiff, fabs(Pv[i]-Prefv[i])/Prefv[i]);
+                Ntransient++;
+            }
+        }
+        printf("  %-8s: %2d transient evaluations; %.3f ms vs reference %.3f ms per evaluation\n", types[t].name,
+               Ntransient, Ntransient ? 1e3*time/Nrepeat/Ntransient : 0., Ntransient ? 1e3*timeref/Nrepeat/Ntransient : 0.);
+        totaltime += time;
+        totaltimeref += timeref;
+        Ncalc += Ntransient;
+    }
+    printf("Total: %.3f ms vs reference %.3f ms per evaluation (speedup %.2f); max relative difference %.2e\n",
+           Ncalc ? 1e3*totaltime/Nrepeat/Ncalc : 0., Ncalc ? 1e3*totaltimeref/Nrepeat/Ncalc : 0.,
+           totaltime > 0. ? totaltimeref/totaltime : 0., maxdiff);
+    return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////
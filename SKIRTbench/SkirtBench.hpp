@@ -0,0 +1,28 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef SKIRTBENCH_HPP
+#define SKIRTBENCH_HPP
+
+////////////////////////////////////////////////////////////////////
+
+/** The SKIRTbench main function measures the performance of the transient heating solver used by
+    the TransientDustEmissivity class, i.e. the TransientHeating::probabilities() function, and
+    compares it with the straightforward implementation it replaced. Because the real dust mixes
+    can only be constructed within a complete simulation hierarchy, the benchmark uses synthetic
+    graphite-like, silicate-like and PAH-like populations of five grain sizes each, with Debye-like
+    enthalpies and power-law absorption cross sections, on the temperature grids used by the
+    TransientDustEmissivity class. The populations are exposed to a diluted 5000 K black-body
+    radiation field scaled by factors ranging from 0.1 to \f$10^4\f$. For each combination, the
+    coarse temperature grid determines the temperature range and thus the medium or fine grid,
+    just as during a simulation. The function prints the time per evaluation for both
+    implementations and the largest relative difference between the calculated probabilities. The
+    optional command line argument specifies the number of repetitions for each timed
+    calculation (the default is 100). */
+int main(int argc, char** argv);
+
+////////////////////////////////////////////////////////////////////
+
+#endif // SKIRTBENCH_HPP
@@ -4,6 +4,7 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include <cfloat>
+#include <climits>
 #include <cmath>
 #include <QFile>
 #include "AdaptiveMesh.hpp"
@@ -17,6 +18,28 @@ using namespace std;
 
 ////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    // node reference value indicating that there is no neighbor beyond a wall (i.e. the wall is a domain wall)
+    const int NOREF = INT_MAX;
+
+    // returns true if the box a covers the specified wall of box b in the two directions parallel to the wall
+    bool covers(const Box& a, const Box& b, int wall, double eps)
+    {
+        bool x = a.xmin() <= b.xmin()+eps && a.xmax() >= b.xmax()-eps;
+        bool y = a.ymin() <= b.ymin()+eps && a.ymax() >= b.ymax()-eps;
+        bool z = a.zmin() <= b.zmin()+eps && a.zmax() >= b.zmax()-eps;
+        switch (wall/2)
+        {
+        case 0:  return y && z;
+        case 1:  return x && z;
+        default: return x && y;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
 AdaptiveMesh::AdaptiveMesh(AdaptiveMeshFile* meshfile, QList<int> fieldIndices, const Box& extent)
 {
     // open the data file
@@ -38,15 +61,22 @@ AdaptiveMesh::AdaptiveMesh(AdaptiveMeshFile* meshfile, QList<int> fieldIndices,
     _fieldvalues.resize(fieldIndices.size());
 
     // construct the root node, and recursively all other nodes
-    // this also fills the _fieldvalues and _leafnodes vectors
-    _root = new AdaptiveMeshNode(extent, uniqueIndices, meshfile, _leafnodes, _fieldvalues);
-    _Ncells = _leafnodes.size();
+    // this also fills the _fieldvalues and leafnodes vectors
+    vector<AdaptiveMeshNode*> leafnodes;
+    AdaptiveMeshNode* root = new AdaptiveMeshNode(extent, uniqueIndices, meshfile, leafnodes, _fieldvalues);
+    _Ncells = leafnodes.size();
 
     // verify that all data was read and close the file
     if (meshfile->read()) throw FATALERROR("Superfluous data in mesh data after all nodes were read");
     meshfile->close();
 
+    // copy the tree into our flat arrays and discard the node objects
+    _leafextents.resize(_Ncells);
+    _root = flatten(root);
+    delete root;
+
     // determine small value relative to the domain extent
+    _extent = extent;
     _eps = 1e-12 * extent.widths().norm();
 
     // clear the density distribution info
@@ -79,7 +109,7 @@ void AdaptiveMesh::addDensityDistribution(int densityField, int densityMultiplie
     {
         double density = _fieldvalues[densityField][m] * densityFraction;
         if (densityMultiplierField >= 0) density *= _fieldvalues[densityMultiplierField][m];
-        if (density > 0) _integratedDensity += density*_leafnodes[m]->volume();
+        if (density > 0) _integratedDensity += density*_leafextents[m].volume();
     }
 }
 
@@ -87,9 +117,15 @@ void AdaptiveMesh::addDensityDistribution(int densityField, int densityMultiplie
 
 void AdaptiveMesh::addNeighbors()
 {
+    if (!_neighbors.empty()) return;
+
+    _neighbors.resize(6*_Ncells);
     for (int m=0; m<_Ncells; m++)
     {
-        _leafnodes[m]->addNeighbors(_root, _eps);
+        for (int wall=BACK; wall<=TOP; wall++)
+        {
+            _neighbors[6*m+wall] = wallNeighbor(m, static_cast<Wall>(wall));
+        }
     }
 }
 
@@ -97,7 +133,113 @@ void AdaptiveMesh::addNeighbors()
 
 AdaptiveMesh::~AdaptiveMesh()
 {
-    delete _root;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int AdaptiveMesh::flatten(const AdaptiveMeshNode* node)
+{
+    // for a leaf node, copy the extent into the leaf array
+    if (node->isLeaf())
+    {
+        int m = node->cellIndex();
+        _leafextents[m] = node->extent();
+        return -m-1;
+    }
+
+    // for a nonleaf node, add an entry to the node arrays and reserve room for the child references
+    int n = _nodeextents.size();
+    int Nx, Ny, Nz;
+    node->numChildren(Nx, Ny, Nz);
+    _nodeextents.push_back(node->extent());
+    _nodegrids.push_back(Nx);
+    _nodegrids.push_back(Ny);
+    _nodegrids.push_back(Nz);
+    int first = _children.size();
+    int numChildren = Nx*Ny*Nz;
+    _nodechildren.push_back(first);
+    _children.resize(first+numChildren);
+
+    // recursively copy the children (the recursive calls may extend the vectors)
+    for (int l=0; l<numChildren; l++)
+    {
+        int ref = flatten(node->child(l));
+        _children[first+l] = ref;
+    }
+    return n;
+}
+
+////////////////////////////////////////////////////////////////////
+
+const Box& AdaptiveMesh::nodeExtent(int ref) const
+{
+    return ref >= 0 ? _nodeextents[ref] : _leafextents[-ref-1];
+}
+
+////////////////////////////////////////////////////////////////////
+
+int AdaptiveMesh::child(int n, Vec r) const
+{
+    // estimate the child node indices; this may be off by one due to rounding errors
+    const int* grid = &_nodegrids[3*n];
+    int Nx = grid[0], Ny = grid[1], Nz = grid[2];
+    int i,j,k;
+    _nodeextents[n].cellindices(i,j,k, r, Nx,Ny,Nz);
+
+    // get the estimated node using local Morton order
+    const int* children = &_children[_nodechildren[n]];
+    int ref = children[(k*Ny+j)*Nx+i];
+
+    // if the point is NOT in the node, correct the indices and get the new node
+    const Box& box = nodeExtent(ref);
+    if (!box.contains(r))
+    {
+        if (r.x() < box.xmin()) i--; else if (r.x() > box.xmax()) i++;
+        if (r.y() < box.ymin()) j--; else if (r.y() > box.ymax()) j++;
+        if (r.z() < box.zmin()) k--; else if (r.z() > box.zmax()) k++;
+        ref = children[(k*Ny+j)*Nx+i];
+        if (!nodeExtent(ref).contains(r)) throw FATALERROR("Can't locate the appropriate child node");
+    }
+    return ref;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int AdaptiveMesh::leafIndex(int ref, Vec r) const
+{
+    if (!nodeExtent(ref).contains(r)) return -1;
+    while (ref >= 0) ref = child(ref, r);
+    return -ref-1;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int AdaptiveMesh::wallNeighbor(int m, Wall wall) const
+{
+    // determine a point just beyond the center of the wall
+    const Box& box = _leafextents[m];
+    Vec c = box.center();
+    Vec r;
+    switch (wall)
+    {
+    case BACK:   r = Vec(box.xmin()-_eps, c.y(), c.z()); break;
+    case FRONT:  r = Vec(box.xmax()+_eps, c.y(), c.z()); break;
+    case LEFT:   r = Vec(c.x(), box.ymin()-_eps, c.z()); break;
+    case RIGHT:  r = Vec(c.x(), box.ymax()+_eps, c.z()); break;
+    case BOTTOM: r = Vec(c.x(), c.y(), box.zmin()-_eps); break;
+    case TOP:    r = Vec(c.x(), c.y(), box.zmax()+_eps); break;
+    }
+    if (!_extent.contains(r)) return NOREF;
+
+    // descend from the root as long as the child containing the point covers the complete wall
+    int ref = _root;
+    while (ref >= 0)
+    {
+        int next = child(ref, r);
+        if (!covers(nodeExtent(next), box, wall, _eps)) break;
+        ref = next;
+    }
+    return ref;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -109,17 +251,25 @@ int AdaptiveMesh::Ncells() const
 
 ////////////////////////////////////////////////////////////////////
 
+size_t AdaptiveMesh::memoryUsage() const
+{
+    return (_nodeextents.capacity() + _leafextents.capacity()) * sizeof(Box)
+            + (_nodegrids.capacity() + _nodechildren.capacity() + _children.capacity() + _neighbors.capacity())
+              * sizeof(int);
+}
+
+////////////////////////////////////////////////////////////////////
+
 int AdaptiveMesh::cellIndex(Position bfr) const
 {
-    const AdaptiveMeshNode* node = _root->whichnode(bfr);
-    return node ? node->cellIndex() : -1;
+    return leafIndex(_root, bfr);
 }
 
 ////////////////////////////////////////////////////////////////////
 
 double AdaptiveMesh::volume() const
 {
-    return _root->volume();
+    return _extent.volume();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -127,14 +277,14 @@ double AdaptiveMesh::volume() const
 double AdaptiveMesh::volume(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return _leafnodes[m]->volume();
+    return _leafextents[m].volume();
 }
 
 ////////////////////////////////////////////////////////////////////
 
 Box AdaptiveMesh::extent() const
 {
-    return _root->extent();
+    return _extent;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -142,7 +292,7 @@ Box AdaptiveMesh::extent() const
 Box AdaptiveMesh::extent(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return _leafnodes[m]->extent();
+    return _leafextents[m];
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -150,7 +300,7 @@ Box AdaptiveMesh::extent(int m) const
 Position AdaptiveMesh::centralPosition(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return Position(_leafnodes[m]->center());
+    return Position(_leafextents[m].center());
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -158,7 +308,7 @@ Position AdaptiveMesh::centralPosition(int m) const
 Position AdaptiveMesh::randomPosition(Random* random, int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return random->position(_leafnodes[m]->extent());
+    return random->position(_leafextents[m]);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -240,8 +390,8 @@ double AdaptiveMesh::SigmaX() const
 {
     const int NSAMPLES = 10000;
     double sum = 0;
-    double xmin = _root->extent().xmin();
-    double xmax = _root->extent().xmax();
+    double xmin = _extent.xmin();
+    double xmax = _extent.xmax();
     for (int k = 0; k < NSAMPLES; k++)
     {
         sum += density(Position(xmin + k*(xmax-xmin)/NSAMPLES, _eps, _eps));
@@ -255,8 +405,8 @@ double AdaptiveMesh::SigmaY() const
 {
     const int NSAMPLES = 10000;
     double sum = 0;
-    double ymin = _root->extent().ymin();
-    double ymax = _root->extent().ymax();
+    double ymin = _extent.ymin();
+    double ymax = _extent.ymax();
     for (int k = 0; k < NSAMPLES; k++)
     {
         sum += density(Position(_eps, ymin + k*(ymax-ymin)/NSAMPLES, _eps));
@@ -270,8 +420,8 @@ double AdaptiveMesh::SigmaZ() const
 {
     const int NSAMPLES = 10000;
     double sum = 0;
-    double zmin = _root->extent().zmin();
-    double zmax = _root->extent().zmax();
+    double zmin = _extent.zmin();
+    double zmax = _extent.zmax();
     for (int k = 0; k < NSAMPLES; k++)
     {
         sum += density(Position(_eps, _eps, zmin + k*(zmax-zmin)/NSAMPLES));
@@ -287,48 +437,50 @@ void AdaptiveMesh::path(DustGridPath* path) const
     path->clear();
 
     // If the photon package starts outside the dust grid, move it into the first grid cell that it will pass
-    Position r = path->moveInside(_root->extent(), _eps);
+    Position r = path->moveInside(_extent, _eps);
 
-    // Get the node containing the current location;
+    // Get the cell containing the current location;
     // if the position is not inside the grid, return an empty path
-    const AdaptiveMeshNode* node = _root->whichnode(r);
-    if (!node) return path->clear();
+    int m = leafIndex(_root, r);
+    if (m<0) return path->clear();
 
-    // Start the loop over nodes/path segments until we leave the grid.
+    // Start the loop over cells/path segments until we leave the grid.
     double kx,ky,kz;
     path->direction().cartesian(kx,ky,kz);
-    while (node)
+    while (m>=0)
     {
-        double xnext = (kx<0.0) ? node->xmin() : node->xmax();
-        double ynext = (ky<0.0) ? node->ymin() : node->ymax();
-        double znext = (kz<0.0) ? node->zmin() : node->zmax();
+        const Box& cell = _leafextents[m];
+        double xnext = (kx<0.0) ? cell.xmin() : cell.xmax();
+        double ynext = (ky<0.0) ? cell.ymin() : cell.ymax();
+        double znext = (kz<0.0) ? cell.zmin() : cell.zmax();
         double dsx = (fabs(kx)>1e-15) ? (xnext-r.x())/kx : DBL_MAX;
         double dsy = (fabs(ky)>1e-15) ? (ynext-r.y())/ky : DBL_MAX;
         double dsz = (fabs(kz)>1e-15) ? (znext-r.z())/kz : DBL_MAX;
 
         double ds;
-        AdaptiveMeshNode::Wall wall;
+        Wall wall;
         if (dsx<=dsy && dsx<=dsz)
         {
             ds = dsx;
-            wall = (kx<0.0) ? AdaptiveMeshNode::BACK : AdaptiveMeshNode::FRONT;
+            wall = (kx<0.0) ? BACK : FRONT;
         }
         else if (dsy<=dsx && dsy<=dsz)
         {
             ds = dsy;
-            wall = (ky<0.0) ? AdaptiveMeshNode::LEFT : AdaptiveMeshNode::RIGHT;
+            wall = (ky<0.0) ? LEFT : RIGHT;
         }
         else
         {
             ds = dsz;
-            wall = (kz<0.0) ? AdaptiveMeshNode::BOTTOM : AdaptiveMeshNode::TOP;
+            wall = (kz<0.0) ? BOTTOM : TOP;
         }
-        path->addSegment(node->cellIndex(), ds);
+        path->addSegment(m, ds);
         r += (ds+_eps)*(path->direction());
 
-        // try the most likely neighbor of the current node, and use top-down search as a fall-back
-        node = node->whichnode(wall,r);
-        if (!node) node = _root->whichnode(r);
+        // descend from the neighbor node beyond the exit wall, and use top-down search as a fall-back
+        int ref = _neighbors.empty() ? NOREF : _neighbors[6*m+wall];
+        m = ref!=NOREF ? leafIndex(ref, r) : -1;
+        if (m<0) m = leafIndex(_root, r);
     }
 }
 
@@ -45,6 +45,14 @@ class Random;
     the leaf nodes form a partition of the domain, i.e. their extents cover the complete domain
     without overlapping one another.
 
+    The tree is built from AdaptiveMeshNode objects while the data file is being read. Once
+    complete, it is copied into a set of flat arrays and the node objects are discarded. The
+    extents of the leaf nodes are stored contiguously in cell order, and each nonleaf node holds
+    its extent, its number of subdivisions and the offset of its child list in a single array of
+    child references. Locating the cell containing a given point starts with an \f${\cal{O}}(1)\f$
+    lookup in the regular grid formed by the children of the root node, followed by a short
+    descent through any finer levels.
+
     For more information on the supported adaptive mesh file formats, refer to the AdaptiveMeshFile
     class and its subclasses.
  */
@@ -80,20 +88,60 @@ public:
     void addDensityDistribution(int densityField, int densityMultiplierField = -1, double densityFraction = 1.);
 
     /** This function adds neighbor information to all leaf nodes in the adaptive mesh.
-        Specifically, each leaf node maintains a list of its most likely neighbor at each of its
-        six walls. This information, while optional, substantially accelerates the operation of the
-        path() function. */
+        Specifically, for each of the six walls of each leaf node, it stores a reference to the
+        smallest node that covers the complete wall from the other side. This is either a leaf
+        node at the same or a coarser level, or a nonleaf node whose subtree holds the (contiguous)
+        range of finer leaf nodes bordering the wall. The path() function then only needs to
+        descend from that node rather than from the root. This information, while optional,
+        substantially accelerates the operation of the path() function. The function does nothing
+        if neighbor information has already been added. */
     void addNeighbors();
 
     /** The destructor releases the data structures allocated during construction. */
     ~AdaptiveMesh();
 
+private:
+    /** This private function copies the information for the specified node, and recursively for
+        all of its children, into the flat arrays held by this instance, and returns a reference to
+        the node. A reference is either the index \f$n\ge 0\f$ of a nonleaf node, or the cell index
+        \f$m\f$ of a leaf node encoded as \f$-m-1\f$. */
+    int flatten(const AdaptiveMeshNode* node);
+
+    /** This private function returns the extent of the node with the specified reference. */
+    const Box& nodeExtent(int ref) const;
+
+    /** This private function returns a reference to the immediate child of the nonleaf node with
+        index \f$n\f$ that contains the specified point, assuming that the point is inside the node
+        (which is not verified). */
+    int child(int n, Vec r) const;
+
+    /** This private function returns the cell index of the leaf node containing the specified
+        point, descending from the node with the specified reference, or -1 if the point is outside
+        of that node. */
+    int leafIndex(int ref, Vec r) const;
+
+    /** This enum contains a constant for each of the walls in a node. The x-coordinate increases
+        from BACK to FRONT, the y-coordinate increases from LEFT to RIGHT, and the z-coordinate
+        increases from BOTTOM to TOP. */
+    enum Wall { BACK=0, FRONT, LEFT, RIGHT, BOTTOM, TOP };
+
+    /** This private function returns a reference to the smallest node that covers the specified
+        wall of the leaf node with cell index \f$m\f$ from the other side, or a special value if the
+        wall lies on the domain boundary (see addNeighbors()). */
+    int wallNeighbor(int m, Wall wall) const;
+
+public:
+
     //=============== Basic getters and interrogation ==============
 
     /** This function returns the number of leaf cells \f$N_\text{cells}\f$ in the mesh represented
         by this instance. */
     int Ncells() const;
 
+    /** This function returns the number of bytes occupied by the flat arrays representing the mesh
+        structure (i.e. excluding the field values). */
+    size_t memoryUsage() const;
+
     /** This function returns the Morton order cell index \f$0\le m \le N_{cells}-1\f$ for the
         cell containing the specified point \f${\bf{r}}\f$. If the point is outside the domain, the
         function returns -1. */
@@ -194,8 +242,9 @@ public:
     //========================= Data members =======================
 
 private:
-    // small fraction of domain extent
-    double _eps;
+    // domain
+    Box _extent;                                // extent of the complete domain
+    double _eps;                                // small fraction of domain extent
 
     // field values
     QHash<int,int> _storageIndices;             // key: field index g    value: storage index s
@@ -209,9 +258,15 @@ private:
     QList<double> _densityFractions;            // indexed on h
     double _integratedDensity;                  // total over all h and m (0 if there is no density distribution)
 
-    // node tree
-    AdaptiveMeshNode* _root;                    // root node representing the complete domain
-    std::vector<AdaptiveMeshNode*> _leafnodes;  // leaf nodes indexed on m
+    // flattened node tree; a node reference is either a nonleaf node index n, or a leaf cell index m encoded as -m-1
+    int _root;                                  // reference to the root node representing the complete domain
+    std::vector<Box> _nodeextents;              // extent of each nonleaf node, indexed on n
+    std::vector<int> _nodegrids;                // number of children in each direction, indexed on 3*n+axis
+    std::vector<int> _nodechildren;             // index in _children of the first child, indexed on n
+    std::vector<int> _children;                 // child references for all nonleaf nodes, in local Morton order
+    std::vector<Box> _leafextents;              // extent of each leaf node, indexed on m
+    std::vector<int> _neighbors;                // node reference beyond each wall, indexed on 6*m+wall
+                                                // (empty if neighbor information has not been added)
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -7,9 +7,11 @@
 #include "AdaptiveMeshDustGridStructure.hpp"
 #include "AdaptiveMeshInterface.hpp"
 #include "DustDistribution.hpp"
+#include "DustGridPath.hpp"
 #include "DustGridPlotFile.hpp"
 #include "FatalError.hpp"
 #include "Log.hpp"
+#include "MemoryStatistics.hpp"
 
 using namespace std;
 
@@ -31,8 +33,11 @@ void AdaptiveMeshDustGridStructure::setupSelfBefore()
     AdaptiveMeshInterface* interface = dd->interface<AdaptiveMeshInterface>();
     if (!interface) throw FATALERROR("Can't find an adaptive mesh in the simulation hierarchy");
     _mesh = interface->mesh();
-    find<Log>()->info("Adding neighbor information to adaptive mesh...");
+    Log* log = find<Log>();
+    log->info("Adding neighbor information to adaptive mesh...");
     _mesh->addNeighbors();
+    log->info("  Mesh structure occupies " + QString::number(_mesh->memoryUsage()/1024./1024., 'f', 1) + " MB; "
+              + MemoryStatistics::reportCurrent());
 
     // calculate the normalization factor imposed by the dust distribution
     // we need this to directly compute cell densities for the DustGridDensityInterface
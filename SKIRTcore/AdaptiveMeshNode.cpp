@@ -58,29 +58,6 @@ AdaptiveMeshNode::AdaptiveMeshNode(const Box& extent, QList<int> fieldIndices, A
 
 ////////////////////////////////////////////////////////////////////
 
-void AdaptiveMeshNode::addNeighbors(AdaptiveMeshNode* root, double eps)
-{
-    // skip if this node has children or if neighbors already have been added
-    if (_nodes.empty())
-    {
-        // node center
-        double xc = (_xmin+_xmax)/2.;
-        double yc = (_ymin+_ymax)/2.;
-        double zc = (_zmin+_zmax)/2.;
-
-        // determine the node just beyond the center of each wall (or null pointer for domain walls)
-        _nodes.resize(6);
-        _nodes[BACK]   = root->whichnode(Vec(_xmin-eps, yc, zc));
-        _nodes[FRONT]  = root->whichnode(Vec(_xmax+eps, yc, zc));
-        _nodes[LEFT]   = root->whichnode(Vec(xc, _ymin-eps, zc));
-        _nodes[RIGHT]  = root->whichnode(Vec(xc, _ymax+eps, zc));
-        _nodes[BOTTOM] = root->whichnode(Vec(xc, yc, _zmin-eps));
-        _nodes[TOP]    = root->whichnode(Vec(xc, yc, _zmax+eps));
-    }
-}
-
-////////////////////////////////////////////////////////////////////
-
 AdaptiveMeshNode::~AdaptiveMeshNode()
 {
     if (!isLeaf())
@@ -106,48 +83,18 @@ bool AdaptiveMeshNode::isLeaf() const
 
 ////////////////////////////////////////////////////////////////////
 
-const AdaptiveMeshNode* AdaptiveMeshNode::child(Vec r) const
+void AdaptiveMeshNode::numChildren(int& Nx, int& Ny, int& Nz) const
 {
-    // estimate the child node indices; this may be off by one due to rounding errors
-    int i,j,k;
-    cellindices(i,j,k, r, _Nx,_Ny,_Nz);
-
-    // get the estimated node using local Morton order
-    const AdaptiveMeshNode* node = _nodes[ (k*_Ny+j)*_Nx+i ];
-
-    // if the point is NOT in the node, correct the indices and get the new node
-    if (!node->contains(r))
-    {
-        if (r.x() < node->xmin()) i--; else if (r.x() > node->xmax()) i++;
-        if (r.y() < node->ymin()) j--; else if (r.y() > node->ymax()) j++;
-        if (r.z() < node->zmin()) k--; else if (r.z() > node->zmax()) k++;
-        node = _nodes[ (k*_Ny+j)*_Nx+i ];
-        if (!node->contains(r)) throw FATALERROR("Can't locate the appropriate child node");
-    }
-    return node;
-}
-
-////////////////////////////////////////////////////////////////////
-
-const AdaptiveMeshNode* AdaptiveMeshNode::whichnode(Vec r) const
-{
-    if (!contains(r)) return 0;
-
-    const AdaptiveMeshNode* node = this;
-    while (!node->isLeaf())
-    {
-        node = node->child(r);
-    }
-    return node;
+    Nx = _Nx;
+    Ny = _Ny;
+    Nz = _Nz;
 }
 
 ////////////////////////////////////////////////////////////////////
 
-const AdaptiveMeshNode* AdaptiveMeshNode::whichnode(AdaptiveMeshNode::Wall wall, Vec r) const
+const AdaptiveMeshNode* AdaptiveMeshNode::child(int l) const
 {
-    const AdaptiveMeshNode* node = _nodes.size()==6 ? _nodes[wall] : 0;
-    if (node && node->contains(r)) return node;
-    else return 0;
+    return _nodes[l];
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -0,0 +1,82 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#include "AliasTable.hpp"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+
+AliasTable::AliasTable()
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+void AliasTable::clear()
+{
+    vector<double>().swap(_prob);
+    vector<int>().swap(_alias);
+}
+
+////////////////////////////////////////////////////////////////////
+
+double AliasTable::build()
+{
+    int N = _prob.size();
+    double total = 0.;
+    for (int m=0; m<N; m++) total += _prob[m];
+    if (!(total > 0.))
+    {
+        clear();
+        return 0.;
+    }
+
+    // scale the weights so that their average is one, and divide the indices into two stacks sharing
+    // a single work vector: "small" indices (scaled weight below one) from the front, "large" ones from the back
+    vector<int> work(N);
+    int Nsmall = 0;
+    int Nlarge = 0;
+    int positive = 0;
+    double scale = N/total;
+    for (int m=0; m<N; m++)
+    {
+        _prob[m] *= scale;
+        _alias[m] = m;
+        if (_prob[m] > 0.) positive = m;
+        if (_prob[m] < 1.) work[Nsmall++] = m;
+        else work[N-1-(Nlarge++)] = m;
+    }
+
+    // fill each small slot with probability donated by a large index
+    while (Nsmall > 0 && Nlarge > 0)
+    {
+        int s = work[--Nsmall];
+        int l = work[N-Nlarge];
+        _alias[s] = l;
+        _prob[l] -= 1.-_prob[s];
+        if (_prob[l] < 1.)
+        {
+            Nlarge--;
+            work[Nsmall++] = l;
+        }
+    }
+
+    // the remaining slots should have a probability of one, except for round-off errors;
+    // make sure that an index with zero weight is never returned
+    while (Nlarge > 0)
+    {
+        _prob[work[N-(Nlarge--)]] = 1.;
+    }
+    while (Nsmall > 0)
+    {
+        int s = work[--Nsmall];
+        if (_prob[s] > 0.) _prob[s] = 1.;
+        else _alias[s] = positive;
+    }
+    return total;
+}
+
+////////////////////////////////////////////////////////////////////
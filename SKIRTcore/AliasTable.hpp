@@ -0,0 +1,78 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef ALIASTABLE_HPP
+#define ALIASTABLE_HPP
+
+#include <vector>
+
+////////////////////////////////////////////////////////////////////
+
+/** An AliasTable instance allows drawing random indices \f$m=0,\ldots,N-1\f$ from a discrete
+    probability distribution with given (unnormalized) weights \f$w_m\f$ in constant time, using
+    the alias method of Walker (1977) with the construction algorithm of Vose (1991). Compared to a
+    binary search in the cumulative distribution, this replaces \f${\cal{O}}(\log N)\f$ steps with
+    random memory accesses by a single table lookup.
+
+    The table is divided into \f$N\f$ slots of equal probability \f$1/N\f$. Each slot \f$i\f$ holds
+    a threshold probability \f$p_i\f$ and an alias index \f$a_i\f$; it returns index \f$i\f$ with
+    probability \f$p_i\f$ and index \f$a_i\f$ otherwise. Indices with zero weight are never
+    returned. The sample() function uses a single uniform deviate to select both the slot and the
+    outcome within the slot. */
+class AliasTable
+{
+public:
+    /** The default constructor creates an empty table. */
+    AliasTable();
+
+    /** This function (re)initializes the table for \f$N\f$ indices, obtaining the weight for each
+        index \f$m\f$ by calling the specified function, which must have the signature "double
+        weight(int m)". Negative weights are treated as zero. The function returns the sum of the
+        weights. If this sum is zero, the table is left empty and should not be sampled. */
+    template<typename Functor> double initialize(int N, Functor weight)
+    {
+        _prob.resize(N);
+        _alias.resize(N);
+        for (int m=0; m<N; m++)
+        {
+            double w = weight(m);
+            _prob[m] = w > 0 ? w : 0.;
+        }
+        return build();
+    }
+
+    /** This function releases the memory held by the table, leaving it empty. */
+    void clear();
+
+    /** This function returns the number of indices \f$N\f$ in the table. */
+    int size() const { return _prob.size(); }
+
+    /** This function returns the index selected by the specified uniform deviate
+        \f${\cal{X}}\in[0,1)\f$. The integer part of \f${\cal{X}}N\f$ selects the slot, and the
+        fractional part is compared to the threshold probability of that slot. */
+    int sample(double X) const
+    {
+        int N = _prob.size();
+        double t = X*N;
+        int i = static_cast<int>(t);
+        if (i >= N) i = N-1;
+        return (t-i) < _prob[i] ? i : _alias[i];
+    }
+
+private:
+    /** This function constructs the threshold probabilities and aliases from the weights stored in
+        the probability vector, and returns the sum of the weights. */
+    double build();
+
+    //======================== Data Members ========================
+
+private:
+    std::vector<double> _prob;   // threshold probability for each slot
+    std::vector<int> _alias;     // alias index for each slot
+};
+
+////////////////////////////////////////////////////////////////////
+
+#endif // ALIASTABLE_HPP
@@ -23,7 +23,7 @@ int AllCellsDustLib::entries() const
 
 ////////////////////////////////////////////////////////////////////
 
-std::vector<int> AllCellsDustLib::mapping() const
+std::vector<int> AllCellsDustLib::mapping()
 {
     // create a mapping from each cell index to identical library index
     int Ncells = find<DustSystem>()->Ncells();
@@ -35,7 +35,7 @@ protected:
     /** This function returns a vector \em nv with length \f$N_{\text{cells}}\f$ that maps each
         cell \f$m\f$ to the corresponding library entry \f$n_m\f$. In this class the function
         returns the identity mapping. */
-    std::vector<int> mapping() const;
+    std::vector<int> mapping();
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -8,7 +8,6 @@
 #include "AxDustGridStructure.hpp"
 #include "DustGridPath.hpp"
 #include "DustGridPlotFile.hpp"
-#include "NR.hpp"
 #include "Random.hpp"
 
 using namespace std;
@@ -22,6 +21,16 @@ AxDustGridStructure::AxDustGridStructure()
 
 //////////////////////////////////////////////////////////////////////
 
+void AxDustGridStructure::setupSelfAfter()
+{
+    DustGridStructure::setupSelfAfter();
+
+    _Rbins.setGrid(_Rv);
+    _zbins.setGrid(_zv);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 int AxDustGridStructure::dimension() const
 {
     return 2;
@@ -74,8 +83,8 @@ int
 AxDustGridStructure::whichcell(Position bfr)
 const
 {
-    int i = NR::locate_fail(_Rv, bfr.cylradius());
-    int k = NR::locate_fail(_zv, bfr.height());
+    int i = _Rbins.locateFail(bfr.cylradius());
+    int k = _zbins.locateFail(bfr.height());
     if (i<0 || k<0) return -1;
     return index(i,k);
 }
@@ -111,6 +120,19 @@ const
 //////////////////////////////////////////////////////////////////////
 
 void AxDustGridStructure::path(DustGridPath* path) const
+{
+    switch (_Rbins.mapping())
+    {
+    case BinLocator::Linear:      return tracePath<BinLocator::Linear>(path);
+    case BinLocator::Logarithmic: return tracePath<BinLocator::Logarithmic>(path);
+    case BinLocator::Power:       return tracePath<BinLocator::Power>(path);
+    default:                      return tracePath<BinLocator::Generic>(path);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+template<BinLocator::Mapping M> void AxDustGridStructure::tracePath(DustGridPath* path) const
 {
     // Determination of the initial position and direction of the path,
     // and calculation of some initial values
@@ -173,8 +195,8 @@ void AxDustGridStructure::path(DustGridPath* path) const
 
     // Determination of the initial grid cell
 
-    int i = NR::locate_clip(_Rv, R);
-    int k = NR::locate_clip(_zv, z);
+    int i = _Rbins.locateClip<M>(R);
+    int k = _zbins.locateClip(z);
 
     // And here we go...
 
@@ -187,7 +209,7 @@ void AxDustGridStructure::path(DustGridPath* path) const
     {
         if (q<0.0)
         {
-            int imin = NR::locate_clip(_Rv, p);
+            int imin = _Rbins.locateClip<M>(p);
             RN = _Rv[i];
             qN = -sqrt((RN-p)*(RN+p));
             zN = _zv[k+1];
@@ -264,7 +286,7 @@ void AxDustGridStructure::path(DustGridPath* path) const
     {
         if (q<0.0)
         {
-            int imin = NR::locate_clip(_Rv, p);
+            int imin = _Rbins.locateClip<M>(p);
             RN = _Rv[i];
             qN = -sqrt((RN-p)*(RN+p));
             zN = _zv[k];
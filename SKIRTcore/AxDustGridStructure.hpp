@@ -7,6 +7,7 @@
 #define AXDUSTGRIDSTRUCTURE_HPP
 
 #include "Array.hpp"
+#include "BinLocator.hpp"
 #include "DustGridStructure.hpp"
 
 //////////////////////////////////////////////////////////////////////
@@ -36,6 +37,12 @@ protected:
     /** The default constructor; it is protected since this is an abstract class. */
     AxDustGridStructure();
 
+    /** This function detects whether the radial and vertical grid points set up by the subclass
+        follow a linear, logarithmic or power-law mapping, so that whichcell() and path() can
+        locate the bin containing a given coordinate in closed form rather than through a binary
+        search. See the BinLocator class for more information. */
+    void setupSelfAfter();
+
     //======================== Other Functions =======================
 
 public:
@@ -88,7 +95,9 @@ public:
 
     /** This function calculates a path through the grid. The DustGridPath object passed as an
         argument specifies the starting position \f${\bf{r}}\f$ and the direction \f${\bf{k}}\f$
-        for the path. The data on the calculated path are added back into the same object. */
+        for the path. The data on the calculated path are added back into the same object. The
+        function dispatches on the mapping of the radial grid points to an instantiation of the
+        tracePath() template. */
     void path(DustGridPath* path) const;
 
 protected:
@@ -111,6 +120,11 @@ private:
         \f$k=m\!\mod N_z\f$. */
     void invertindex(int m, int& i, int& k) const;
 
+    /** This private function implements path() for radial grid points with the mapping specified
+        as template argument, so that the radial bins can be located without a binary search. The
+        vertical bin is located only once for each path, so it uses the run-time mapping. */
+    template<BinLocator::Mapping M> void tracePath(DustGridPath* path) const;
+
     //======================== Data Members ========================
 
 protected:
@@ -121,6 +135,11 @@ protected:
     double _zmin, _zmax;
     Array _Rv;
     Array _zv;
+
+private:
+    // data members initialized during setup
+    BinLocator _Rbins;
+    BinLocator _zbins;
 };
 
 //////////////////////////////////////////////////////////////////////
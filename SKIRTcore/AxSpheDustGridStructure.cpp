@@ -11,7 +11,6 @@
 #include "DustGridPlotFile.hpp"
 #include "FatalError.hpp"
 #include "Log.hpp"
-#include "NR.hpp"
 #include "Random.hpp"
 
 using namespace std;
@@ -45,6 +44,10 @@ void AxSpheDustGridStructure::setupSelfAfter()
         }
     }
     if (countzeroes != 1) throw FATALERROR("the grid point with theta = pi/2 must occur exactly once");
+
+    // prepare the bin locators
+    _rbins.setGrid(_rv);
+    _thetabins.setGrid(_thetav);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -93,9 +96,9 @@ int AxSpheDustGridStructure::whichcell(Position bfr) const
 {
     double r, theta, phi;
     bfr.spherical(r, theta, phi);
-    int i = NR::locate_fail(_rv, r);
+    int i = _rbins.locateFail(r);
     if (i<0) return -1;
-    int k = NR::locate_clip(_thetav, theta);
+    int k = _thetabins.locateClip(theta);
     return index(i,k);
 }
 
@@ -219,8 +222,8 @@ void AxSpheDustGridStructure::path(DustGridPath* path) const
     // Determine the indices of the cell containing the starting point.
     double r, theta, phi;
     bfr.spherical(r, theta, phi);
-    int i = NR::locate_fail(_rv, r);
-    int k = NR::locate_clip(_thetav, theta);
+    int i = _rbins.locateFail(r);
+    int k = _thetabins.locateClip(theta);
 
     // Start the loop over cells/path segments until we leave the grid
     int inext = i;
@@ -295,8 +298,8 @@ void AxSpheDustGridStructure::path(DustGridPath* path) const
             bfr += bfk*eps;
             double r, theta, phi;
             bfr.spherical(r, theta, phi);
-            i = NR::locate_fail(_rv, r);
-            k = NR::locate_clip(_thetav, theta);
+            i = _rbins.locateFail(r);
+            k = _thetabins.locateClip(theta);
         }
     }
 }
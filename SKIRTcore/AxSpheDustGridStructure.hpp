@@ -7,6 +7,7 @@
 #define AXSPHEDUSTGRIDSTRUCTURE_HPP
 
 #include "Array.hpp"
+#include "BinLocator.hpp"
 #include "DustGridStructure.hpp"
 
 //////////////////////////////////////////////////////////////////////
@@ -44,7 +45,9 @@ protected:
 
     /** This function pre-calculates and stores the opening angle cosines \f$c_k = \cos\theta_k\f$
         for the boundary cones in the angular grid, to help speed up calculations in the path()
-        method. */
+        method. It also detects whether the radial and angular grid points follow a linear,
+        logarithmic or power-law mapping, so that the bin containing a given coordinate can be
+        located in closed form rather than through a binary search (see the BinLocator class). */
     void setupSelfAfter();
 
     //======================== Other Functions =======================
@@ -146,6 +149,8 @@ protected:
 
     // data members initialized in this class
     Array _cv;
+    BinLocator _rbins;
+    BinLocator _thetabins;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -0,0 +1,120 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#include "BinLocator.hpp"
+#include "NR.hpp"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+
+BinLocator::BinLocator()
+    : _N(0), _mapping(Generic), _x0(0), _offset(0), _a(0), _b(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // relative tolerance used to decide whether the grid points follow a given mapping
+    const double TOLERANCE = 1e-8;
+
+    // returns true if the specified values, all assumed to be positive, are equal within the tolerance
+    bool equal(double a, double b)
+    {
+        return fabs(a-b) <= TOLERANCE*b;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void BinLocator::setGrid(const Array& xv)
+{
+    _xv = xv;
+    _N = xv.size()-1;
+    _mapping = Generic;
+    _x0 = xv[0];
+    _offset = 0;
+    _a = 0;
+    _b = 0;
+    if (_N < 1) return;
+
+    // linear: equal bin widths
+    double dx = (xv[_N]-xv[0])/_N;
+    bool linear = dx > 0;
+    for (int i=0; i<_N && linear; i++) linear = equal(xv[i+1]-xv[i], dx);
+    if (linear)
+    {
+        _mapping = Linear;
+        _a = 1./dx;
+        return;
+    }
+    if (_N < 2) return;
+
+    // logarithmic: constant ratio between consecutive grid points, ignoring a leading zero
+    int offset = xv[0] == 0. ? 1 : 0;
+    if (xv[offset] > 0. && _N-offset >= 1)
+    {
+        double ratio = pow(xv[_N]/xv[offset], 1./(_N-offset));
+        bool logarithmic = ratio > 1.;
+        for (int i=offset; i<_N && logarithmic; i++) logarithmic = equal(xv[i+1]/xv[i], ratio);
+        if (logarithmic)
+        {
+            _mapping = Logarithmic;
+            _x0 = xv[offset];
+            _offset = offset;
+            _a = 1./log(ratio);
+            return;
+        }
+    }
+
+    // power: constant ratio between consecutive bin widths
+    double w0 = xv[1]-xv[0];
+    double q = pow((xv[_N]-xv[_N-1])/w0, 1./(_N-1));
+    bool power = w0 > 0. && q > 0. && !equal(q, 1.);
+    for (int i=1; i<_N && power; i++) power = equal((xv[i+1]-xv[i])/(xv[i]-xv[i-1]), q);
+    if (power)
+    {
+        _mapping = Power;
+        _a = (q-1.)/w0;
+        _b = 1./log(q);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+int BinLocator::locateClip(double x) const
+{
+    switch (_mapping)
+    {
+    case Linear:      return locateClip<Linear>(x);
+    case Logarithmic: return locateClip<Logarithmic>(x);
+    case Power:       return locateClip<Power>(x);
+    default:          return locateClipGeneric(x);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+int BinLocator::locateFail(double x) const
+{
+    switch (_mapping)
+    {
+    case Linear:      return locateFail<Linear>(x);
+    case Logarithmic: return locateFail<Logarithmic>(x);
+    case Power:       return locateFail<Power>(x);
+    default:          return locateFail<Generic>(x);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+int BinLocator::locateClipGeneric(double x) const
+{
+    return NR::locate_clip(_xv, x);
+}
+
+////////////////////////////////////////////////////////////////////
@@ -0,0 +1,110 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef BINLOCATOR_HPP
+#define BINLOCATOR_HPP
+
+#include <cmath>
+#include "Array.hpp"
+
+////////////////////////////////////////////////////////////////////
+
+/** A BinLocator instance determines the bin containing a given coordinate in an ordered set of
+    \f$N+1\f$ grid points \f$x_i\f$ (with \f$i=0,\ldots,N\f$), with exactly the same result as the
+    NR::locate_clip() and NR::locate_fail() functions. When the grid points are set, the
+    BinLocator detects whether they follow one of the mappings produced by the grid generation
+    functions in the NR namespace:
+
+    - Linear: the grid points are equally spaced, as produced by NR::lingrid().
+    - Logarithmic: the grid points (excluding a leading zero, if present) form a geometric
+      progression, as produced by NR::loggrid() and NR::zerologgrid().
+    - Power: the bin widths form a geometric progression, as produced by NR::powgrid().
+
+    For these mappings, the bin index is calculated in closed form and then corrected for
+    round-off errors by comparing the coordinate to the actual neighboring grid points. For any
+    other set of grid points, the BinLocator falls back to a binary search.
+
+    The locate functions are provided as templates on the mapping, so that client code with a tight
+    loop can dispatch on the mapping once, outside of the loop, and use a specialized instantiation
+    inside the loop. The non-template versions dispatch on the mapping for each call. */
+class BinLocator
+{
+public:
+    /** This enum lists the mappings recognized by the BinLocator class. */
+    enum Mapping { Generic, Linear, Logarithmic, Power };
+
+    /** The default constructor creates a BinLocator without grid points. Its setGrid() function
+        must be called before any of the locate functions can be used. */
+    BinLocator();
+
+    /** This function copies the specified grid points into the BinLocator and detects the mapping
+        they follow. There must be at least two grid points, in increasing order. */
+    void setGrid(const Array& xv);
+
+    /** This function returns the mapping detected for the current grid points. */
+    Mapping mapping() const { return _mapping; }
+
+    /** This function returns the index \f$i\f$ of the bin containing the coordinate \f$x\f$, with
+        the same result as NR::locate_clip(), using the closed-form expression for the specified
+        mapping. The template argument must equal the mapping detected for the grid points. */
+    template<Mapping M> int locateClip(double x) const
+    {
+        if (M == Generic) return locateClipGeneric(x);
+
+        if (x < _xv[0]) return 0;
+        if (x >= _xv[_N]) return _N-1;
+        double t = estimate<M>(x);
+        int i = t > 0. ? (t < _N ? static_cast<int>(t) : _N-1) : 0;
+        while (i > 0 && x < _xv[i]) i--;
+        while (i < _N-1 && x >= _xv[i+1]) i++;
+        return i;
+    }
+
+    /** This function returns the index \f$i\f$ of the bin containing the coordinate \f$x\f$, with
+        the same result as NR::locate_fail(), i.e. it returns -1 if \f$x\f$ is outside of the
+        grid. See locateClip() for the meaning of the template argument. */
+    template<Mapping M> int locateFail(double x) const
+    {
+        if (x < _xv[0] || x > _xv[_N]) return -1;
+        return locateClip<M>(x);
+    }
+
+    /** This function returns the result of the locateClip() template for the detected mapping. */
+    int locateClip(double x) const;
+
+    /** This function returns the result of the locateFail() template for the detected mapping. */
+    int locateFail(double x) const;
+
+private:
+    /** This function returns the (fractional) bin index estimated with the closed-form expression
+        for the specified mapping, assuming that \f$x_0\le x<x_N\f$. */
+    template<Mapping M> double estimate(double x) const
+    {
+        switch (M)
+        {
+        case Linear:      return (x-_x0)*_a;
+        case Logarithmic: return x > _x0 ? _offset + log(x/_x0)*_a : _offset - 1.;
+        case Power:       return log(1. + (x-_x0)*_a) * _b;
+        default:          return 0.;
+        }
+    }
+
+    /** This function performs a binary search, with the same result as NR::locate_clip(). */
+    int locateClipGeneric(double x) const;
+
+    //======================== Data Members ========================
+
+private:
+    Array _xv;          // the grid points
+    int _N;             // the number of bins
+    Mapping _mapping;   // the detected mapping
+    double _x0;         // the first grid point that is part of the mapping
+    int _offset;        // the index of that grid point (nonzero only for a logarithmic grid with leading zero)
+    double _a, _b;      // coefficients for the closed-form expression, depending on the mapping
+};
+
+////////////////////////////////////////////////////////////////////
+
+#endif // BINLOCATOR_HPP
@@ -0,0 +1,245 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#include <cstring>
+#include <QSaveFile>
+#include "Array.hpp"
+#include "Checkpoint.hpp"
+#include "FatalError.hpp"
+#include "Table.hpp"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // the size of a block of values handed to the writer thread (64 MiB)
+    const size_t blockSize = size_t(1) << 26;
+}
+
+////////////////////////////////////////////////////////////////////
+
+Checkpoint::Checkpoint()
+    : _mapped(0), _mappedsize(0), _next(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+Checkpoint::~Checkpoint()
+{
+    _writer.wait();
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::clear()
+{
+    _writer.wait();
+    vector<char>().swap(_data);
+    if (_mapped) _file.unmap(const_cast<uchar*>(reinterpret_cast<const uchar*>(_mapped)));
+    _file.close();
+    _mapped = 0;
+    _mappedsize = 0;
+    _next = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::begin(QString filepath)
+{
+    clear();
+    _data.reserve(blockSize);
+    _writer.open(filepath);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::write(quint64 value)
+{
+    append(&value, sizeof(value));
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::write(const double* data, size_t count)
+{
+    append(data, count*sizeof(double));
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::write(const Array& v)
+{
+    write(static_cast<quint64>(v.size()));
+    if (v.size()) write(&v[0], v.size());
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::write(const Table<2>& t)
+{
+    write(static_cast<quint64>(t.size(0)));
+    write(static_cast<quint64>(t.size(1)));
+    if (t.size(0)*t.size(1)) write(&t(0,0), t.size(0)*t.size(1));
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::save()
+{
+    _writer.flush(_data, true);
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool Checkpoint::wait()
+{
+    _writer.wait();
+    return _writer.success();
+}
+
+////////////////////////////////////////////////////////////////////
+
+Checkpoint::Writer::Writer()
+    : QThread(), _file(0), _commit(false), _success(true)
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+Checkpoint::Writer::~Writer()
+{
+    wait();
+    delete _file;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::Writer::open(QString filepath)
+{
+    wait();
+    delete _file;
+    _file = new QSaveFile(filepath);
+    _success = _file->open(QIODevice::WriteOnly);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::Writer::flush(vector<char>& block, bool commit)
+{
+    wait();
+    _block.swap(block);
+    block.clear();
+    _commit = commit;
+    start();
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::Writer::run()
+{
+    if (!_file) return;
+    if (_success && !_block.empty())
+        _success = _file->write(&_block[0], _block.size()) == static_cast<qint64>(_block.size());
+    vector<char>().swap(_block);
+    if (_commit)
+    {
+        if (!_success) _file->cancelWriting();
+        _success = _file->commit() && _success;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool Checkpoint::load(QString filepath)
+{
+    clear();
+
+    _file.setFileName(filepath);
+    if (!_file.exists()) return false;
+    if (!_file.open(QIODevice::ReadOnly)) throw FATALERROR("Could not open checkpoint file " + filepath);
+    _mappedsize = _file.size();
+    if (_mappedsize)
+    {
+        _mapped = reinterpret_cast<const char*>(_file.map(0, _mappedsize));
+        if (!_mapped) throw FATALERROR("Could not map checkpoint file " + filepath);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+
+quint64 Checkpoint::readInt()
+{
+    quint64 value;
+    extract(&value, sizeof(value));
+    return value;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::read(double* data, size_t count)
+{
+    extract(data, count*sizeof(double));
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::read(Array& v)
+{
+    if (readInt() != v.size()) throw FATALERROR("Checkpoint does not match the simulation");
+    if (v.size()) read(&v[0], v.size());
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::readArray(Array& v)
+{
+    size_t n = readInt();
+    if (n > (_mappedsize - _next) / sizeof(double)) throw FATALERROR("Checkpoint does not match the simulation");
+    v.resize(n);
+    if (n) read(&v[0], n);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::read(Table<2>& t)
+{
+    if (readInt() != t.size(0) || readInt() != t.size(1))
+        throw FATALERROR("Checkpoint does not match the simulation");
+    if (t.size(0)*t.size(1)) read(&t(0,0), t.size(0)*t.size(1));
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::append(const void* bytes, size_t count)
+{
+    const char* begin = static_cast<const char*>(bytes);
+    while (count)
+    {
+        size_t n = min(count, blockSize - _data.size());
+        _data.insert(_data.end(), begin, begin+n);
+        begin += n;
+        count -= n;
+        if (_data.size() == blockSize)
+        {
+            _writer.flush(_data, false);
+            _data.reserve(blockSize);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Checkpoint::extract(void* bytes, size_t count)
+{
+    if (_next + count > _mappedsize) throw FATALERROR("Checkpoint does not match the simulation");
+    memcpy(bytes, _mapped + _next, count);
+    _next += count;
+}
+
+////////////////////////////////////////////////////////////////////
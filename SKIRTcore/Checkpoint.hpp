@@ -0,0 +1,164 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <vector>
+#include <QFile>
+#include <QString>
+#include <QThread>
+class Array;
+class QSaveFile;
+template<size_t NDIM> class Table;
+
+////////////////////////////////////////////////////////////////////
+
+/** A Checkpoint instance holds a binary snapshot of the state of a simulation, so that a
+    simulation interrupted by a failure can be resumed from the most recently completed photon
+    shooting phase rather than from scratch. A snapshot is started with the begin() function,
+    assembled through a series of calls to the write() functions, and completed with the save()
+    function. The values are collected in a memory block of limited size (64 MiB). When the block
+    is full, it is handed to a separate thread that appends it to the file, while the values that
+    follow are collected in a second block. The memory used for writing a snapshot is thus limited
+    to two blocks, regardless of the size of the simulation state. The last block is written and
+    the file is completed by the separate thread as well, so that the simulation can proceed with
+    the next phase while the file is being finished. To resume a simulation, the snapshot is loaded
+    from file with the load() function, after which the read() functions must be called in the
+    same order as the corresponding write() functions. The load() function memory-maps the file,
+    so that the values are copied directly from the file to their destination.
+
+    The same mechanism is used by the DustSystem class to cache the cell densities of a dust grid
+    across simulation runs.
+
+    The snapshot contains just the raw values; it is the responsibility of the client code to
+    include sufficient information to verify that a snapshot matches the simulation being resumed
+    (such as the sizes of the data structures). The read() functions throw a fatal error if the
+    snapshot is exhausted, and the read() function for arrays throws a fatal error if the array
+    size in the snapshot differs from the size of the target array. */
+class Checkpoint
+{
+public:
+    /** The constructor creates an empty checkpoint. */
+    Checkpoint();
+
+    /** The destructor waits for any pending save operation to complete. */
+    ~Checkpoint();
+
+    /** This function discards the current contents of the checkpoint. If a save operation is
+        pending, the function first waits for it to complete. If a file has been loaded, it is
+        unmapped. */
+    void clear();
+
+    /** This function discards the current contents of the checkpoint (see clear()), and starts a
+        new snapshot that will be written to the file with the specified path, preparing for a
+        series of write() calls followed by a call to save(). The file is replaced atomically when
+        the save operation completes, so that an interruption while the snapshot is being written
+        leaves any previously saved checkpoint intact. A failure to write the file is reported by
+        wait(). */
+    void begin(QString filepath);
+
+    /** This function appends the specified integer value to the checkpoint. */
+    void write(quint64 value);
+
+    /** This function appends the specified number of double values, starting at the specified
+        address, to the checkpoint. */
+    void write(const double* data, size_t count);
+
+    /** This function appends the size and the values of the specified array to the checkpoint. */
+    void write(const Array& v);
+
+    /** This function appends the size and the values of the specified table to the checkpoint. */
+    void write(const Table<2>& t);
+
+    /** This function completes the snapshot started by begin(): it starts writing the remaining
+        values and replacing the file on a separate thread, and returns immediately. The functions
+        begin(), clear() and the destructor automatically wait for the save operation to complete.
+        */
+    void save();
+
+    /** This function waits for any pending save operation to complete, and returns true if the
+        most recent save operation succeeded (or if there was no such operation). */
+    bool wait();
+
+    /** This function replaces the contents of the checkpoint by the contents of the file with the
+        specified path, and prepares for a series of read() calls. The file is memory-mapped
+        rather than read into memory. The function returns false if the file does not exist, and
+        throws a fatal error if it exists but cannot be mapped. */
+    bool load(QString filepath);
+
+    /** This function reads the next integer value from the checkpoint. */
+    quint64 readInt();
+
+    /** This function reads the specified number of double values from the checkpoint, and stores
+        them starting at the specified address. */
+    void read(double* data, size_t count);
+
+    /** This function reads the values of the specified array from the checkpoint. */
+    void read(Array& v);
+
+    /** This function reads an array of any size from the checkpoint, and resizes the specified
+        array accordingly before storing the values. */
+    void readArray(Array& v);
+
+    /** This function reads the values of the specified table from the checkpoint. */
+    void read(Table<2>& t);
+
+private:
+    /** The declaration for this class is nested in the Checkpoint class declaration. An instance
+        of this class represents the thread appending a block of values to the file being written.
+        The functions other than run() may be called only while the thread is not running. */
+    class Writer : public QThread
+    {
+    public:
+        /** The constructor creates a writer without an open file. */
+        Writer();
+
+        /** The destructor waits for the thread to finish and discards the file, if any. */
+        ~Writer();
+
+        /** This function discards the file being written, if any, and opens the file with the
+            specified path for a new snapshot. */
+        void open(QString filepath);
+
+        /** This function exchanges the contents of the specified block with the (empty) block of
+            the writer, and starts the thread to append it to the file. If \em commit is true, the
+            thread also completes the file. */
+        void flush(std::vector<char>& block, bool commit);
+
+        /** This function returns true if all operations on the current file succeeded so far. */
+        bool success() const { return _success; }
+
+    protected:
+        /** This function appends the block to the file and, if requested, completes the file. */
+        void run();
+
+    private:
+        QSaveFile* _file;           // the file being written, or null if there is none
+        std::vector<char> _block;   // the block being appended to the file
+        bool _commit;               // true if the file must be completed after appending the block
+        bool _success;              // false if an operation on the current file failed
+    };
+
+    /** This function appends the specified number of bytes to the checkpoint, handing each full
+        block to the writer thread. */
+    void append(const void* bytes, size_t count);
+
+    /** This function copies the specified number of bytes from the checkpoint to the specified
+        address, advancing the read position. */
+    void extract(void* bytes, size_t count);
+
+    // data members
+    std::vector<char> _data;   // the block of values being collected for writing
+    QFile _file;               // the loaded file
+    const char* _mapped;       // the mapped contents of the loaded file, or null if no file is loaded
+    size_t _mappedsize;        // the number of bytes in the mapped contents
+    size_t _next;              // the offset in the mapped contents of the next value to be read
+    Writer _writer;            // the thread performing the save operation
+};
+
+////////////////////////////////////////////////////////////////////
+
+#endif // CHECKPOINT_HPP
@@ -3,6 +3,7 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <cstdlib>
@@ -11,7 +12,6 @@
 #include "DustGridPath.hpp"
 #include "DustGridPlotFile.hpp"
 #include "FatalError.hpp"
-#include "NR.hpp"
 #include "Random.hpp"
 
 using namespace std;
@@ -25,6 +25,17 @@ CubDustGridStructure::CubDustGridStructure()
 
 //////////////////////////////////////////////////////////////////////
 
+void CubDustGridStructure::setupSelfAfter()
+{
+    GenDustGridStructure::setupSelfAfter();
+
+    _xbins.setGrid(_xv);
+    _ybins.setGrid(_yv);
+    _zbins.setGrid(_zv);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 double CubDustGridStructure::xmax() const
 {
     return max(fabs(_xmin),fabs(_xmax));
@@ -55,9 +66,9 @@ double CubDustGridStructure::volume(int m) const
 
 int CubDustGridStructure::whichcell(Position bfr) const
 {
-    int i = NR::locate_fail(_xv, bfr.x());
-    int j = NR::locate_fail(_yv, bfr.y());
-    int k = NR::locate_fail(_zv, bfr.z());
+    int i = _xbins.locateFail(bfr.x());
+    int j = _ybins.locateFail(bfr.y());
+    int k = _zbins.locateFail(bfr.z());
     if (i<0 || j<0 || k<0)
         return -1;
     else
@@ -82,100 +93,15 @@ Position CubDustGridStructure::randomPositionInCell(int m) const
 
 void CubDustGridStructure::path(DustGridPath* path) const
 {
-    // Determination of the initial position and direction of the path,
-    // and calculation of some initial values
+    // Move to the first grid cell that the path will pass; return if it does not pass any grid cell
 
-    path->clear();
+    double x,y,z;
+    int i,j,k;
+    if (!enter(path, x,y,z, i,j,k)) return;
     double kx,ky,kz;
     path->direction().cartesian(kx,ky,kz);
-    double x,y,z;
-    path->position().cartesian(x,y,z);
     double ds, dsx, dsy, dsz;
 
-    // move the photon package to the first grid cell that it will
-    // pass. If it does not pass any grid cell, return an empty path.
-
-    if (x<_xmin)
-    {
-        if (kx<=0.0) return path->clear();
-        else
-        {
-            ds = (_xmin-x)/kx;
-            path->addSegment(-1,ds);
-            x = _xmin + 1e-8*(_xv[1]-_xv[0]);
-            y += ky*ds;
-            z += kz*ds;
-        }
-    }
-    else if (x>_xmax)
-    {
-        if (kx>=0.0) return path->clear();
-        else
-        {
-            ds = (_xmax-x)/kx;
-            path->addSegment(-1,ds);
-            x = _xmax - 1e-8*(_xv[_Nx]-_xv[_Nx-1]);
-            y += ky*ds;
-            z += kz*ds;
-        }
-    }
-    if (y<_ymin)
-    {
-        if (ky<=0.0) return path->clear();
-        else
-        {
-            ds = (_ymin-y)/ky;
-            path->addSegment(-1,ds);
-            x += kx*ds;
-            y = _ymin + 1e-8*(_yv[1]-_yv[0]);
-            z += kz*ds;
-        }
-    }
-    else if (y>_ymax)
-    {
-        if (ky>=0.0) return path->clear();
-        else
-        {
-            ds = (_ymax-y)/ky;
-            path->addSegment(-1,ds);
-            x += kx*ds;
-            y = _ymax - 1e-8*(_yv[_Ny]-_yv[_Ny-1]);
-            z += kz*ds;
-        }
-    }
-    if (z<_zmin)
-    {
-        if (kz<=0.0) return path->clear();
-        else
-        {
-            ds = (_zmin-z)/kz;
-            path->addSegment(-1,ds);
-            x += kx*ds;
-            y += ky*ds;
-            z = _zmin + 1e-8*(_zv[1]-_zv[0]);
-        }
-    }
-    else if (z>_zmax)
-    {
-        if (kz>=0.0) return path->clear();
-        else
-        {
-            ds = (_zmax-z)/kz;
-            path->addSegment(-1,ds);
-            x += kx*ds;
-            y += ky*ds;
-            z = _zmax - 1e-8*(_zv[_Nz]-_zv[_Nz-1]);
-        }
-    }
-
-    if (x<_xmin || x>_xmax || y<_ymin || y>_ymax || z<_zmin || z>_zmax) return path->clear();
-
-    // Now determine which grid cell we are in...
-
-    int i = NR::locate_clip(_xv, x);
-    int j = NR::locate_clip(_yv, y);
-    int k = NR::locate_clip(_zv, z);
-
     // And there we go...
 
     while (true)
@@ -231,6 +157,113 @@ void CubDustGridStructure::path(DustGridPath* path) const
 
 //////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    // the maximum number of paths advanced together by CubDustGridStructure::paths()
+    const int maxBatchSize = 16;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void CubDustGridStructure::paths(DustGridPath* const* pathv, int count) const
+{
+    // Process the paths in batches of limited size, so that their state fits in arrays on the stack
+    if (count > maxBatchSize)
+    {
+        for (int p=0; p<count; p+=maxBatchSize) paths(pathv+p, min(maxBatchSize, count-p));
+        return;
+    }
+
+    // Move each path to the first grid cell that it will pass, and store the state of the
+    // paths that pass through the grid in separate arrays for each quantity
+    DustGridPath* pv[maxBatchSize];
+    double xv[maxBatchSize], yv[maxBatchSize], zv[maxBatchSize];
+    double kxv[maxBatchSize], kyv[maxBatchSize], kzv[maxBatchSize];
+    int iv[maxBatchSize], jv[maxBatchSize], kv[maxBatchSize];
+    int N = 0;
+    for (int p=0; p<count; p++)
+    {
+        if (enter(pathv[p], xv[N],yv[N],zv[N], iv[N],jv[N],kv[N]))
+        {
+            pv[N] = pathv[p];
+            pathv[p]->direction().cartesian(kxv[N],kyv[N],kzv[N]);
+            N++;
+        }
+    }
+
+    // Advance all active paths by one cell in each iteration, using exactly the same
+    // arithmetic as the path() function, and drop the paths that leave the grid
+    double xEv[maxBatchSize], yEv[maxBatchSize], zEv[maxBatchSize];
+    double dsxv[maxBatchSize], dsyv[maxBatchSize], dszv[maxBatchSize];
+    while (N > 0)
+    {
+        // calculate the distance to the exit wall in each direction for all paths
+        for (int a=0; a<N; a++)
+        {
+            xEv[a] = (kxv[a]<0.0) ? _xv[iv[a]] : _xv[iv[a]+1];
+            yEv[a] = (kyv[a]<0.0) ? _yv[jv[a]] : _yv[jv[a]+1];
+            zEv[a] = (kzv[a]<0.0) ? _zv[kv[a]] : _zv[kv[a]+1];
+            dsxv[a] = (fabs(kxv[a])>1e-15) ? (xEv[a]-xv[a])/kxv[a] : DBL_MAX;
+            dsyv[a] = (fabs(kyv[a])>1e-15) ? (yEv[a]-yv[a])/kyv[a] : DBL_MAX;
+            dszv[a] = (fabs(kzv[a])>1e-15) ? (zEv[a]-zv[a])/kzv[a] : DBL_MAX;
+        }
+
+        // add the segment for the current cell to each path, and move it to the next cell
+        int next = 0;
+        for (int a=0; a<N; a++)
+        {
+            int m = index(iv[a],jv[a],kv[a]);
+            double dsx = dsxv[a];
+            double dsy = dsyv[a];
+            double dsz = dszv[a];
+            bool inside = true;
+            if (dsx<=dsy && dsx<=dsz)
+            {
+                pv[a]->addSegment(m, dsx);
+                iv[a] += (kxv[a]<0.0) ? -1 : 1;
+                inside = iv[a]<_Nx && iv[a]>=0;
+                xv[a] = xEv[a];
+                yv[a] += kyv[a]*dsx;
+                zv[a] += kzv[a]*dsx;
+            }
+            else if (dsy< dsx && dsy<=dsz)
+            {
+                pv[a]->addSegment(m, dsy);
+                jv[a] += (kyv[a]<0.0) ? -1 : 1;
+                inside = jv[a]<_Ny && jv[a]>=0;
+                xv[a] += kxv[a]*dsy;
+                yv[a] = yEv[a];
+                zv[a] += kzv[a]*dsy;
+            }
+            else if (dsz< dsx && dsz< dsy)
+            {
+                pv[a]->addSegment(m, dsz);
+                kv[a] += (kzv[a]<0.0) ? -1 : 1;
+                inside = kv[a]<_Nz && kv[a]>=0;
+                xv[a] += kxv[a]*dsz;
+                yv[a] += kyv[a]*dsz;
+                zv[a] = zEv[a];
+            }
+
+            // keep the path if it is still inside the grid
+            if (inside)
+            {
+                if (next != a)
+                {
+                    pv[next] = pv[a];
+                    xv[next] = xv[a];   yv[next] = yv[a];   zv[next] = zv[a];
+                    kxv[next] = kxv[a]; kyv[next] = kyv[a]; kzv[next] = kzv[a];
+                    iv[next] = iv[a];   jv[next] = jv[a];   kv[next] = kv[a];
+                }
+                next++;
+            }
+        }
+        N = next;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void CubDustGridStructure::write_xy(DustGridPlotFile* outfile) const
 {
     for (int i=0; i<=_Nx; i++) outfile->writeLine(_xv[i], _ymin, _xv[i], _ymax);
@@ -290,3 +323,102 @@ Box CubDustGridStructure::box(int m) const
 }
 
 //////////////////////////////////////////////////////////////////////
+
+bool CubDustGridStructure::enter(DustGridPath* path, double& x, double& y, double& z, int& i, int& j, int& k) const
+{
+    // Determination of the initial position and direction of the path,
+    // and calculation of some initial values
+
+    path->clear();
+    double kx,ky,kz;
+    path->direction().cartesian(kx,ky,kz);
+    path->position().cartesian(x,y,z);
+    double ds;
+
+    // move the photon package to the first grid cell that it will
+    // pass. If it does not pass any grid cell, return an empty path.
+
+    if (x<_xmin)
+    {
+        if (kx<=0.0) { path->clear(); return false; }
+        else
+        {
+            ds = (_xmin-x)/kx;
+            path->addSegment(-1,ds);
+            x = _xmin + 1e-8*(_xv[1]-_xv[0]);
+            y += ky*ds;
+            z += kz*ds;
+        }
+    }
+    else if (x>_xmax)
+    {
+        if (kx>=0.0) { path->clear(); return false; }
+        else
+        {
+            ds = (_xmax-x)/kx;
+            path->addSegment(-1,ds);
+            x = _xmax - 1e-8*(_xv[_Nx]-_xv[_Nx-1]);
+            y += ky*ds;
+            z += kz*ds;
+        }
+    }
+    if (y<_ymin)
+    {
+        if (ky<=0.0) { path->clear(); return false; }
+        else
+        {
+            ds = (_ymin-y)/ky;
+            path->addSegment(-1,ds);
+            x += kx*ds;
+            y = _ymin + 1e-8*(_yv[1]-_yv[0]);
+            z += kz*ds;
+        }
+    }
+    else if (y>_ymax)
+    {
+        if (ky>=0.0) { path->clear(); return false; }
+        else
+        {
+            ds = (_ymax-y)/ky;
+            path->addSegment(-1,ds);
+            x += kx*ds;
+            y = _ymax - 1e-8*(_yv[_Ny]-_yv[_Ny-1]);
+            z += kz*ds;
+        }
+    }
+    if (z<_zmin)
+    {
+        if (kz<=0.0) { path->clear(); return false; }
+        else
+        {
+            ds = (_zmin-z)/kz;
+            path->addSegment(-1,ds);
+            x += kx*ds;
+            y += ky*ds;
+            z = _zmin + 1e-8*(_zv[1]-_zv[0]);
+        }
+    }
+    else if (z>_zmax)
+    {
+        if (kz>=0.0) { path->clear(); return false; }
+        else
+        {
+            ds = (_zmax-z)/kz;
+            path->addSegment(-1,ds);
+            x += kx*ds;
+            y += ky*ds;
+            z = _zmax - 1e-8*(_zv[_Nz]-_zv[_Nz-1]);
+        }
+    }
+
+    if (x<_xmin || x>_xmax || y<_ymin || y>_ymax || z<_zmin || z>_zmax) { path->clear(); return false; }
+
+    // Now determine which grid cell we are in...
+
+    i = _xbins.locateClip(x);
+    j = _ybins.locateClip(y);
+    k = _zbins.locateClip(z);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
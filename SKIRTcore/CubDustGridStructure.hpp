@@ -7,6 +7,7 @@
 #define CUBDUSTGRIDSTRUCTURE_HPP
 
 #include "Array.hpp"
+#include "BinLocator.hpp"
 #include "GenDustGridStructure.hpp"
 class Box;
 
@@ -30,6 +31,14 @@ protected:
     /** The default constructor; it is protected since this is an abstract class. */
     CubDustGridStructure();
 
+    /** This function determines, for each of the X, Y and Z directions, whether the grid points
+        set up by the subclass follow a linear, logarithmic or power-law mapping. For such an
+        axis, the bin containing a given coordinate is then calculated directly rather than
+        through a binary search, which speeds up whichcell() and path(). The result is identical
+        in both cases, since the directly calculated bin index is corrected for round-off errors
+        by comparing the coordinate to the actual grid points (see the BinLocator class). */
+    void setupSelfAfter();
+
     //======================== Other Functions =======================
 
 public:
@@ -80,6 +89,15 @@ public:
         for the path. The data on the calculated path are added back into the same object. */
     void path(DustGridPath* path) const;
 
+    /** This function calculates the paths through the grid for a batch of DustGridPath objects,
+        with exactly the same result as calling path() for each of them. After moving each path
+        to its entry point in the grid, the function advances all paths in lockstep, one cell per
+        iteration. The positions, directions and bin indices of the active paths are stored in
+        separate arrays, so that the distances to the cell walls can be calculated for all paths
+        in a single loop that is amenable to vectorization by the compiler. Larger batches are
+        processed in blocks of at most 16 paths, so that this state fits in arrays on the stack. */
+    void paths(DustGridPath* const* pathv, int count) const;
+
 protected:
     /** This function writes the intersection of the dust grid structure with the xy plane
         to the specified DustGridPlotFile object. */
@@ -110,6 +128,13 @@ private:
         m\,{\text{mod}}\,N_z. \end{split} \f] */
     Box box(int m) const;
 
+    /** This function moves the specified path to the first grid cell that it will cross, adding a
+        segment with cell number -1 for the distance covered outside of the grid if needed. It
+        stores the position after this move and the bin indices of the first grid cell in the
+        output arguments. The function returns false (after clearing the path) if the path does
+        not cross the grid at all. */
+    bool enter(DustGridPath* path, double& x, double& y, double& z, int& i, int& j, int& k) const;
+
     //======================== Data Members ========================
 
 protected:
@@ -123,6 +148,10 @@ protected:
     Array _xv;
     Array _yv;
     Array _zv;
+
+private:
+    // data members initialized during setup
+    BinLocator _xbins, _ybins, _zbins;
 };
 
 ////////////////////////////////////////////////////////////////////
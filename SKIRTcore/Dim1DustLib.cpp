@@ -16,7 +16,7 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////
 
 Dim1DustLib::Dim1DustLib()
-    : _NU(0)
+    : _NU(0), _JtotMW(0)
 {
 }
 
@@ -45,26 +45,25 @@ int Dim1DustLib::entries() const
 
 ////////////////////////////////////////////////////////////////////
 
-std::vector<int> Dim1DustLib::mapping() const
+std::vector<int> Dim1DustLib::mapping()
 {
     // get basic information about the wavelength grid and the dust system
     WavelengthGrid* lambdagrid = find<WavelengthGrid>();
-    PanDustSystem* ds = find<PanDustSystem>();
-    int Ncells = ds->Ncells();
+    int Ncells = find<PanDustSystem>()->Ncells();
 
-    // calculate the properties of the ISRF in all cells of the dust system;
-    // remember the minimum and maximum values of the strength of the ISRF
-    double JtotMW = ( ISRF::mathis(lambdagrid) * lambdagrid->dlambdav() ).sum();
+    // calculate the strength of the ISRF in all cells of the dust system
+    _dlambdav = lambdagrid->dlambdav();
+    _JtotMW = ( ISRF::mathis(lambdagrid) * _dlambdav ).sum();
+    calculatefieldproperties(1, 1);
+
+    // determine the minimum and maximum values of the strength of the ISRF
     double Umin = DBL_MAX;
     double Umax = 0.0;
     vector<double> Ucellv(Ncells);
     for (int m=0; m<Ncells; m++)
     {
-        double Jtot = ( ds->meanintensityv(m) * lambdagrid->dlambdav() ).sum();
-        double U = Jtot/JtotMW;
-        // ignore cells with extremely small radiation fields (compared to the average in the Milky Way)
-        // to avoid wasting library grid points on fields that won't change simulation results anyway
-        if (U > 1e-6)
+        double U = fieldproperty(m,0);
+        if (U > 0.0)
         {
             Ucellv[m] = U;
             Umin = min(Umin,U);
@@ -97,3 +96,24 @@ std::vector<int> Dim1DustLib::mapping() const
 }
 
 ////////////////////////////////////////////////////////////////////
+
+void Dim1DustLib::fieldmoments(int /*m*/, const Array& Jv, Array& momentv) const
+{
+    int Nlambda = Jv.size();
+    double Jtot = 0.0;
+    for (int ell=0; ell<Nlambda; ell++) Jtot += Jv[ell] * _dlambdav[ell];
+    momentv[0] = Jtot;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Dim1DustLib::fieldproperties(int /*m*/, const Array& momentv, Array& propv) const
+{
+    double U = momentv[0]/_JtotMW;
+
+    // ignore cells with extremely small radiation fields (compared to the average in the Milky Way)
+    // to avoid wasting library grid points on fields that won't change simulation results anyway
+    propv[0] = U > 1e-6 ? U : 0.0;
+}
+
+////////////////////////////////////////////////////////////////////
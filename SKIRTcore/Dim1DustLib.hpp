@@ -62,14 +62,32 @@ protected:
         U_{\text{min}} } \right)^{n/N_U} \qquad n=0,\ldots,N_U, \f] where \f$U_{\text{min}}\f$ and
         \f$U_{\text{max}}\f$ represent the smallest and largest values of the ISRF strength found
         among all dust cells. Then the function determines for each cell \f$m\f$ the corresponding
-        library entry \f$n\f$. */
-    std::vector<int> mapping() const;
+        library entry \f$n\f$. The values \f$U_m\f$ are calculated in parallel by the
+        calculatefieldproperties() function of the base class, which keeps the previous value for
+        cells with a sufficiently small change in absorbed luminosity if the mapping tolerance is
+        nonzero. */
+    std::vector<int> mapping();
+
+    /** This function stores the integrated mean intensity \f$J_m=\int J_\lambda\,{\text{d}}\lambda\f$
+        of the dust cell with cell number \f$m\f$, given its mean intensity, as the single moment
+        in \em momentv. */
+    void fieldmoments(int m, const Array& Jv, Array& momentv) const;
+
+    /** This function stores the strength \f$U_m\f$ of the radiation field in the dust cell with
+        cell number \f$m\f$, given its integrated mean intensity, as the single property in \em
+        propv. Values that are extremely small compared to the radiation field in the Milky Way are
+        replaced by zero. */
+    void fieldproperties(int m, const Array& momentv, Array& propv) const;
 
     //======================== Data Members ========================
 
 private:
     // discoverable properties
-    int _NU;        // number of library entries
+    int _NU;            // number of library entries
+
+    // data initialized by mapping() for use by fieldmoments() and fieldproperties()
+    Array _dlambdav;    // wavelength bin widths
+    double _JtotMW;     // integrated ISRF in the Milky Way
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -17,7 +17,7 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////
 
 Dim2DustLib::Dim2DustLib()
-    : _NT(0), _NW(0)
+    : _NT(0), _NW(0), _ds(0)
 {
 }
 
@@ -67,18 +67,20 @@ int Dim2DustLib::entries() const
 
 ////////////////////////////////////////////////////////////////////
 
-std::vector<int> Dim2DustLib::mapping() const
+std::vector<int> Dim2DustLib::mapping()
 {
     // get basic information about the wavelength grid and the dust system
     WavelengthGrid* lambdagrid = find<WavelengthGrid>();
-    PanDustSystem* ds = find<PanDustSystem>();
-    int Nlambda = lambdagrid->Nlambda();
-    int Ncells = ds->Ncells();
-    int Ncomp = ds->Ncomp();
+    _ds = find<PanDustSystem>();
+    int Ncells = _ds->Ncells();
     Log* log = find<Log>();
     Units* units = find<Units>();
 
-    // calculate the properties of the ISRF in all cells of the dust system;
+    // calculate the properties of the ISRF in all cells of the dust system
+    _lambdav = lambdagrid->lambdav();
+    _dlambdav = lambdagrid->dlambdav();
+    calculatefieldproperties(2*_ds->Ncomp(), 2);
+
     // determine the minimum and maximum values of the mean temperature and mean wavelength
     double Tmin = DBL_MAX;
     double Tmax = 0.0;
@@ -88,30 +90,10 @@ std::vector<int> Dim2DustLib::mapping() const
     Array lambdameanv(Ncells);
     for (int m=0; m<Ncells; m++)
     {
-        if (ds->Labs(m) > 0.0)
+        Tmeanv[m] = fieldproperty(m,0);
+        lambdameanv[m] = fieldproperty(m,1);
+        if (Tmeanv[m] > 0.0 && lambdameanv[m] > 0.0)
         {
-            const Array& Jv = ds->meanintensityv(m);
-            double sumrho = 0.;
-            for (int h=0; h<Ncomp; h++)
-            {
-                double sum0 = 0.0;
-                double sum1 = 0.0;
-                for (int ell=0; ell<Nlambda; ell++)
-                {
-                    double lambda = lambdagrid->lambda(ell);
-                    double dlambda = lambdagrid->dlambda(ell);
-                    double sigmaJ = ds->mix(h)->sigmaabs(ell) * Jv[ell];
-                    sum0 += sigmaJ * dlambda;
-                    sum1 += sigmaJ * lambda * dlambda;
-                }
-                double rho = ds->density(m,h);
-                Tmeanv[m] += rho * ds->mix(h)->invplanckabs(sum0);
-                lambdameanv[m] += rho * (sum1/sum0);
-                sumrho += rho;
-            }
-            Tmeanv[m] /= sumrho;
-            lambdameanv[m] /= sumrho;
-
             Tmin = min(Tmin,Tmeanv[m]);
             Tmax = max(Tmax,Tmeanv[m]);
             lambdamin = min(lambdamin,lambdameanv[m]);
@@ -154,3 +136,47 @@ std::vector<int> Dim2DustLib::mapping() const
 }
 
 ////////////////////////////////////////////////////////////////////
+
+void Dim2DustLib::fieldmoments(int /*m*/, const Array& Jv, Array& momentv) const
+{
+    int Nlambda = Jv.size();
+    int Ncomp = _ds->Ncomp();
+    for (int h=0; h<Ncomp; h++)
+    {
+        const DustMix* mix = _ds->mix(h);
+        double sum0 = 0.0;
+        double sum1 = 0.0;
+        for (int ell=0; ell<Nlambda; ell++)
+        {
+            double sigmaJdlambda = mix->sigmaabs(ell) * Jv[ell] * _dlambdav[ell];
+            sum0 += sigmaJdlambda;
+            sum1 += sigmaJdlambda * _lambdav[ell];
+        }
+        momentv[2*h] = sum0;
+        momentv[2*h+1] = sum1;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Dim2DustLib::fieldproperties(int m, const Array& momentv, Array& propv) const
+{
+    int Ncomp = _ds->Ncomp();
+    double Tmean = 0.;
+    double lambdamean = 0.;
+    double sumrho = 0.;
+    for (int h=0; h<Ncomp; h++)
+    {
+        const DustMix* mix = _ds->mix(h);
+        double sum0 = momentv[2*h];
+        double sum1 = momentv[2*h+1];
+        double rho = _ds->density(m,h);
+        Tmean += rho * mix->invplanckabs(sum0);
+        lambdamean += rho * (sum1/sum0);
+        sumrho += rho;
+    }
+    propv[0] = Tmean/sumrho;
+    propv[1] = lambdamean/sumrho;
+}
+
+////////////////////////////////////////////////////////////////////
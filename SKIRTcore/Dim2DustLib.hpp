@@ -93,15 +93,34 @@ protected:
         {\bar{\lambda}}_{\text{min}} \left( \frac{ {\bar{\lambda}}_{\text{max}} }{
         {\bar{\lambda}}_{\text{min}} } \right)^{j/N_{\bar{\lambda}}} \qquad
         j=0,\ldots,N_{\bar{\lambda}}. \f] The function then calculates for each cell \f$m\f$ its
-        library entry \f$n \equiv (i,j)\f$. */
-    std::vector<int> mapping() const;
+        library entry \f$n \equiv (i,j)\f$. The values \f${\bar{T}}_m\f$ and
+        \f${\bar{\lambda}}_m\f$ are calculated in parallel by the calculatefieldproperties()
+        function of the base class, which keeps the previous values for cells with a sufficiently
+        small change in absorbed luminosity if the mapping tolerance is nonzero. */
+    std::vector<int> mapping();
+
+    /** This function stores the integrals \f$\int\sigma_{\lambda,h}^{\text{abs}}
+        J_\lambda\,{\text{d}}\lambda\f$ and \f$\int\sigma_{\lambda,h}^{\text{abs}}
+        J_\lambda\,\lambda\,{\text{d}}\lambda\f$ for each dust component \f$h\f$ of the dust
+        cell with cell number \f$m\f$, given its mean intensity, as the moments in \em momentv. */
+    void fieldmoments(int m, const Array& Jv, Array& momentv) const;
+
+    /** This function stores the mean temperature \f${\bar{T}}_m\f$ and the mean wavelength
+        \f${\bar{\lambda}}_m\f$ of the dust cell with cell number \f$m\f$, given the moments
+        calculated by fieldmoments(), as the two properties in \em propv. */
+    void fieldproperties(int m, const Array& momentv, Array& propv) const;
 
     //======================== Data Members ========================
 
 private:
     // discoverable properties
-    int _NT;        // number of mean temperature grid points
-    int _NW;        // number of mean wavelength grid points
+    int _NT;            // number of mean temperature grid points
+    int _NW;            // number of mean wavelength grid points
+
+    // data initialized by mapping() for use by fieldmoments() and fieldproperties()
+    PanDustSystem* _ds;
+    Array _lambdav;     // wavelengths
+    Array _dlambdav;    // wavelength bin widths
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -106,6 +106,13 @@ Direction DistantInstrument::bfkobs(const Position& /*bfr*/) const
 
 ////////////////////////////////////////////////////////////////////
 
+bool DistantInstrument::hasFixedDirection() const
+{
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+
 void DistantInstrument::calibrateAndWriteSEDs(QList< Array* > Farrays, QStringList Fnames)
 {
     WavelengthGrid* lambdagrid = find<WavelengthGrid>();
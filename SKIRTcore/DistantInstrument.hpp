@@ -108,6 +108,10 @@ public:
         is sufficiently large. */
     Direction bfkobs(const Position& bfr) const;
 
+    /** Returns true, since the direction towards a distant observer does not depend on the
+        launching position. */
+    bool hasFixedDirection() const;
+
 protected:
     /** This convenience function calibrates one or more integrated luminosity data vectors
         gathered by a DistantInstrument subclass, and outputs them as columns in a single SED text
@@ -117,6 +117,20 @@ double DustGridStructure::weight(int m) const
 
 //////////////////////////////////////////////////////////////////////
 
+void DustGridStructure::paths(DustGridPath* const* pathv, int count) const
+{
+    for (int p=0; p<count; p++) path(pathv[p]);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int DustGridStructure::cellAtOutputIndex(int i) const
+{
+    return i;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void DustGridStructure::write_xy(DustGridPlotFile* /*outfile*/) const
 {
 }
@@ -115,6 +115,20 @@ public:
         the end of each cell is encountered. */
     virtual void path(DustGridPath* path) const = 0;
 
+    /** This function calculates the paths through the grid for a batch of \em count DustGridPath
+        objects, each specifying a starting position and direction, with exactly the same result
+        as calling path() for each of them in turn. It is used for the peel off photon packages
+        launched towards all distant instruments at once (see DustSystem::opticaldepths()). The default
+        implementation simply calls path() for each object; a subclass may override it to advance
+        the paths together so that the arithmetic can be vectorized. */
+    virtual void paths(DustGridPath* const* pathv, int count) const;
+
+    /** This function returns the number of the dust cell that should be reported at index \em i
+        in per-cell output files. Grid structures that reorder their cells internally (for example,
+        to improve memory locality) override this function so that such files still list the
+        cells in their original order. The default implementation simply returns \em i. */
+    virtual int cellAtOutputIndex(int i) const;
+
 protected:
     /** This virtual function writes the intersection of the dust grid structure with the xy plane
         to the specified DustGridPlotFile object. The default implementation does nothing. */
@@ -4,13 +4,16 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include <QMultiHash>
+#include "Checkpoint.hpp"
 #include "DustLib.hpp"
 #include "DustEmissivity.hpp"
+#include "FatalError.hpp"
 #include "Log.hpp"
 #include "NR.hpp"
 #include "PanDustSystem.hpp"
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
+#include "ProcessCommunicator.hpp"
 #include "WavelengthGrid.hpp"
 
 using namespace std;
@@ -18,36 +21,77 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////
 
 DustLib::DustLib()
+    : _mappingTolerance(0), _lambdastride(1), _ds(0), _parfac(0)
 {
 }
 
 ////////////////////////////////////////////////////////////////////
 
+void DustLib::setMappingTolerance(double value)
+{
+    _mappingTolerance = value;
+}
+
+////////////////////////////////////////////////////////////////////
+
+double DustLib::mappingTolerance() const
+{
+    return _mappingTolerance;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::setCacheTolerance(double value)
+{
+    _cache.setTolerance(value);
+}
+
+////////////////////////////////////////////////////////////////////
+
+double DustLib::cacheTolerance() const
+{
+    return _cache.tolerance();
+}
+
+////////////////////////////////////////////////////////////////////
+
 namespace
 {
+    // the maximum number of values in the tables exchanged between processes for a block of library entries (32 MiB)
+    const size_t maxBlockValues = size_t(1) << 22;
+
     class EmissionCalculator : public ParallelTarget
     {
     private:
         // data members initialized in constructor
-        ArrayTable<2>& _Lvv;        // output luminosities indexed on m or n and ell (writable reference)
+        ArrayTable<2>& _Lvv;        // output luminosities indexed on m or n and (local) ell (writable reference)
+        EmissivityCache* _cache;    // emissivities from the previous invocation, if enabled
         QMultiHash<int,int> _mh;    // hash map <n,m> of cells for each library entry
         Log* _log;
         PanDustSystem* _ds;
         DustEmissivity* _de;
         WavelengthGrid* _lambdagrid;
+        ProcessCommunicator* _comm;
         int _Nlambda;
         int _Ncomp;
 
+        // data members used in data-parallel mode for the block of library entries being handled
+        int _firstentry;            // the index of the first library entry in the block
+        Table<2> _Jvv;              // mean intensities indexed on n-_firstentry and ell
+        Table<3> _evvv;             // emissivities indexed on n-_firstentry, h and ell
+
     public:
         // constructor
-        EmissionCalculator(ArrayTable<2>& Lvv, vector<int>& nv, int Nlib, SimulationItem* item)
-            : _Lvv(Lvv)
+        EmissionCalculator(ArrayTable<2>& Lvv, vector<int>& nv, int Nlib, EmissivityCache* cache,
+                           SimulationItem* item)
+            : _Lvv(Lvv), _cache(cache), _firstentry(0)
         {
             // get basic information about the wavelength grid and the dust system
             _log = item->find<Log>();
             _ds = item->find<PanDustSystem>();
             _de = item->find<DustEmissivity>();
             _lambdagrid = item->find<WavelengthGrid>();
+            _comm = item->find<ProcessCommunicator>();
             _Nlambda = _lambdagrid->Nlambda();
             _Ncomp = _ds->Ncomp();
 
@@ -61,9 +105,10 @@ namespace
             _log->info("Library entries in use: " + QString::number(Nused) +
                                        " out of " + QString::number(Nlib) + ".");
 
-            // resize result vectors appropriately (for every cell or for every library entry)
+            // resize result vectors appropriately (for every cell or for every library entry,
+            // and for the wavelengths handled by this process)
             int Nout = _Ncomp>1 ? Ncells : Nlib;
-            _Lvv.resize(Nout,_Nlambda);  // also sets all values to zero
+            _Lvv.resize(Nout,_comm->localCount(_Nlambda));  // also sets all values to zero
 
             // if there are multiple components, rewire the mapping so that n==m for luminosity()
             if (_Ncomp > 1) for (int m=0; m<Ncells; m++) nv[m] = m;
@@ -74,57 +119,145 @@ namespace
         {
             // get the list of dust cells that map to this library entry
             QList<int> mv = _mh.values(n);
-            int Nmapped = mv.size();
 
             // if this library entry is used by at least one cell, calculate the emission for those cells
-            if (Nmapped > 0)
+            if (!mv.isEmpty())
+            {
+                Array Jv;
+                meanintensity(mv, Jv);
+                ArrayTable<2> evv(_Ncomp,0);
+                emissivities(n, Jv, evv);
+                luminosities(n, mv, evv);
+            }
+        }
+
+        // calculates the emission for all library entries in data-parallel mode, block by block
+        void calculateblocks(Parallel* parallel, int Nlib)
+        {
+            int Nblock = max(static_cast<size_t>(1), maxBlockValues / ((_Ncomp+1)*_Nlambda));
+            for (_firstentry=0; _firstentry<Nlib; _firstentry+=Nblock)
+            {
+                int Nentries = min(Nblock, Nlib-_firstentry);
+
+                // sum the contributions of all processes to the mean intensity of each library entry
+                _Jvv.resize(Nentries,_Nlambda);
+                parallel->call(this, &EmissionCalculator::meanintensitybody, Nentries);
+                _comm->sum(&_Jvv(0,0), static_cast<size_t>(Nentries)*_Nlambda);
+
+                // calculate the emissivities of the library entries owned by this process, and share them
+                _evvv.resize(Nentries,_Ncomp,_Nlambda);
+                parallel->call(this, &EmissionCalculator::emissivitybody, Nentries);
+                _comm->sum(&_evvv(0,0,0), static_cast<size_t>(Nentries)*_Ncomp*_Nlambda);
+
+                // store the normalized luminosities for the wavelengths handled by this process
+                parallel->call(this, &EmissionCalculator::luminositybody, Nentries);
+            }
+            _Jvv.resize(0,0);
+            _evvv.resize(0,0,0);
+        }
+
+    private:
+        // the parallelized loop bodies used by calculateblocks(), with an index relative to the first entry in the block
+        void meanintensitybody(size_t i)
+        {
+            QList<int> mv = _mh.values(_firstentry+i);
+            if (!mv.isEmpty())
             {
-                if (_de->logfrequency())
-                    _log->info("Calculating emission for library entry " + QString::number(n+1) + "...");
+                Array Jv;
+                meanintensity(mv, Jv);
+                for (int ell=0; ell<_Nlambda; ell++) _Jvv(i,ell) = Jv[ell];
+            }
+        }
 
-                // calculate the average ISRF for this library entry from the ISRF of all dust cells that map to it
+        void emissivitybody(size_t i)
+        {
+            int n = _firstentry+i;
+            if (_comm->isLocal(n) && _mh.contains(n))
+            {
                 Array Jv(_Nlambda);
-                foreach (int m, mv) Jv += _ds->meanintensityv(m);
-                Jv /= Nmapped;
+                for (int ell=0; ell<_Nlambda; ell++) Jv[ell] = _Jvv(i,ell);
+                ArrayTable<2> evv(_Ncomp,0);
+                emissivities(n, Jv, evv);
+                for (int h=0; h<_Ncomp; h++)
+                    for (int ell=0; ell<_Nlambda; ell++) _evvv(i,h,ell) = evv[h][ell];
+            }
+        }
 
-                // multiple dust components: calculate emission for each dust cell separately
-                if (_Ncomp > 1)
-                {
-                    // get emissivity for each dust component (i.e. for the corresponding dust mix)
-                    ArrayTable<2> evv(_Ncomp,0);
-                    for (int h=0; h<_Ncomp; h++) evv[h] = _de->emissivity(_ds->mix(h),Jv);
-
-                    // combine emissivities into SED for each dust cell, and store the normalized SEDs
-                    foreach (int m, mv)
-                    {
-                        // get a reference to the output array for this dust cell
-                        Array& Lv = _Lvv[m];
-
-                        // calculate the emission for this cell
-                        for (int h=0; h<_Ncomp; h++) Lv += evv[h] * _ds->density(m,h);
-
-                        // convert to luminosities and normalize the result
-                        Lv *= _lambdagrid->dlambdav();
-                        double total = Lv.sum();
-                        if (total>0) Lv /= total;
-                    }
-                }
+        void luminositybody(size_t i)
+        {
+            int n = _firstentry+i;
+            QList<int> mv = _mh.values(n);
+            if (!mv.isEmpty())
+            {
+                ArrayTable<2> evv(_Ncomp,_Nlambda);
+                for (int h=0; h<_Ncomp; h++)
+                    for (int ell=0; ell<_Nlambda; ell++) evv[h][ell] = _evvv(i,h,ell);
+                luminosities(n, mv, evv);
+            }
+        }
 
-                // single dust component: remember just the libary template, which serves for all mapped cells
-                else
-                {
-                    // get a reference to the output array for this library entry
-                    Array& Lv = _Lvv[n];
+        // calculates the average ISRF of the specified dust cells; in data-parallel mode,
+        // only the wavelengths handled by this process are nonzero
+        void meanintensity(const QList<int>& mv, Array& Jv)
+        {
+            Jv.resize(_Nlambda);
+            Array Jmv;
+            foreach (int m, mv)
+            {
+                _ds->meanintensityv(m, Jmv);
+                Jv += Jmv;
+            }
+            Jv /= mv.size();
+        }
 
-                    // get the emissivity of the library entry
-                    Lv = _de->emissivity(_ds->mix(0),Jv);
+        // gets the emissivity of library entry n for each dust component (i.e. for the corresponding dust mix),
+        // reusing the result of the previous invocation for a sufficiently similar ISRF
+        void emissivities(int n, const Array& Jv, ArrayTable<2>& evv)
+        {
+            if (_de->logfrequency())
+                _log->info("Calculating emission for library entry " + QString::number(n+1) + "...");
 
-                    // convert to luminosities and normalize the result
-                    Lv *= _lambdagrid->dlambdav();
-                    double total = Lv.sum();
-                    if (total>0) Lv /= total;
+            if (!_cache->lookup(n,Jv,evv))
+            {
+                for (int h=0; h<_Ncomp; h++) evv[h] = _de->emissivity(_ds->mix(h),Jv);
+                _cache->store(n,Jv,evv);
+            }
+        }
+
+        // stores the normalized emission spectra for library entry n, given its emissivities
+        void luminosities(int n, const QList<int>& mv, const ArrayTable<2>& evv)
+        {
+            // multiple dust components: combine emissivities into SED for each dust cell
+            if (_Ncomp > 1)
+            {
+                foreach (int m, mv)
+                {
+                    Array Lv(_Nlambda);
+                    for (int h=0; h<_Ncomp; h++) Lv += evv[h] * _ds->density(m,h);
+                    store(m, Lv);
                 }
             }
+
+            // single dust component: remember just the libary template, which serves for all mapped cells
+            else
+            {
+                Array Lv = evv[0];
+                store(n, Lv);
+            }
+        }
+
+        // converts the emissivities to luminosities, normalizes the result, and stores it in the specified
+        // output row; in data-parallel mode, only the wavelengths handled by this process are stored
+        void store(int k, Array& Lv)
+        {
+            Lv *= _lambdagrid->dlambdav();
+            double total = Lv.sum();
+            if (total>0) Lv /= total;
+
+            Array& outv = _Lvv[k];
+            int Nlocal = outv.size();
+            if (Nlocal == _Nlambda) outv = Lv;
+            else for (int i=0; i<Nlocal; i++) outv[i] = Lv[_comm->globalIndex(i)];
         }
     };
 }
@@ -138,9 +271,22 @@ void DustLib::calculate()
     _nv = mapping();
 
     // calculate the emissivity for each library entry
-    EmissionCalculator calc(_Lvv, _nv, Nlib, this);
+    WavelengthGrid* lambdagrid = find<WavelengthGrid>();
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+    _lambdastride = comm->dataParallel() ? comm->size() : 1;
+    _cache.startCycle(Nlib, lambdagrid->lambdav(), lambdagrid->dlambdav());
+    EmissionCalculator calc(_Lvv, _nv, Nlib, &_cache, this);
     Parallel* parallel = find<ParallelFactory>()->parallel();
-    parallel->call(&calc, Nlib);
+    if (comm->dataParallel()) calc.calculateblocks(parallel, Nlib);
+    else parallel->call(&calc, Nlib);
+
+    // log cache statistics
+    if (_cache.tolerance() > 0)
+        find<Log>()->info("Emissivities reused for " + QString::number(_cache.hits()) +
+                          " library entries and recalculated for " + QString::number(_cache.misses()) + ".");
+    if (_cache.overflows() > 0)
+        find<Log>()->warning("Emissivity cache memory limit reached; results for " +
+                             QString::number(_cache.overflows()) + " library entries will not be reused.");
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -148,7 +294,129 @@ void DustLib::calculate()
 double DustLib::luminosity(int m, int ell) const
 {
     int n = _nv[m];
-    return n>=0 ? _Lvv[n][ell] : 0.;
+    return n>=0 ? _Lvv[n][ell/_lambdastride] : 0.;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    int Nrows = _propvv.size(0);
+    checkpoint.write(static_cast<quint64>(Nrows));
+    checkpoint.write(static_cast<quint64>(_propvv.size(1)));
+    for (int m=0; m<Nrows; m++) checkpoint.write(_propvv[m]);
+    checkpoint.write(_Labsv);
+    _cache.writeCheckpoint(checkpoint);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::readCheckpoint(Checkpoint& checkpoint)
+{
+    int Nrows = checkpoint.readInt();
+    int Nprops = checkpoint.readInt();
+    _propvv.resize(Nrows, Nprops);
+    for (int m=0; m<Nrows; m++) checkpoint.read(_propvv[m]);
+    checkpoint.readArray(_Labsv);
+    _cache.readCheckpoint(checkpoint);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::calculatefieldproperties(int Nmoments, int Nprops)
+{
+    _ds = find<PanDustSystem>();
+    _parfac = find<ParallelFactory>();
+    int Ncells = _ds->Ncells();
+
+    // start from scratch unless there are compatible results from a previous invocation;
+    // a negative luminosity indicates that the properties for the cell have never been calculated
+    if (_mappingTolerance <= 0 || _propvv.size(0) != static_cast<size_t>(Ncells)
+                               || _propvv.size(1) != static_cast<size_t>(Nprops))
+    {
+        _propvv.resize(Ncells, Nprops);
+        _Labsv.resize(Ncells);
+        _Labsv = -1.;
+    }
+
+    // calculate the moments for each cell in parallel, using a mean intensity and moments buffer per thread
+    int Nthreads = _parfac->maxThreadCount();
+    _Jvv.resize(Nthreads);
+    _momentbufv.assign(Nthreads, Array(Nmoments));
+    _momentvv.resize(Ncells, Nmoments);
+    _recalcv.assign(Ncells, 0);
+    _parfac->parallel()->call(this, &DustLib::calculatecellfieldmoments, Ncells);
+
+    // in data-parallel mode, each process calculated the moments for its own wavelengths;
+    // since the absorbed luminosities are known by all processes, they all handle the same cells
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+    if (comm->dataParallel() && Nmoments > 0)
+        comm->sum(&_momentvv(0,0), static_cast<size_t>(Ncells)*Nmoments);
+
+    // convert the moments into properties
+    _parfac->parallel()->call(this, &DustLib::calculatecellfieldproperties, Ncells);
+    _momentvv.resize(0,0);
+
+    // log the number of cells actually calculated
+    int Ncalc = 0;
+    for (int m=0; m<Ncells; m++) if (_recalcv[m]) Ncalc++;
+    find<Log>()->info("Radiation field properties calculated for " + QString::number(Ncalc) +
+                      " out of " + QString::number(Ncells) + " dust cells.");
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::calculatecellfieldmoments(size_t m)
+{
+    // skip the cell if its absorbed luminosity did not change significantly since the previous calculation
+    double Labs = _ds->Labs(m);
+    double Labsprev = _Labsv[m];
+    if (_mappingTolerance > 0 && Labsprev >= 0 && fabs(Labs-Labsprev) <= _mappingTolerance*Labsprev) return;
+
+    _recalcv[m] = 1;
+    _Labsv[m] = Labs;
+    if (Labs > 0)
+    {
+        int t = _parfac->currentThreadIndex();
+        Array& Jv = _Jvv[t];
+        Array& momentv = _momentbufv[t];
+        _ds->meanintensityv(m, Jv);
+        momentv = 0.;
+        fieldmoments(m, Jv, momentv);
+        int Nmoments = momentv.size();
+        for (int i=0; i<Nmoments; i++) _momentvv(m,i) = momentv[i];
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::calculatecellfieldproperties(size_t m)
+{
+    if (!_recalcv[m]) return;
+
+    Array& propv = _propvv[m];
+    propv = 0.;
+    if (_Labsv[m] > 0)
+    {
+        Array& momentv = _momentbufv[_parfac->currentThreadIndex()];
+        int Nmoments = momentv.size();
+        for (int i=0; i<Nmoments; i++) momentv[i] = _momentvv(m,i);
+        fieldproperties(m, momentv, propv);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::fieldmoments(int /*m*/, const Array& /*Jv*/, Array& /*momentv*/) const
+{
+    throw FATALERROR("A dust library that calls calculatefieldproperties() must implement fieldmoments()");
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustLib::fieldproperties(int /*m*/, const Array& /*momentv*/, Array& /*propv*/) const
+{
+    throw FATALERROR("A dust library that calls calculatefieldproperties() must implement fieldproperties()");
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -7,7 +7,12 @@
 #define DUSTLIB_HPP
 
 #include "ArrayTable.hpp"
+#include "EmissivityCache.hpp"
 #include "SimulationItem.hpp"
+#include "Table.hpp"
+class Checkpoint;
+class PanDustSystem;
+class ParallelFactory;
 
 //////////////////////////////////////////////////////////////////////
 
@@ -27,12 +32,54 @@ class DustLib : public SimulationItem
     Q_OBJECT
     Q_CLASSINFO("Title", "a dust library")
 
+    Q_CLASSINFO("Property", "mappingTolerance")
+    Q_CLASSINFO("Title", "the relative change in absorbed luminosity that triggers recalculating a cell's mapping")
+    Q_CLASSINFO("MinValue", "0")
+    Q_CLASSINFO("MaxValue", "1")
+    Q_CLASSINFO("Default", "0")
+
+    Q_CLASSINFO("Property", "cacheTolerance")
+    Q_CLASSINFO("Title", "the relative change in radiation field within which emissivities are reused between cycles")
+    Q_CLASSINFO("MinValue", "0")
+    Q_CLASSINFO("MaxValue", "0.1")
+    Q_CLASSINFO("Default", "0")
+
     //============= Construction - Setup - Destruction =============
 
 protected:
     /** Default constructor. */
     DustLib();
 
+    //======== Setters & Getters for Discoverable Attributes =======
+
+public:
+    /** Sets the relative change in the absorbed luminosity of a dust cell since the previous
+        self-absorption cycle above which the properties of the radiation field in the cell, which
+        determine the library entry to which the cell is mapped, are recalculated. For a value of
+        zero (the default) these properties are recalculated for all cells in every cycle. The
+        default is deliberately zero, so that existing configurations produce exactly the same
+        results; a nonzero value trades accuracy for speed and must be requested explicitly, e.g.
+        a value of 0.01 for a simulation with many dust cells. The tolerance is used only by
+        subclasses that call calculatefieldproperties(). */
+    Q_INVOKABLE void setMappingTolerance(double value);
+
+    /** Returns the relative change in absorbed luminosity that triggers recalculating the
+        properties of the radiation field in a dust cell. */
+    Q_INVOKABLE double mappingTolerance() const;
+
+    /** Sets the relative tolerance on the radiation field of a library entry within which the
+        emissivities calculated during the previous self-absorption cycle are reused, as described
+        for the EmissivityCache class. A value of zero (the default) disables this mechanism, so
+        that the emissivities for all library entries are recalculated in every cycle. The default
+        is deliberately zero, so that existing configurations produce exactly the same results; a
+        nonzero value trades accuracy for speed and must be requested explicitly, e.g. a value of
+        0.01 for a library with many entries. */
+    Q_INVOKABLE void setCacheTolerance(double value);
+
+    /** Returns the relative tolerance on the radiation field within which emissivities are reused
+        between self-absorption cycles. */
+    Q_INVOKABLE double cacheTolerance() const;
+
     //======================== Other Functions =======================
 
 public:
@@ -56,15 +103,39 @@ public:
         so that the normalized emission spectrum is identical for all dust cells that map to a
         certain library entry. In this case, it is sufficient to just normalize and store the
         library templates and have luminosity() perform the mapping from dust cell to library
-        entry. */
+        entry.
+
+        If the cache tolerance is nonzero, the emissivities calculated for a library entry are
+        remembered until the next invocation of this function, where they are reused for any
+        library entry with a radiation field that matches within the tolerance. The number of
+        library entries for which the emissivities were reused or recalculated is logged.
+
+        When the wavelengths are divided over multiple processes (see
+        ProcessCommunicator::dataParallel()), each process holds the absorbed luminosities for its
+        own wavelengths only. The library entries are then handled in blocks. For each block, the
+        processes sum their contributions to the mean intensity of each entry, each process
+        calculates the emissivities for the entries it owns, and the emissivities are again summed
+        over all processes. Each process stores the normalized spectra for its own wavelengths only.
+        The size of the tables exchanged for a block is limited to 32 MiB. This function must then
+        be called by all processes. */
     void calculate();
 
     /** This function returns the luminosity fraction \f$L_\ell\f$ at the wavelength index
         \f$\ell\f$ in the normalized dust emission spectrum corresponding to the dust cell with
         dust cell number \f$m\f$. The function simply looks up the appropriate value in the cached
-        results produced by calculate(). */
+        results produced by calculate(). In data-parallel mode, the wavelength must be handled by
+        the calling process. */
     double luminosity(int m, int ell) const;
 
+    /** This function writes the state kept across invocations of calculate() to the specified
+        checkpoint, i.e. the radiation field properties and absorbed luminosities remembered for
+        the mapping tolerance, and the emissivities remembered for the cache tolerance. */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the state written by writeCheckpoint() from the specified
+        checkpoint. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
 protected:
     /** This function returns the number of entries in the library. It must be implemented by each
         subclass to provide this information to the base class. */
@@ -74,14 +145,85 @@ protected:
         cell \f$m\f$ to the corresponding library entry \f$n_m\f$. A index value of -1 indicates
         that the cell produces no emission. The function must be implemented by each subclass to
         provide this information to the base class. */
-    virtual std::vector<int> mapping() const = 0;
+    virtual std::vector<int> mapping() = 0;
+
+    /** This function calculates \f$N_{\text{prop}}\f$ properties of the radiation field in every
+        dust cell, for use by the mapping() function of a subclass, and stores them so that they can
+        be retrieved through the fieldproperty() function. The properties for a cell are obtained
+        in two steps. The fieldmoments() function first calculates \f$N_{\text{mom}}\f$ moments
+        of the mean intensity of the cell, and the fieldproperties() function then converts these
+        moments into the properties. Both functions must be implemented by any subclass that uses
+        this mechanism. Because the moments are linear in the mean intensity, they can be
+        calculated by each process for its own wavelengths in data-parallel mode and then summed
+        over all processes, so that the full radiation field never needs to be assembled. Cells
+        that did not absorb any luminosity receive zero for all properties. The cells are handled
+        in parallel, and each execution thread reuses a private buffer to hold the mean intensity
+        of the cell being handled.
+
+        If the mapping tolerance is positive, the calculation is incremental: a cell keeps the
+        properties calculated during the previous invocation if its absorbed luminosity
+        \f$L_m^{\text{abs}}\f$ changed by no more than the given fraction since then. The function
+        logs the number of cells for which the properties were actually (re-)calculated. */
+    void calculatefieldproperties(int Nmoments, int Nprops);
+
+    /** This function returns the property with index \f$p\f$ of the radiation field in the dust
+        cell with cell number \f$m\f$, as determined by the most recent invocation of
+        calculatefieldproperties(). */
+    double fieldproperty(int m, int p) const { return _propvv[m][p]; }
+
+    /** This function stores the moments of the radiation field in the dust cell with cell number
+        \f$m\f$ into the array \em momentv, given the mean intensity \em Jv of the cell. The
+        moments must be linear in the mean intensity, i.e. sums over the wavelengths of the mean
+        intensity multiplied by some weight. In data-parallel mode, \em Jv contains only the
+        wavelengths handled by the calling process (the other values are zero). The function is
+        called by calculatefieldproperties() for each cell with nonzero absorbed luminosity,
+        possibly from multiple execution threads at the same time, so it must not modify any
+        shared data. A subclass that calls calculatefieldproperties() must override this
+        function; the default implementation throws a fatal error. */
+    virtual void fieldmoments(int m, const Array& Jv, Array& momentv) const;
+
+    /** This function stores the properties of the radiation field in the dust cell with cell
+        number \f$m\f$ into the array \em propv, given the moments \em momentv calculated by
+        fieldmoments() and summed over all wavelengths. The same remarks apply as for
+        fieldmoments(). */
+    virtual void fieldproperties(int m, const Array& momentv, Array& propv) const;
+
+private:
+    /** This function calculates the moments of the radiation field for the single dust cell with
+        cell number \f$m\f$, if its properties need to be (re-)calculated. It serves as the body of
+        the first parallelized loop in calculatefieldproperties(). */
+    void calculatecellfieldmoments(size_t m);
+
+    /** This function converts the moments of the radiation field into properties for the single
+        dust cell with cell number \f$m\f$, if its properties need to be (re-)calculated. It serves
+        as the body of the second parallelized loop in calculatefieldproperties(). */
+    void calculatecellfieldproperties(size_t m);
 
     //======================== Data Members ========================
 
 private:
+    // discoverable properties (the cache tolerance is held by the cache)
+    double _mappingTolerance;   // relative change in absorbed luminosity that triggers recalculation
+
     // results of calculate(), used by luminosity()
     std::vector<int> _nv;   // library index for each cell or -1, indexed on m
-    ArrayTable<2> _Lvv;     // luminosities indexed on m or n and ell
+    ArrayTable<2> _Lvv;     // luminosities indexed on m or n and (local) ell
+    int _lambdastride;      // the number of processes sharing the wavelengths in data-parallel mode, or 1
+
+    // emissivities kept across invocations of calculate(); also holds the cache tolerance property
+    EmissivityCache _cache;
+
+    // results of calculatefieldproperties(), kept across invocations for the incremental calculation
+    ArrayTable<2> _propvv;  // field properties indexed on m and property index
+    Array _Labsv;           // absorbed luminosity for each cell when its properties were last calculated
+
+    // data used by calculatefieldproperties() while it is executing
+    PanDustSystem* _ds;
+    ParallelFactory* _parfac;
+    std::vector<Array> _Jvv;            // mean intensity buffer for each execution thread
+    std::vector<Array> _momentbufv;     // moments buffer for each execution thread
+    Table<2> _momentvv;                 // moments for each cell, indexed on m and moment index
+    std::vector<char> _recalcv;         // nonzero for each cell whose properties are (re-)calculated
 };
 
 ////////////////////////////////////////////////////////////////////
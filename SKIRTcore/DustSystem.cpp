@@ -5,6 +5,7 @@
 
 #include <cmath>
 #include <fstream>
+#include "Checkpoint.hpp"
 #include "DustDistribution.hpp"
 #include "DustGridDensityInterface.hpp"
 #include "DustGridPath.hpp"
@@ -20,6 +21,8 @@
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
 #include "PhotonPackage.hpp"
+#include "ProcessCommunicator.hpp"
+#include "Random.hpp"
 #include "Units.hpp"
 #include "WavelengthGrid.hpp"
 #include <QVarLengthArray>
@@ -28,10 +31,19 @@ using namespace std;
 
 //////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    // the value identifying a dust density cache file ("SKIRTDC1")
+    const quint64 cacheMagic = 0x534b495254444331;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 DustSystem::DustSystem()
     : _dd(0), _grid(0), _gdi(0), _Nrandom(100),
       _writeConvergence(true), _writeDensity(true), _writeDepthMap(false),
-      _writeQuality(false), _writeCellProperties(false), _writeCellsCrossed(false)
+      _writeQuality(false), _writeCellProperties(false), _writeCellsCrossed(false),
+      _opacityMemory(0), _haveKappaRho(false)
 {
 }
 
@@ -71,11 +83,30 @@ void DustSystem::setupSelfAfter()
         find<Log>()->info("Setting the value of the density in the cells using grid interface...");
         find<ParallelFactory>()->parallel()->call(this, &DustSystem::setGridDensityBody, _Ncells);
     }
-    else
+    else if (!loaddensitycache())
     {
-        // otherwise take an average of the density in 100 random positions in the cell (parallelized)
+        // otherwise take an average of the density in 100 random positions in the cell (parallelized),
+        // unless the sampled densities can be loaded from the cache
         find<Log>()->info("Setting the value of the density in the cells...");
         find<ParallelFactory>()->parallel()->call(this, &DustSystem::setSampleDensityBody, _Ncells);
+        savedensitycache();
+    }
+
+    // Precompute the extinction opacity for each wavelength and each cell, if it fits in the memory budget
+    _haveKappaRho = false;
+    if (_opacityMemory > 0)
+    {
+        int Nlambda = find<WavelengthGrid>()->Nlambda();
+        double required = static_cast<double>(Nlambda) * _Ncells * sizeof(double);
+        QString size = QString::number(required/1024./1024., 'f', 1) + " MB";
+        if (required <= _opacityMemory * 1024. * 1024.)
+        {
+            find<Log>()->info("Precomputing the extinction opacity in the cells (" + size + ")...");
+            _kapparhovv.resize(Nlambda,_Ncells);
+            find<ParallelFactory>()->parallel()->call(this, &DustSystem::setKappaRhoBody, _Ncells);
+            _haveKappaRho = true;
+        }
+        else find<Log>()->info("Not precomputing the extinction opacity in the cells (would require " + size + ")");
     }
 
     // Perform a convergence check on the grid.
@@ -113,6 +144,21 @@ void DustSystem::setGridDensityBody(size_t m)
 
 ////////////////////////////////////////////////////////////////////
 
+// parallelized body used above
+void DustSystem::setKappaRhoBody(size_t m)
+{
+    int Nlambda = _kapparhovv.size(0);
+    for (int ell=0; ell<Nlambda; ell++)
+    {
+        double kapparho = 0;
+        for (int h=0; h<_Ncomp; h++)
+            kapparho += mix(h)->kappaext(ell) * _rhovv(m,h);
+        _kapparhovv(ell,m) = kapparho;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
 // parallelized body used above
 void DustSystem::setSampleDensityBody(size_t m)
 {
@@ -123,12 +169,17 @@ void DustSystem::setSampleDensityBody(size_t m)
     }
     if (_grid->weight(m) > 0)
     {
+        // sample the density using a random stream keyed on the cell number, so that with the
+        // Philox generator the result does not depend on the thread handling the cell
+        Random* random = find<Random>();
+        random->startChunk(Random::DensitySamplingPhase, m);
         Array sumv(_Ncomp);
         for (int n=0; n<_Nrandom; n++)
         {
             Position bfr = _grid->randomPositionInCell(m);
             for (int h=0; h<_Ncomp; h++) sumv[h] += _dd->density(h,bfr);
         }
+        random->endChunk();
         for (int h=0; h<_Ncomp; h++)
         {
             _rhovv(m,h) = sumv[h]/_Nrandom;
@@ -142,6 +193,57 @@ void DustSystem::setSampleDensityBody(size_t m)
 
 ////////////////////////////////////////////////////////////////////
 
+bool DustSystem::loaddensitycache()
+{
+    if (_densitycachepath.isEmpty()) return false;
+
+    Checkpoint cache;
+    if (!cache.load(_densitycachepath)) return false;
+
+    // verify that the cache matches the dust grid, using the cell volumes as a fingerprint
+    Log* log = find<Log>();
+    if (cache.readInt() != cacheMagic || cache.readInt() != static_cast<quint64>(_Ncells)
+                                      || cache.readInt() != static_cast<quint64>(_Ncomp))
+    {
+        log->warning("Ignoring dust density cache that does not match the dust grid: " + _densitycachepath);
+        return false;
+    }
+    Array volumev(_Ncells);
+    cache.read(volumev);
+    for (int m=0; m<_Ncells; m++)
+    {
+        if (volumev[m] != _volumev[m])
+        {
+            log->warning("Ignoring dust density cache that does not match the dust grid: " + _densitycachepath);
+            return false;
+        }
+    }
+
+    log->info("Loading the value of the density in the cells from cache " + _densitycachepath + "...");
+    cache.read(_rhovv);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void DustSystem::savedensitycache() const
+{
+    if (_densitycachepath.isEmpty() || !find<ProcessCommunicator>()->isRoot()) return;
+
+    find<Log>()->info("Writing the value of the density in the cells to cache " + _densitycachepath + "...");
+    Checkpoint cache;
+    cache.begin(_densitycachepath);
+    cache.write(cacheMagic);
+    cache.write(static_cast<quint64>(_Ncells));
+    cache.write(static_cast<quint64>(_Ncomp));
+    cache.write(_volumev);
+    cache.write(_rhovv);
+    cache.save();
+    if (!cache.wait()) find<Log>()->warning("Could not write dust density cache " + _densitycachepath);
+}
+
+////////////////////////////////////////////////////////////////////
+
 void DustSystem::writeconvergence() const
 {
     // Perform a convergence check on the grid. First calculate the total
@@ -430,6 +532,26 @@ namespace
             return result;
         }
     };
+
+    // Private class to provide the precomputed kappa*rho values to the DustGridPath::opticalDepth() function
+    class KappaRhoTable
+    {
+    private:
+        // data members initialized in constructor
+        const double* _kapparhov;
+
+    public:
+        // constructor
+        // stores a pointer to the precomputed values for all cells at the wavelength of interest
+        KappaRhoTable(const double* kapparhov) : _kapparhov(kapparhov) { }
+
+        // call-back function
+        // returns kappa*rho for the specified cell number
+        double operator() (int m)
+        {
+            return m >= 0 ? _kapparhov[m] : 0;
+        }
+    };
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -584,11 +706,13 @@ void DustSystem::writecellproperties() const
     file << "# column 3: mass fraction\n";
     file << "# column 4: optical depth\n";
 
-    // write a line for each cell; remember the tau values so we can compute some statistics
+    // write a line for each cell, in the order defined by the grid;
+    // remember the tau values so we can compute some statistics
     Array tauV(_Ncells);
     double totalmass = _dd->mass();
-    for (int m=0; m<_Ncells; m++)
+    for (int i=0; i<_Ncells; i++)
     {
+        int m = _grid->cellAtOutputIndex(i);
         double rho = density(m);
         double V = volume(m);
         double delta = (rho*V)/totalmass;
@@ -767,6 +891,34 @@ bool DustSystem::writeCellsCrossed() const
 
 //////////////////////////////////////////////////////////////////////
 
+void DustSystem::setOpacityMemory(double value)
+{
+    _opacityMemory = value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+double DustSystem::opacityMemory() const
+{
+    return _opacityMemory;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void DustSystem::setDensityCachePath(QString value)
+{
+    _densitycachepath = value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+QString DustSystem::densityCachePath() const
+{
+    return _densitycachepath;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 int DustSystem::dimension() const
 {
     return _dd->dimension();
@@ -816,13 +968,6 @@ double DustSystem::volume(int m) const
 
 //////////////////////////////////////////////////////////////////////
 
-double DustSystem::density(int m, int h) const
-{
-    return m >= 0 ? _rhovv(m,h) : 0;
-}
-
-//////////////////////////////////////////////////////////////////////
-
 double DustSystem::density(int m) const
 {
     double rho = 0;
@@ -848,7 +993,8 @@ void DustSystem::fillOpticalDepth(PhotonPackage* pp)
     }
 
     // calculate and store the optical depth details in the photon package
-    pp->fillOpticalDepth(KappaRho(this, pp->ell()));
+    if (_haveKappaRho) pp->fillOpticalDepth(KappaRhoTable(&_kapparhovv(pp->ell(),0)));
+    else pp->fillOpticalDepth(KappaRho(this, pp->ell()));
 
     // verify that the result makes sense
     double tau = pp->tau();
@@ -873,9 +1019,38 @@ double DustSystem::opticaldepth(PhotonPackage* pp, double distance)
     }
 
     // calculate and return the optical depth at the specified distance
+    if (_haveKappaRho) return pp->opticalDepth(KappaRhoTable(&_kapparhovv(pp->ell(),0)), distance);
     return pp->opticalDepth(KappaRho(this, pp->ell()), distance);
 }
 
+//////////////////////////////////////////////////////////////////////
+
+void DustSystem::opticaldepths(PhotonPackage* const* ppv, int count)
+{
+    // determine the paths for the complete batch and store the geometric details in the photon packages
+    QVarLengthArray<DustGridPath*,16> pathv(count);
+    for (int p=0; p<count; p++) pathv[p] = ppv[p];
+    _grid->paths(pathv.data(), count);
+
+    for (int p=0; p<count; p++)
+    {
+        PhotonPackage* pp = ppv[p];
+
+        // if such statistics are requested, keep track of the number of cells crossed
+        if (_writeCellsCrossed)
+        {
+            QMutexLocker lock(&_crossedMutex);
+            unsigned int index = pp->size();
+            if (index >= _crossed.size()) _crossed.resize(index+1);
+            _crossed[index] += 1;
+        }
+
+        // calculate the optical depth along the complete path and cache it in the photon package
+        if (_haveKappaRho) pp->setCachedOpticalDepth(pp->opticalDepth(KappaRhoTable(&_kapparhovv(pp->ell(),0))));
+        else pp->setCachedOpticalDepth(pp->opticalDepth(KappaRho(this, pp->ell())));
+    }
+}
+
 ////////////////////////////////////////////////////////////////////
 
 void DustSystem::write() const
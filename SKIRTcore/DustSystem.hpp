@@ -72,6 +72,13 @@ class DustSystem : public SimulationItem
     Q_CLASSINFO("Title", "output statistics on the number of cells crossed per path")
     Q_CLASSINFO("Default", "no")
 
+    Q_CLASSINFO("Property", "opacityMemory")
+    Q_CLASSINFO("Title", "the maximum memory in MB for a precomputed opacity table")
+    Q_CLASSINFO("MinValue", "0")
+    Q_CLASSINFO("MaxValue", "1e6")
+    Q_CLASSINFO("Default", "0")
+    Q_CLASSINFO("Silent", "yes")
+
     //============= Construction - Setup - Destruction =============
 
 protected:
@@ -90,8 +97,21 @@ protected:
         random positions are generated within the cell (see sampleCount()). The density in the cell
         is calculated as the mean of the density values (found using a call to the corresponding
         function of the dust distribution) in these points. The calculation of both volume and
-        density is parallellized. In the last phase, the function optionally invokes various
-        writeXXX() functions depending on the state of the corresponding write flags. */
+        density is parallellized. If the memory limit configured with setOpacityMemory() allows
+        it, the function then precomputes the total extinction opacity \f$\sum_h
+        \kappa_{\ell,h}^{\text{ext}}\, \rho_{m,h}\f$ for each wavelength and each cell, so that
+        calculating the optical depth along a path requires a single table lookup per path
+        segment. In the last phase, the function optionally invokes various writeXXX() functions
+        depending on the state of the corresponding write flags.
+
+        If a density cache file has been configured with setDensityCachePath() and the densities
+        are determined by random sampling, the sampled densities are loaded from that file rather
+        than calculated, provided the file exists and matches the dust grid (the cell volumes serve
+        as a fingerprint of the grid). Otherwise the densities are sampled and the cache file is
+        created for use by subsequent simulation runs. The cache holds only these densities: the
+        dust grid structure is constructed and the cell volumes are calculated for every
+        simulation run, and the densities obtained through the DustGridDensityInterface, which are
+        cheap to calculate, are never cached. */
     void setupSelfAfter();
 
 private:
@@ -106,6 +126,19 @@ private:
         by taking random density sample. */
     void setSampleDensityBody(size_t m);
 
+    /** This function serves as the parallelization body for precomputing the extinction opacity of
+        each cell at all wavelengths. */
+    void setKappaRhoBody(size_t m);
+
+    /** This function loads the cell densities from the density cache file, if one has been
+        configured and if it matches the current dust grid. It returns true if the densities have been loaded, and
+        false otherwise. */
+    bool loaddensitycache();
+
+    /** This function writes the cell volumes and densities to the density cache file, if one has
+        been configured. In a multi-process simulation, only the root process writes the file. */
+    void savedensitycache() const;
+
     /** This function writes out a simple text file, named <tt>prefix_ds_convergence.dat</tt>,
         providing a convergence check on the dust system. The function calculates the total dust
         mass, the face-on surface density and the edge-on surface density by directly integrating
@@ -236,9 +269,32 @@ public:
         number of dust grid cells crossed per path calculated through the grid. */
     Q_INVOKABLE bool writeCellsCrossed() const;
 
+    /** Sets the maximum amount of memory, in megabytes, that may be used for a table holding the
+        precomputed extinction opacity \f$\kappa\rho\f$ for each wavelength and each cell. If
+        the table fits within this limit, it is used to speed up the optical depth calculations;
+        otherwise the opacity is calculated from the densities of the dust components for each
+        path segment. The table is most effective for simulations with multiple dust components
+        and a limited number of wavelengths. The default value of zero disables the table. */
+    Q_INVOKABLE void setOpacityMemory(double value);
+
+    /** Returns the maximum amount of memory, in megabytes, that may be used for a table holding
+        the precomputed extinction opacity for each wavelength and each cell. */
+    Q_INVOKABLE double opacityMemory() const;
+
     //======================== Other Functions =======================
 
 public:
+    /** Sets the path of the file used to cache the randomly sampled dust densities across
+        simulation runs, or the empty string (the default) to disable caching. Only the densities
+        are cached; the dust grid structure is still constructed for every run. This attribute is
+        not discoverable; it is set by the command line handler, which derives the file name from
+        a hash of the dust distribution and dust grid configuration. */
+    void setDensityCachePath(QString value);
+
+    /** Returns the path of the file used to cache the randomly sampled dust densities across
+        simulation runs, or the empty string if caching is disabled. */
+    QString densityCachePath() const;
+
     /** This function returns the dimension of the dust system, which depends on the (lack of)
         symmetry in the geometry of its distribution. A value of 1 means spherical symmetry, 2
         means axial symmetry and 3 means none of these symmetries. */
@@ -317,6 +373,15 @@ public:
         */
     double opticaldepth(PhotonPackage* pp, double distance);
 
+    /** This function calculates the optical depth along the complete path through the dust system
+        for each of the \em count photon packages in the specified array, and caches the result in
+        the photon package (see PhotonPackage::setCachedOpticalDepth()), so that the instruments
+        receiving these peel off photon packages no longer need to trace their paths. The paths are
+        determined in a single call to DustGridStructure::paths(), allowing dust grid structures to
+        advance a batch of paths in lockstep. The results are identical to those obtained by calling
+        opticaldepth() for each photon package with an infinite distance. */
+    void opticaldepths(PhotonPackage* const* ppv, int count);
+
     /** If the writeCellsCrossed attribute is true, this function writes out a data file (named
         <tt>prefix_ds_crossed.dat</tt>) with statistics on the number of dust grid cells crossed
         per path calculated through the grid. The first column on each line specifies a particular
@@ -356,16 +421,28 @@ protected:
     bool _writeQuality;
     bool _writeCellProperties;
     bool _writeCellsCrossed;
+    double _opacityMemory;
+    QString _densitycachepath;
 
     // data members initialized during setup
     int _Ncomp;
     int _Ncells;
     Array _volumev;     // volume for each cell (indexed on m)
     Table<2> _rhovv;    // density for each cell and each dust component (indexed on m,h)
+    Table<2> _kapparhovv;   // extinction opacity for each wavelength and each cell (indexed on ell,m), if precomputed
+    bool _haveKappaRho;     // true if the extinction opacity table has been precomputed
     std::vector<qint64> _crossed;
     QMutex _crossedMutex;
 };
 
 //////////////////////////////////////////////////////////////////////
 
+// inline implementation of density() since it is called for each path segment
+inline double DustSystem::density(int m, int h) const
+{
+    return m >= 0 ? _rhovv(m,h) : 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 #endif // DUSTSYSTEM_HPP
@@ -0,0 +1,203 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#include <algorithm>
+#include <cmath>
+#include "Checkpoint.hpp"
+#include "EmissivityCache.hpp"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // the maximum number of values stored during a single cycle (512 MiB)
+    const size_t maxStoredValues = size_t(1) << 26;
+}
+
+////////////////////////////////////////////////////////////////////
+
+EmissivityCache::EmissivityCache()
+    : _tolerance(0), _step(0), _Nhits(0), _Nmisses(0), _Noverflows(0), _Nstored(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+void EmissivityCache::setTolerance(double tolerance)
+{
+    _tolerance = tolerance;
+    _step = log(1.+max(_tolerance,1e-6));
+    if (_tolerance <= 0)
+    {
+        vector<Array>().swap(_previousv);
+        vector<Array>().swap(_currentv);
+        _candidates.clear();
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void EmissivityCache::startCycle(int Nentries, const Array& lambdav, const Array& dlambdav)
+{
+    _Nhits = 0;
+    _Nmisses = 0;
+    _Noverflows = 0;
+    _Nstored = 0;
+    if (_tolerance <= 0) return;
+
+    // discard the results of the cycle before if the wavelength grid changed (which should not happen)
+    if (_lambdav.size() != lambdav.size()) _currentv.clear();
+    _lambdav = lambdav;
+    _dlambdav = dlambdav;
+
+    // the results of the cycle just completed become the candidates for reuse
+    _previousv.swap(_currentv);
+    vector<Array>().swap(_currentv);
+    _currentv.resize(Nentries);
+
+    // hash the candidates on their quantized integrated intensity, and sort each bin on mean wavelength
+    _candidates.clear();
+    int Nprevious = _previousv.size();
+    for (int p=0; p<Nprevious; p++)
+    {
+        if (_previousv[p].size() > 0)
+        {
+            double sum0, sum1;
+            if (moments(&_previousv[p][0], sum0, sum1)) _candidates[bin(sum0)].push_back(make_pair(sum1/sum0, p));
+        }
+    }
+    for (auto it = _candidates.begin(); it != _candidates.end(); ++it) sort(it->begin(), it->end());
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool EmissivityCache::lookup(int n, const Array& Jv, ArrayTable<2>& evv)
+{
+    if (_tolerance <= 0) return false;
+
+    double sum0, sum1;
+    if (moments(&Jv[0], sum0, sum1))
+    {
+        // determine the range of quantization bins and of mean wavelengths that may hold a field within
+        // the tolerance; both ranges are extended by one step on each side to guard against roundoff errors
+        int Nlambda = _lambdav.size();
+        double lambdamin = _lambdav[0];
+        double lambdamax = _lambdav[Nlambda-1];
+        double dsum0 = _tolerance*sum0;
+        double dsum1 = _tolerance*sum0*lambdamax;
+        int imin = bin(sum0-dsum0) - 1;
+        int imax = bin(sum0+dsum0) + 1;
+        double lambdalow = max(lambdamin, (sum1-dsum1)/(sum0+dsum0)) * exp(-_step);
+        double lambdahigh = min(lambdamax, (sum1+dsum1)/(sum0-dsum0)) * exp(_step);
+
+        for (int i=imin; i<=imax; i++)
+        {
+            // use the const lookup so that concurrent calls never detach the shared hash
+            auto candidates = _candidates.constFind(i);
+            if (candidates == _candidates.constEnd()) continue;
+
+            // the candidates are sorted on mean wavelength, so the scan can stop at the upper limit
+            auto end = candidates->cend();
+            for (auto it = lower_bound(candidates->cbegin(), end, make_pair(lambdalow, -1)); it != end; ++it)
+            {
+                if (it->first > lambdahigh) break;
+
+                const Array& cachedv = _previousv[it->second];
+                double diff = 0.;
+                for (int ell=0; ell<Nlambda; ell++) diff += fabs(Jv[ell]-cachedv[ell]) * _dlambdav[ell];
+                if (diff <= _tolerance*sum0)
+                {
+                    // copy the emissivities for each dust component, and remember the candidate for the next cycle
+                    int Ncomp = cachedv.size()/Nlambda - 1;
+                    evv.resize(Ncomp, Nlambda);
+                    for (int h=0; h<Ncomp; h++)
+                        for (int ell=0; ell<Nlambda; ell++) evv[h][ell] = cachedv[(h+1)*Nlambda+ell];
+                    if (reserve(cachedv.size())) _currentv[n] = cachedv;
+                    _Nhits++;
+                    return true;
+                }
+            }
+        }
+    }
+    _Nmisses++;
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void EmissivityCache::store(int n, const Array& Jv, const ArrayTable<2>& evv)
+{
+    if (_tolerance <= 0) return;
+
+    int Nlambda = _lambdav.size();
+    int Ncomp = evv.size(0);
+    if (!reserve((Ncomp+1)*Nlambda)) return;
+    Array& cachedv = _currentv[n];
+    cachedv.resize((Ncomp+1)*Nlambda);
+    for (int ell=0; ell<Nlambda; ell++) cachedv[ell] = Jv[ell];
+    for (int h=0; h<Ncomp; h++)
+        for (int ell=0; ell<Nlambda; ell++) cachedv[(h+1)*Nlambda+ell] = evv[h][ell];
+}
+
+////////////////////////////////////////////////////////////////////
+
+void EmissivityCache::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    checkpoint.write(_lambdav);
+    int Nentries = _currentv.size();
+    checkpoint.write(static_cast<quint64>(Nentries));
+    for (int n=0; n<Nentries; n++) checkpoint.write(_currentv[n]);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void EmissivityCache::readCheckpoint(Checkpoint& checkpoint)
+{
+    checkpoint.readArray(_lambdav);
+    int Nentries = checkpoint.readInt();
+    _currentv.resize(Nentries);
+    for (int n=0; n<Nentries; n++) checkpoint.readArray(_currentv[n]);
+
+    // discard the results if the cache has been disabled since the checkpoint was written
+    if (_tolerance <= 0) setTolerance(0);
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool EmissivityCache::moments(const double* Jv, double& sum0, double& sum1) const
+{
+    int Nlambda = _lambdav.size();
+    sum0 = 0.;
+    sum1 = 0.;
+    for (int ell=0; ell<Nlambda; ell++)
+    {
+        double Jdlambda = Jv[ell] * _dlambdav[ell];
+        sum0 += Jdlambda;
+        sum1 += Jdlambda * _lambdav[ell];
+    }
+    return sum0 > 0.;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int EmissivityCache::bin(double x) const
+{
+    return static_cast<int>(floor(log(x)/_step));
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool EmissivityCache::reserve(size_t n)
+{
+    if (_Nstored.fetch_add(n) + n <= maxStoredValues) return true;
+    _Nstored.fetch_sub(n);
+    _Noverflows++;
+    return false;
+}
+
+
+////////////////////////////////////////////////////////////////////
@@ -0,0 +1,129 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef EMISSIVITYCACHE_HPP
+#define EMISSIVITYCACHE_HPP
+
+#include <atomic>
+#include <vector>
+#include <QHash>
+#include "ArrayTable.hpp"
+class Checkpoint;
+
+////////////////////////////////////////////////////////////////////
+
+/** An EmissivityCache instance remembers the dust emissivities calculated by a dust library during
+    a self-absorption cycle, so that they can be reused in the next cycle for library entries with a
+    nearly identical radiation field. Late in the self-absorption iteration, the radiation field in
+    most dust cells changes very little from one cycle to the next, so that most of the (expensive)
+    emissivity calculations can be avoided.
+
+    The results of each cycle are stored per library entry: the mean intensity \f$J_\ell\f$ of the
+    entry and the corresponding emissivities \f$\varepsilon_{h,\ell}\f$ for each dust component
+    \f$h\f$. When a new cycle is started, the results of the cycle just completed become the
+    candidates for reuse, and the results of the cycle before are discarded. To find candidates
+    quickly, they are hashed on the integrated intensity \f$J=\int J_\lambda\,{\text{d}}\lambda\f$,
+    quantized on a logarithmic scale with a step equal to the tolerance \f$\epsilon\f$ (but no smaller
+    than \f$10^{-6}\f$, to keep the quantized values within range). The candidates in each bin are
+    sorted on their mean wavelength \f$\bar\lambda=\int\lambda J_\lambda\,{\text{d}}\lambda\,/J\f$,
+    so that a lookup only visits the candidates within the allowed range of mean wavelengths. A candidate
+    is accepted if \f[ \int |J_\lambda - J_\lambda^{\text{cached}}|\,{\text{d}}\lambda \le
+    \epsilon\, J. \f] This condition bounds the integrated intensity of an acceptable candidate
+    to \f$(1\pm\epsilon)J\f$, and its first moment \f$\int\lambda J_\lambda\,{\text{d}}\lambda\f$
+    to within \f$\epsilon J\lambda_{\text{max}}\f$ of the first moment of the field being looked up.
+    The lookup examines all candidates allowed by these bounds, so that any candidate passing the
+    test is found. The emissivities of an accepted candidate are stored again, together
+    with the intensity for which they were actually calculated, so that the deviation cannot
+    accumulate over multiple cycles.
+
+    The results stored during a single cycle are limited to 512 MiB, so that the cache never
+    occupies more than 1 GiB (the results of the previous and of the current cycle). Once the limit
+    is reached, further results are not stored and the corresponding library entries are
+    recalculated in the next cycle. This matters mostly for a library with an entry for every
+    dust cell and a large number of wavelengths.
+
+    For distinct library entries, the lookup() and store() functions can be called from multiple
+    execution threads at the same time. A tolerance of zero disables the cache. */
+class EmissivityCache
+{
+public:
+    /** The default constructor creates a disabled cache. */
+    EmissivityCache();
+
+    /** This function sets the relative tolerance \f$\epsilon\f$ on the radiation field. A value of
+        zero disables the cache and releases any stored results. */
+    void setTolerance(double tolerance);
+
+    /** This function returns the relative tolerance on the radiation field. */
+    double tolerance() const { return _tolerance; }
+
+    /** This function starts a new cycle with the specified number of library entries, given the
+        wavelength grid points and bin widths. The results stored during the previous cycle become
+        the candidates for reuse, and the hit and miss counters are reset. */
+    void startCycle(int Nentries, const Array& lambdav, const Array& dlambdav);
+
+    /** This function looks for a candidate from the previous cycle with a radiation field matching
+        the mean intensity \em Jv within the tolerance. If one is found, the function copies its
+        emissivities into the rows of \em evv (one row per dust component), stores it as the result
+        for library entry \f$n\f$ of the current cycle, and returns true. Otherwise, the function
+        returns false, and the caller should calculate the emissivities and pass them to store(). */
+    bool lookup(int n, const Array& Jv, ArrayTable<2>& evv);
+
+    /** This function stores the mean intensity \em Jv and the emissivities \em evv (one row per
+        dust component) calculated for library entry \f$n\f$ of the current cycle. */
+    void store(int n, const Array& Jv, const ArrayTable<2>& evv);
+
+    /** This function returns the number of successful lookups during the current cycle. */
+    int hits() const { return _Nhits; }
+
+    /** This function returns the number of failed lookups during the current cycle. */
+    int misses() const { return _Nmisses; }
+
+    /** This function returns the number of library entries for which the results of the current
+        cycle could not be stored because the memory limit was reached. */
+    int overflows() const { return _Noverflows; }
+
+    /** This function writes the results of the current cycle to the specified checkpoint, so that
+        they can serve as the candidates for reuse in the next cycle after the simulation has been
+        resumed. If the cache is disabled, just an empty list of results is written. */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the results written by writeCheckpoint() from the specified
+        checkpoint, as the results of the current cycle. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
+private:
+    /** This function calculates the integrated intensity \em sum0 and the first moment \em sum1
+        of the mean intensity given by the first \f$N_\lambda\f$ values at the specified address.
+        It returns false if the integrated intensity is zero, in which case the field cannot be
+        cached. */
+    bool moments(const double* Jv, double& sum0, double& sum1) const;
+
+    /** This function returns the logarithmically quantized value of the specified positive value. */
+    int bin(double x) const;
+
+    /** This function reserves room for the specified number of values in the results of the
+        current cycle. It returns false if this would exceed the memory limit. */
+    bool reserve(size_t n);
+
+    //======================== Data Members ========================
+
+private:
+    double _tolerance;                    // the relative tolerance, or zero if the cache is disabled
+    double _step;                         // the logarithmic quantization step
+    Array _lambdav;                       // the wavelength grid points
+    Array _dlambdav;                      // the wavelength bin widths
+    std::vector<Array> _previousv;        // results of the previous cycle, indexed on library entry
+    std::vector<Array> _currentv;         // results of the current cycle, indexed on library entry
+    QHash<int,std::vector<std::pair<double,int>>> _candidates;  // sorted (mean wavelength, entry) per bin
+    std::atomic<int> _Nhits;              // the number of successful lookups during the current cycle
+    std::atomic<int> _Nmisses;            // the number of failed lookups during the current cycle
+    std::atomic<int> _Noverflows;         // the number of results not stored during the current cycle
+    std::atomic<size_t> _Nstored;         // the number of values stored during the current cycle
+};
+
+////////////////////////////////////////////////////////////////////
+
+#endif // EMISSIVITYCACHE_HPP
@@ -5,7 +5,6 @@
 
 #include "FatalError.hpp"
 #include "FrameInstrument.hpp"
-#include "LockFree.hpp"
 #include "PhotonPackage.hpp"
 #include "WavelengthGrid.hpp"
 
@@ -23,8 +22,7 @@ void FrameInstrument::setupSelfBefore()
 {
     SingleFrameInstrument::setupSelfBefore();
 
-    int Nlambda = find<WavelengthGrid>()->Nlambda();
-    _ftotv.resize(Nlambda*_Nxp*_Nyp);
+    _ftotk = setupRecordCube(_ftotv, _Nxp*_Nyp);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -36,13 +34,13 @@ FrameInstrument::detect(PhotonPackage* pp)
     if (l >= 0)
     {
         int ell = pp->ell();
-        int m = l + ell*_Nxp*_Nyp;
+        int m = l + cubePlane(ell)*_Nxp*_Nyp;
         double L = pp->luminosity();
         double taupath = opticalDepth(pp);
         double extf = exp(-taupath);
         double Lextf = L*extf;
 
-        LockFree::add(_ftotv[m], Lextf);
+        record(_ftotk, m, Lextf);
     }
 }
 
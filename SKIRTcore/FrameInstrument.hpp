@@ -44,6 +44,7 @@ protected:
 
 private:
     Array _ftotv;
+    int _ftotk;     // record index of _ftotv
 };
 
 ////////////////////////////////////////////////////////////////////
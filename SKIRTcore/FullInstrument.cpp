@@ -5,7 +5,6 @@
 
 #include "FatalError.hpp"
 #include "FullInstrument.hpp"
-#include "LockFree.hpp"
 #include "PhotonPackage.hpp"
 #include "WavelengthGrid.hpp"
 
@@ -25,10 +24,6 @@ void FullInstrument::setupSelfBefore()
     SingleFrameInstrument::setupSelfBefore();
 
     int Nlambda = find<WavelengthGrid>()->Nlambda();
-    _fdirv.resize(Nlambda*_Nxp*_Nyp);
-    _fscav.resize(Nlambda*_Nxp*_Nyp);
-    _ftrav.resize(Nlambda*_Nxp*_Nyp);
-    _fdusv.resize(Nlambda*_Nxp*_Nyp);
     _Fdirv.resize(Nlambda);
     _Fscav.resize(Nlambda);
     _Ftrav.resize(Nlambda);
@@ -36,9 +31,25 @@ void FullInstrument::setupSelfBefore()
 
     if (_Nscatt > 0)
     {
-        _fscavv.resize(_Nscatt+1, Nlambda*_Nxp*_Nyp);
+        _fscavv.resize(_Nscatt+1, 0);   // the rows are sized by setupRecordCube() below
         _Fscavv.resize(_Nscatt+1, Nlambda);
     }
+
+    _fdirk = setupRecordCube(_fdirv, _Nxp*_Nyp);
+    _fscak = setupRecordCube(_fscav, _Nxp*_Nyp);
+    _ftrak = setupRecordCube(_ftrav, _Nxp*_Nyp);
+    _fdusk = setupRecordCube(_fdusv, _Nxp*_Nyp);
+    _Fdirk = addRecordArray(_Fdirv);
+    _Fscak = addRecordArray(_Fscav);
+    _Ftrak = addRecordArray(_Ftrav);
+    _Fdusk = addRecordArray(_Fdusv);
+    _fscakv.resize(_Nscatt+1);
+    _Fscakv.resize(_Nscatt+1);
+    for (int nscatt=1; nscatt<=_Nscatt; nscatt++)
+    {
+        _fscakv[nscatt] = setupRecordCube(_fscavv[nscatt], _Nxp*_Nyp);
+        _Fscakv[nscatt] = addRecordArray(_Fscavv[nscatt]);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -62,7 +73,7 @@ FullInstrument::detect(PhotonPackage* pp)
 {
     int l = pixelondetector(pp);
     int ell = pp->ell();
-    int m = l + ell*_Nxp*_Nyp;
+    int m = l + cubePlane(ell)*_Nxp*_Nyp;
     double L = pp->luminosity();
     double taupath = opticalDepth(pp);
     double extf = exp(-taupath);
@@ -73,18 +84,18 @@ FullInstrument::detect(PhotonPackage* pp)
         int nscatt = pp->nScatt();
         if (nscatt==0)
         {
-            LockFree::add(_Ftrav[ell], L);
-            LockFree::add(_Fdirv[ell], Lextf);
+            record(_Ftrak, ell, L);
+            record(_Fdirk, ell, Lextf);
         }
         else
         {
-            LockFree::add(_Fscav[ell], Lextf);
-            if (nscatt<=_Nscatt) LockFree::add(_Fscavv[nscatt][ell], Lextf);
+            record(_Fscak, ell, Lextf);
+            if (nscatt<=_Nscatt) record(_Fscakv[nscatt], ell, Lextf);
         }
     }
     else
     {
-        LockFree::add(_Fdusv[ell], Lextf);
+        record(_Fdusk, ell, Lextf);
     }
 
     if (l>=0)
@@ -94,18 +105,18 @@ FullInstrument::detect(PhotonPackage* pp)
             int nscatt = pp->nScatt();
             if (nscatt==0)
             {
-                LockFree::add(_ftrav[m], L);
-                LockFree::add(_fdirv[m], Lextf);
+                record(_ftrak, m, L);
+                record(_fdirk, m, Lextf);
             }
             else
             {
-                LockFree::add(_fscav[m], Lextf);
-                if (nscatt<=_Nscatt) LockFree::add(_fscavv[nscatt][m], Lextf);
+                record(_fscak, m, Lextf);
+                if (nscatt<=_Nscatt) record(_fscakv[nscatt], m, Lextf);
             }
         }
         else
         {
-            LockFree::add(_fdusv[m], Lextf);
+            record(_fdusk, m, Lextf);
         }
     }
 }
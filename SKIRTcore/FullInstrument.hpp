@@ -112,6 +112,12 @@ private:
     Array _Ftrav;
     Array _Fdusv;
     ArrayTable<2> _Fscavv;
+
+    // record indices of the above arrays, in the same order
+    int _fdirk, _fscak, _ftrak, _fdusk;
+    std::vector<int> _fscakv;
+    int _Fdirk, _Fscak, _Ftrak, _Fdusk;
+    std::vector<int> _Fscakv;
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -4,16 +4,19 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include "Instrument.hpp"
+#include "Checkpoint.hpp"
 #include "DustSystem.hpp"
 #include "FatalError.hpp"
 #include "PhotonPackage.hpp"
+#include "ProcessCommunicator.hpp"
+#include "WavelengthGrid.hpp"
 
 using namespace std;
 
 ////////////////////////////////////////////////////////////////////
 
 Instrument::Instrument()
-    : _ds(0)
+    : _ds(0), _parfac(0), _cubestride(1)
 {
 }
 
@@ -33,6 +36,11 @@ void Instrument::setupSelfBefore()
     {
         _ds = 0;
     }
+
+    _parfac = find<ParallelFactory>();
+
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+    _cubestride = comm->dataParallel() ? comm->size() : 1;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -51,9 +59,144 @@ QString Instrument::instrumentName() const
 
 ////////////////////////////////////////////////////////////////////
 
+bool Instrument::hasFixedDirection() const
+{
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+
 double Instrument::opticalDepth(PhotonPackage* pp, double distance) const
 {
-    return _ds ? _ds->opticaldepth(pp,distance) : 0;
+    if (!_ds) return 0;
+
+    // for the complete path, reuse the value calculated for another instrument sharing this peel off
+    if (distance == DBL_MAX)
+    {
+        if (!pp->hasCachedOpticalDepth()) pp->setCachedOpticalDepth(_ds->opticaldepth(pp,distance));
+        return pp->cachedOpticalDepth();
+    }
+    return _ds->opticaldepth(pp,distance);
+}
+
+////////////////////////////////////////////////////////////////////
+
+int Instrument::addRecordArray(Array& target)
+{
+    _recordv.push_back(&target);
+    _planesizev.push_back(0);
+    return _recordv.size()-1;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int Instrument::setupRecordCube(Array& target, size_t planeSize)
+{
+    int Nlambda = find<WavelengthGrid>()->Nlambda();
+    target.resize(find<ProcessCommunicator>()->localCount(Nlambda)*planeSize);
+    int k = addRecordArray(target);
+    _planesizev[k] = planeSize;
+    return k;
+}
+
+////////////////////////////////////////////////////////////////////
+
+size_t Instrument::recordSize() const
+{
+    size_t size = 0;
+    foreach (const Array* target, _recordv) size += target->size();
+    return size;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Instrument::setupPrivateBuffers(int Nthreads)
+{
+    _buffervv.clear();
+    if (Nthreads < 2) return;
+
+    _buffervv.resize(Nthreads-1);
+    for (int thread=1; thread<Nthreads; thread++)
+    {
+        vector<Array>& buffers = _buffervv[thread-1];
+        buffers.resize(_recordv.size());
+        for (unsigned int k=0; k<_recordv.size(); k++) buffers[k].resize(_recordv[k]->size());
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Instrument::flush()
+{
+    for (unsigned int t=0; t<_buffervv.size(); t++)
+    {
+        vector<Array>& buffers = _buffervv[t];
+        for (unsigned int k=0; k<_recordv.size(); k++)
+        {
+            *(_recordv[k]) += buffers[k];
+            buffers[k] = 0.;
+        }
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
+
+void Instrument::sumResults()
+{
+    flush();
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+    if (comm->isMultiProc())
+    {
+        for (unsigned int k=0; k<_recordv.size(); k++)
+        {
+            if (_planesizev[k] && comm->dataParallel()) gatherCube(*(_recordv[k]), _planesizev[k]);
+            else comm->sum(*(_recordv[k]));
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Instrument::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    foreach (const Array* target, _recordv) checkpoint.write(*target);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Instrument::readCheckpoint(Checkpoint& checkpoint)
+{
+    foreach (Array* target, _recordv) checkpoint.read(*target);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Instrument::gatherCube(Array& target, size_t planeSize)
+{
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+    int Nlambda = find<WavelengthGrid>()->Nlambda();
+
+    Array cubev;
+    if (comm->isRoot()) cubev.resize(Nlambda*planeSize);
+    Array planev(planeSize);
+    for (int ell=0; ell<Nlambda; ell++)
+    {
+        int owner = comm->owner(ell);
+        if (owner == comm->rank())
+        {
+            size_t offset = comm->localIndex(ell)*planeSize;
+            for (size_t l=0; l<planeSize; l++) planev[l] = target[offset+l];
+        }
+        comm->broadcast(&planev[0], planeSize, owner);
+        if (comm->isRoot())
+        {
+            size_t offset = ell*planeSize;
+            for (size_t l=0; l<planeSize; l++) cubev[offset+l] = planev[l];
+        }
+    }
+    if (comm->isRoot()) target.swap(cubev);
+    else Array().swap(target);
+}
+
+////////////////////////////////////////////////////////////////////
+
@@ -8,9 +8,13 @@
 
 #include <cfloat>
 #include <vector>
+#include "Array.hpp"
 #include "Direction.hpp"
+#include "LockFree.hpp"
+#include "ParallelFactory.hpp"
 #include "Position.hpp"
 #include "SimulationItem.hpp"
+class Checkpoint;
 class DustSystem;
 class PhotonPackage;
 
@@ -22,7 +26,17 @@ class PhotonPackage;
     responsible for the transformation from world coordinates to instrument coordinates, allowing
     various perspective schemes in different subclasses. This top-level abstract class offers a
     generic interface for receiving photon packages from the simulation, and for appropriately
-    locking the instrument's data structure when photon packages may arrive in parallel. */
+    locking the instrument's data structure when photon packages may arrive in parallel.
+
+    Subclasses register the arrays in which they accumulate detected luminosities through the
+    addRecordArray() function, and update these arrays exclusively through the record() function.
+    By default, record() adds the contribution to the shared array using a lock-free atomic
+    operation. If the instrument system decides that memory allows it (see
+    setupPrivateBuffers()), each parallel thread other than the first instead accumulates into a
+    private copy of the registered arrays. This avoids contention between threads on the cache
+    lines holding the shared data, which is substantial for small frames or for instruments with
+    a single value per wavelength. The private copies are added to the shared arrays by the
+    flush() function, which the simulation calls at the end of each photon shooting phase. */
 class Instrument : public SimulationItem
 {
     Q_OBJECT
@@ -57,6 +71,13 @@ public:
         The implementation must be provided in a subclass. */
     virtual Direction bfkobs(const Position& bfr) const = 0;
 
+    /** Returns true if the direction towards the observer returned by bfkobs() is the same for all
+        launching positions, and false otherwise. The instrument system uses this information to
+        group instruments that observe the system from the same direction, so that a single peel
+        off photon package (and a single optical depth calculation) can serve all of them. The
+        default implementation in this class returns false. */
+    virtual bool hasFixedDirection() const;
+
     /** This function simulates the detection of a photon package by the instrument. Its
         implementation must be provided in a subclass. The implementation must call the record()
         function to actually update the instrument's data structure, so that appropriate locking
@@ -70,9 +91,84 @@ public:
     /** This function is provided for use in subclasses. It calculates and returns the optical
         depth over the specified distance along the current path of the specified photon package,
         at the photon package's wavelength. If the distance is not specified, the complete path is
-        taken into account. */
+        taken into account. In that case the result is cached in the photon package, so that other
+        instruments receiving the same peel off photon package can reuse it without tracing the
+        path through the dust grid again. */
     double opticalDepth(PhotonPackage* pp, double distance=DBL_MAX) const;
 
+    /** This function registers the specified array as one of the arrays in which the instrument
+        accumulates detected luminosities through the record() function. It should be called
+        during setup, after the array has been given its final size. The array must remain at the
+        same address for the lifetime of the instrument. The function returns the record index of
+        the array, which must be passed to the record() function to update the array. */
+    int addRecordArray(Array& target);
+
+    /** This function resizes the specified array so that it can hold a data cube with a plane of
+        \em planeSize values for each wavelength handled by the calling process, and registers it
+        with addRecordArray(). Usually all wavelengths are handled by each process. When the
+        wavelengths are divided over multiple processes, however (see
+        ProcessCommunicator::dataParallel()), the array holds only the planes for the process's own
+        wavelengths, and the sumResults() function collects the complete data cube in the root
+        process. The plane for wavelength index \f$\ell\f$ starts at index cubePlane(\f$\ell\f$)
+        times \em planeSize. The function returns the record index of the array, as for
+        addRecordArray(). */
+    int setupRecordCube(Array& target, size_t planeSize);
+
+    /** This function returns the index of the plane corresponding to the specified wavelength
+        index in the data cubes set up with setupRecordCube(). The wavelength must be handled by
+        the calling process. */
+    int cubePlane(int ell) const;
+
+    /** This function returns the total number of values in the arrays registered with
+        addRecordArray(). */
+    size_t recordSize() const;
+
+    /** This function allocates a private copy of the arrays registered with addRecordArray() for
+        each parallel thread other than the first, for the specified total number of threads. After
+        this function has been called, the record() function no longer updates the shared arrays
+        directly (except from the first thread), and the flush() function must be called before
+        the shared arrays are used. */
+    void setupPrivateBuffers(int Nthreads);
+
+    /** This function adds the specified value to the element with the specified index in the
+        target array with record index \em k, as returned by addRecordArray() or
+        setupRecordCube() when the array was registered. The function is thread-safe. Depending on the configuration established during setup, it either
+        updates the target array through a lock-free atomic operation, or it updates the private
+        copy of the target array for the calling thread. */
+    void record(int k, size_t index, double value);
+
+    /** This function adds the contents of the private buffers, if any, to the shared arrays
+        registered with addRecordArray(), and clears the private buffers. It must be called from a
+        single thread while no photon packages are being detected. */
+    void flush();
+
+    /** This function calls flush() and then, if the simulation is performed by multiple processes,
+        replaces the values in the arrays registered with addRecordArray() by their sums over all
+        processes (see ProcessCommunicator). In data-parallel mode, the data cubes set up with
+        setupRecordCube() are instead assembled from the planes held by each process, and replaced
+        by the complete data cube in the root process, while the other processes release their
+        planes. This happens only when the results are written (see
+        MonteCarloSimulation::write()), so that the root process must be able to hold the
+        complete data cubes of all instruments at that time, but not earlier. The function must be
+        called exactly once, by all processes, after the last photon package has been detected and
+        before the instrument data is written. */
+    void sumResults();
+
+    /** This function writes the current contents of the arrays registered with addRecordArray()
+        to the specified checkpoint. It must be called while no photon packages are being
+        detected, after the private buffers (if any) have been flushed. */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the contents of the arrays registered with addRecordArray() from
+        the specified checkpoint. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
+private:
+    /** This function assembles the complete data cube from the planes of the specified array held
+        by each process, and replaces the array by this data cube in the root process. The array is
+        released in the other processes. */
+    void gatherCube(Array& target, size_t planeSize);
+
     //======================== Data Members ========================
 
 protected:
@@ -82,8 +178,35 @@ protected:
 private:
     // other data members
     DustSystem* _ds;   // cached pointer to dust system to call opticalDepth() function
+    ParallelFactory* _parfac;   // cached pointer to the parallel factory to determine the thread index
+    std::vector<Array*> _recordv;   // the arrays registered with addRecordArray()
+    std::vector<size_t> _planesizev;  // for each registered array, the plane size if it is a data cube, or zero
+    int _cubestride;   // the number of processes sharing the wavelengths in data-parallel mode, or 1
+    std::vector< std::vector<Array> > _buffervv;  // private copies of these arrays for threads 1..N-1
 };
 
 ////////////////////////////////////////////////////////////////////
 
+// inline implementation of record() since it is called for each detected photon package
+inline void Instrument::record(int k, size_t index, double value)
+{
+    if (!_buffervv.empty())
+    {
+        int thread = _parfac->currentThreadIndex();
+        if (thread == 0) (*_recordv[k])[index] += value;
+        else _buffervv[thread-1][k][index] += value;
+        return;
+    }
+    LockFree::add((*_recordv[k])[index], value);
+}
+
+////////////////////////////////////////////////////////////////////
+
+inline int Instrument::cubePlane(int ell) const
+{
+    return ell / _cubestride;
+}
+
+////////////////////////////////////////////////////////////////////
+
 #endif // INSTRUMENT_HPP
@@ -8,7 +8,6 @@
 #include "FITSInOut.hpp"
 #include "InstrumentFrame.hpp"
 #include "Log.hpp"
-#include "LockFree.hpp"
 #include "PhotonPackage.hpp"
 #include "MultiFrameInstrument.hpp"
 #include "StellarSystem.hpp"
@@ -58,6 +57,15 @@ void InstrumentFrame::setupSelfBefore()
     // initialize pixel frame(s)
     if (_writeTotal) _ftotv.resize(_Nxp*_Nyp);
     if (_writeStellarComps) _fcompvv.resize(find<StellarSystem>()->Ncomp(), _Nxp*_Nyp);
+
+    // register the pixel frame(s) with the parent instrument so that it can handle the recording
+    if (_writeTotal) _ftotk = _instrument->addRecordArray(_ftotv);
+    if (_writeStellarComps)
+    {
+        int Ncomp = _fcompvv.size(0);
+        _fcompkv.resize(Ncomp);
+        for (int k=0; k<Ncomp; k++) _fcompkv[k] = _instrument->addRecordArray(_fcompvv[k]);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -149,8 +157,8 @@ void InstrumentFrame::detect(PhotonPackage* pp)
         double extf = exp(-taupath);
         double Lextf = L*extf;
 
-        if (_writeTotal) LockFree::add(_ftotv[l], Lextf);
-        if (_writeStellarComps && pp->isStellar()) LockFree::add(_fcompvv(pp->stellarCompIndex(),l), Lextf);
+        if (_writeTotal) _instrument->record(_ftotk, l, Lextf);
+        if (_writeStellarComps && pp->isStellar()) _instrument->record(_fcompkv[pp->stellarCompIndex()], l, Lextf);
     }
 }
 
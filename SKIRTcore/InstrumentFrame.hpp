@@ -149,6 +149,10 @@ private:
     // total flux per pixel
     Array _ftotv;
     ArrayTable<2> _fcompvv;
+
+    // record indices of the above arrays in the parent instrument
+    int _ftotk;
+    std::vector<int> _fcompkv;
 };
 
 ////////////////////////////////////////////////////////////////////
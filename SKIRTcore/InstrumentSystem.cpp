@@ -6,17 +6,79 @@
 #include "FatalError.hpp"
 #include "Instrument.hpp"
 #include "InstrumentSystem.hpp"
+#include "Log.hpp"
+#include "ParallelFactory.hpp"
 
 using namespace std;
 
 //////////////////////////////////////////////////////////////////////
 
 InstrumentSystem::InstrumentSystem()
+    : _bufferMemory(0)
 {
 }
 
 //////////////////////////////////////////////////////////////////////
 
+void InstrumentSystem::setupSelfAfter()
+{
+    SimulationItem::setupSelfAfter();
+
+    _groups.clear();
+    foreach (Instrument* instrument, _instruments)
+    {
+        // look for an existing group with exactly the same fixed observer direction
+        bool found = false;
+        if (instrument->hasFixedDirection())
+        {
+            Direction bfk = instrument->bfkobs(Position());
+            for (unsigned int g=0; g<_groups.size() && !found; g++)
+            {
+                Instrument* first = _groups[g][0];
+                if (first->hasFixedDirection())
+                {
+                    Direction bfkfirst = first->bfkobs(Position());
+                    if (bfk.x()==bfkfirst.x() && bfk.y()==bfkfirst.y() && bfk.z()==bfkfirst.z())
+                    {
+                        _groups[g].push_back(instrument);
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        // otherwise start a new group
+        if (!found) _groups.push_back(std::vector<Instrument*>(1, instrument));
+    }
+
+    if (_groups.size() < static_cast<unsigned int>(_instruments.size()))
+        find<Log>()->info("Instruments are organized in " + QString::number(_groups.size())
+                          + " peel-off groups sharing the same line of sight");
+
+    // allocate private buffers for the smallest instruments, as long as they fit in the memory budget
+    int Nthreads = find<ParallelFactory>()->maxThreadCount();
+    if (_bufferMemory > 0 && Nthreads > 1)
+    {
+        QList< QPair<size_t,Instrument*> > sizes;
+        foreach (Instrument* instrument, _instruments) sizes << qMakePair(instrument->recordSize(), instrument);
+        qSort(sizes);
+
+        double available = _bufferMemory * 1024. * 1024.;
+        for (int i=0; i<sizes.size(); i++)
+        {
+            double required = (Nthreads-1) * sizes[i].first * sizeof(double);
+            if (required > available) break;
+            sizes[i].second->setupPrivateBuffers(Nthreads);
+            available -= required;
+            find<Log>()->info("Instrument " + sizes[i].second->instrumentName() + " uses private buffers for "
+                              + QString::number(Nthreads-1) + " threads ("
+                              + QString::number(required/1024./1024., 'f', 1) + " MB)");
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void InstrumentSystem::addInstrument(Instrument* value)
 {
     if (!value) throw FATALERROR("Instrument pointer shouldn't be null");
@@ -33,8 +95,58 @@ QList<Instrument*> InstrumentSystem::instruments() const
 
 //////////////////////////////////////////////////////////////////////
 
+void InstrumentSystem::setBufferMemory(double value)
+{
+    _bufferMemory = value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+double InstrumentSystem::bufferMemory() const
+{
+    return _bufferMemory;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+const std::vector< std::vector<Instrument*> >& InstrumentSystem::groups() const
+{
+    return _groups;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void InstrumentSystem::flush()
+{
+    foreach (Instrument* instrument, _instruments) instrument->flush();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void InstrumentSystem::sumResults()
+{
+    foreach (Instrument* instrument, _instruments) instrument->sumResults();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void InstrumentSystem::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    foreach (Instrument* instrument, _instruments) instrument->writeCheckpoint(checkpoint);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void InstrumentSystem::readCheckpoint(Checkpoint& checkpoint)
+{
+    foreach (Instrument* instrument, _instruments) instrument->readCheckpoint(checkpoint);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void InstrumentSystem::write()
 {
+    flush();
     foreach (Instrument* instrument, _instruments) instrument->write();
 }
 
@@ -10,6 +10,7 @@
 #include <QMutex>
 #include <QPair>
 #include "SimulationItem.hpp"
+class Checkpoint;
 class Instrument;
 class ParallelFactory;
 
@@ -28,12 +29,31 @@ class InstrumentSystem : public SimulationItem
     Q_CLASSINFO("Optional", "true")
     Q_CLASSINFO("Default", "SimpleInstrument")
 
+    Q_CLASSINFO("Property", "bufferMemory")
+    Q_CLASSINFO("Title", "the maximum memory in MB for per-thread private instrument buffers")
+    Q_CLASSINFO("MinValue", "0")
+    Q_CLASSINFO("MaxValue", "1e6")
+    Q_CLASSINFO("Default", "0")
+    Q_CLASSINFO("Silent", "yes")
+
     //============= Construction - Setup - Destruction =============
 
 public:
     /** The default constructor; creates an empty instrument system. */
     Q_INVOKABLE InstrumentSystem();
 
+protected:
+    /** This function groups the instruments that observe the system from the same direction, as
+        described for the groups() function. It also decides which instruments accumulate their
+        data in per-thread private buffers rather than directly in shared arrays (see
+        Instrument::setupPrivateBuffers()). The private buffers for an instrument occupy \f$N_t-1\f$
+        times the memory of the instrument's data arrays, where \f$N_t\f$ is the number of
+        parallel threads. The instruments are considered in order of increasing data size (smaller
+        instruments suffer most from contention between threads), and private buffers are
+        allocated as long as the total memory stays within the limit configured through
+        setBufferMemory(). Instruments that do not fit use the lock-free atomic updates. */
+    void setupSelfAfter();
+
     //======== Setters & Getters for Discoverable Attributes =======
 
 public:
@@ -43,11 +63,49 @@ public:
     /** This function returns the list of instruments in the instrument system. */
     Q_INVOKABLE QList<Instrument*> instruments() const;
 
+    /** Sets the maximum amount of memory, in megabytes, that may be allocated for per-thread
+        private instrument buffers. The default value of zero disables private buffers, so that
+        all instruments accumulate their data through lock-free atomic updates of shared arrays. */
+    Q_INVOKABLE void setBufferMemory(double value);
+
+    /** Returns the maximum amount of memory, in megabytes, that may be allocated for per-thread
+        private instrument buffers. */
+    Q_INVOKABLE double bufferMemory() const;
+
     //======================== Other Functions =======================
 
 public:
-    /** This function writes down the results of the instrument system. It calls the write()
-        function for each of the instruments. */
+    /** This function returns the instruments in the instrument system organized in peel-off
+        groups. All instruments in a group have the same fixed direction towards the observer (see
+        Instrument::hasFixedDirection()), so that they can be served by the same peel off photon
+        package. Instruments for which the observer direction depends on the launching position
+        are placed in a group of their own. Each instrument appears in exactly one group, and the
+        order of the instruments in the instrument list is preserved within each group. The
+        function returns a reference to avoid copying (and reference counting) in the inner loop
+        of the simulation. */
+    const std::vector< std::vector<Instrument*> >& groups() const;
+
+    /** This function adds the contents of the per-thread private buffers to the shared data arrays
+        for all instruments, by calling Instrument::flush() for each of them. It must be called at
+        the end of each photon shooting phase, while no photon packages are being detected. */
+    void flush();
+
+    /** This function calls Instrument::sumResults() for each of the instruments, so that the
+        instrument data includes the contributions of all processes in case the simulation is
+        performed by multiple processes. It must be called by all processes before the results are
+        written. */
+    void sumResults();
+
+    /** This function writes the data accumulated by each of the instruments to the specified
+        checkpoint, by calling Instrument::writeCheckpoint() for each of them. */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the data accumulated by each of the instruments from the specified
+        checkpoint, by calling Instrument::readCheckpoint() for each of them. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
+    /** This function writes down the results of the instrument system. It calls the flush() and
+        write() functions for each of the instruments. */
     void write();
 
     //======================== Data Members ========================
@@ -55,6 +113,10 @@ public:
 private:
     // discoverable attributes
     QList<Instrument*> _instruments;
+    double _bufferMemory;
+
+    // data members initialized during setup
+    std::vector< std::vector<Instrument*> > _groups;
 };
 
 ////////////////////////////////////////////////////////////////////
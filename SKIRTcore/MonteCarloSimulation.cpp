@@ -3,6 +3,7 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include "Checkpoint.hpp"
 #include "DustGridStructure.hpp"
 #include "DustMix.hpp"
 #include "DustSystem.hpp"
@@ -15,6 +16,7 @@
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
 #include "PhotonPackage.hpp"
+#include "ProcessCommunicator.hpp"
 #include "Random.hpp"
 #include "StellarSystem.hpp"
 #include "TimeLogger.hpp"
@@ -25,7 +27,8 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////
 
 MonteCarloSimulation::MonteCarloSimulation()
-    : _lambdagrid(0), _ss(0), _ds(0), _is(0), _packages(0), _continuousScattering(false)
+    : _lambdagrid(0), _ss(0), _ds(0), _is(0), _packages(0), _continuousScattering(false),
+      _tuneChunks(false), _Nphases(0), _phasework(0), _maxchunkwork(0)
 {
 }
 
@@ -43,6 +46,14 @@ void MonteCarloSimulation::setupSelfBefore()
 
 ////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    // the number of threads assumed for determining the number of chunks with the Philox generator
+    const int philoxReferenceThreads = 16;
+}
+
+////////////////////////////////////////////////////////////////////
+
 void MonteCarloSimulation::setupSelfAfter()
 {
     Simulation::setupSelfAfter();
@@ -54,20 +65,61 @@ void MonteCarloSimulation::setupSelfAfter()
     if (_packages <= 0)
     {
         _Nchunks = 0;
+        _firstlocalchunk = 0;
+        _Nlocalchunks = 0;
+        _Nlocallambda = 0;
         _chunksize = 0;
         _Npp = 0;
     }
     else
     {
-        int Nthreads = _parfac->maxThreadCount();
-        if (Nthreads == 1) _Nchunks = 1;
-        else _Nchunks = ceil( qMin(_packages/2e4, qMax(_packages/1e7, 10.*Nthreads/_Nlambda)) );
+        // the Philox random streams are keyed on the chunk index, so in that case the number of chunks
+        // may not depend on the number of threads; we use a fixed reference number of threads instead
+        if (_random->generator() == Random::Philox)
+            _Nchunks = ceil( qMin(_packages/2e4, qMax(_packages/1e7, 10.*philoxReferenceThreads/_Nlambda)) );
+        else
+        {
+            int Nthreads = _parfac->maxThreadCount();
+            if (Nthreads == 1) _Nchunks = 1;
+            else _Nchunks = ceil( qMin(_packages/2e4, qMax(_packages/1e7, 10.*Nthreads/_Nlambda)) );
+        }
+
+        int Nprocs = _comm->size();
+        if (_comm->dataParallel())
+        {
+            // divide the wavelengths over the processes
+            _firstlocalchunk = 0;
+            _Nlocalchunks = _Nchunks;
+            _Nlocallambda = _comm->localCount(_Nlambda);
+            _log->info("Dividing " + QString::number(_Nlambda) + " wavelengths over "
+                       + QString::number(Nprocs) + " processes");
+            if (_Nlambda < static_cast<quint64>(Nprocs))
+                _log->warning("Some processes have no wavelengths to handle");
+        }
+        else
+        {
+            // divide the chunks over the processes in consecutive blocks; for an even division, round
+            // the number of chunks up to a multiple of the number of processes, except with the Philox
+            // generator, because the chunk layout would then depend on the number of processes
+            if (_random->generator() != Random::Philox) _Nchunks = ((_Nchunks + Nprocs - 1) / Nprocs) * Nprocs;
+            int rank = _comm->rank();
+            _firstlocalchunk = _Nchunks*rank/Nprocs;
+            _Nlocalchunks = _Nchunks*(rank+1)/Nprocs - _firstlocalchunk;
+            _Nlocallambda = _Nlambda;
+            if (Nprocs > 1)
+                _log->info("Dividing " + QString::number(_Nchunks) + " chunks per wavelength over "
+                           + QString::number(Nprocs) + " processes");
+        }
+
         _chunksize = ceil(_packages/_Nchunks);
         _Npp = _Nchunks*_chunksize;
     }
 
     // determine the log frequency; continuous scattering is much slower!
     _logchunksize = _continuousScattering ? 5000 : 50000;
+
+    // setup is complete, so the processes may now diverge in their random sequences
+    _random->randomize();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -122,6 +174,20 @@ bool MonteCarloSimulation::continuousScattering() const
 
 ////////////////////////////////////////////////////////////////////
 
+void MonteCarloSimulation::setTuneChunks(bool value)
+{
+    _tuneChunks = value;
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool MonteCarloSimulation::tuneChunks() const
+{
+    return _tuneChunks;
+}
+
+////////////////////////////////////////////////////////////////////
+
 int MonteCarloSimulation::dimension() const
 {
     return qMax(_ss->dimension(), _ds ? _ds->dimension() : 1);
@@ -133,6 +199,9 @@ void MonteCarloSimulation::initprogress(QString phase)
 {
     _phase = phase;
     _Ndone = 0;
+    _Nphases++;
+    _phasework = 0;
+    _maxchunkwork = 0;
 
     _log->info("(" + QString::number(_packages,'g') + " photon packages for "
                + (_Nlambda==1 ? QString("a single wavelength") : QString("each of %1 wavelengths").arg(_Nlambda))
@@ -152,75 +221,175 @@ void MonteCarloSimulation::logprogress(quint64 extraDone)
     if (_timer.elapsed() > 3000)
     {
         _timer.restart();
-        double completed = _Ndone * 100. / (_Npp*_Nlambda);
+        double completed = _Ndone * 100. / (_Nlocalchunks*_chunksize*_Nlocallambda);
         _log->info("Launched " + _phase + " photon packages: " + QString::number(completed,'f',1) + "%");
     }
 }
 
 ////////////////////////////////////////////////////////////////////
 
+size_t MonteCarloSimulation::initchunk(size_t index)
+{
+    size_t chunk;
+    if (_comm->dataParallel())
+    {
+        size_t ell = _comm->globalIndex(index % _Nlocallambda);
+        chunk = (index / _Nlocallambda)*_Nlambda + ell;
+    }
+    else
+    {
+        chunk = _firstlocalchunk*_Nlambda + index;
+    }
+    _random->startChunk(_Nphases, chunk);
+    return chunk;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void MonteCarloSimulation::recordchunkwork(quint64 work)
+{
+    _phasework.fetch_add(work);
+    quint64 max = _maxchunkwork;
+    while (work > max && !_maxchunkwork.compare_exchange_weak(max, work)) { }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void MonteCarloSimulation::tunechunks()
+{
+    const double maxChunkFraction = 1. / (10.*philoxReferenceThreads);
+    const double minChunkSize = 1e4;
+
+    if (_tuneChunks && _Nchunks > 0 && !_comm->isMultiProc()
+        && _maxchunkwork > maxChunkFraction * _phasework && _packages/(2*_Nchunks) >= minChunkSize)
+    {
+        _Nchunks *= 2;
+        _Nlocalchunks = _Nchunks;
+        _chunksize = ceil(_packages/_Nchunks);
+        _Npp = _Nchunks*_chunksize;
+        _log->info("Using " + QString::number(_Nchunks) + " chunks per wavelength for subsequent phases"
+                   " to balance the work over the threads");
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // identifies the start of a checkpoint written by a Monte Carlo simulation
+    const quint64 checkpointMagic = 0x534b495254434b31ULL;  // "SKIRTCK1"
+}
+
+////////////////////////////////////////////////////////////////////
+
+void MonteCarloSimulation::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    checkpoint.write(checkpointMagic);
+    checkpoint.write(_Nlambda);
+    checkpoint.write(_Nphases);
+    checkpoint.write(_Nchunks);
+    _random->writeCheckpoint(checkpoint);
+    _is->writeCheckpoint(checkpoint);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void MonteCarloSimulation::readCheckpoint(Checkpoint& checkpoint)
+{
+    if (checkpoint.readInt() != checkpointMagic || checkpoint.readInt() != _Nlambda)
+        throw FATALERROR("Checkpoint does not match the simulation");
+    _Nphases = checkpoint.readInt();
+
+    // adopt the number of chunks as it was adjusted by tunechunks() before the checkpoint was written
+    quint64 Nchunks = checkpoint.readInt();
+    if (Nchunks != _Nchunks)
+    {
+        if (_comm->isMultiProc() || !Nchunks || !_Nchunks)
+            throw FATALERROR("Checkpoint does not match the simulation");
+        _Nchunks = Nchunks;
+        _Nlocalchunks = _Nchunks;
+        _chunksize = ceil(_packages/_Nchunks);
+        _Npp = _Nchunks*_chunksize;
+    }
+
+    _random->readCheckpoint(checkpoint);
+    _is->readCheckpoint(checkpoint);
+}
+
+////////////////////////////////////////////////////////////////////
+
 void MonteCarloSimulation::runstellaremission()
 {
-    TimeLogger logger(_log, "the stellar emission phase");
-    initprogress("stellar emission");
     Parallel* parallel = find<ParallelFactory>()->parallel();
-    parallel->call(this, &MonteCarloSimulation::dostellaremissionchunk, _Nchunks*_Nlambda);
+    TimeLogger logger(_log, "the stellar emission phase", parallel);
+    initprogress("stellar emission");
+    parallel->call(this, &MonteCarloSimulation::dostellaremissionchunk, _Nlocalchunks*_Nlocallambda);
+    _is->flush();
+    tunechunks();
 }
 
 ////////////////////////////////////////////////////////////////////
 
 void MonteCarloSimulation::dostellaremissionchunk(size_t index)
 {
-    int ell = index % _Nlambda;
+    int ell = initchunk(index) % _Nlambda;
     double L = _ss->luminosity(ell)/_Npp;
     if (L > 0)
     {
         double Lmin = 1e-4 * L;
-        PhotonPackage pp,ppp;
+        PhotonPackage pp;
+        vector<PhotonPackage> pppv(_is->groups().size());
 
+        quint64 work = 0;
         quint64 remaining = _chunksize;
         while (remaining > 0)
         {
             quint64 count = qMin(remaining, _logchunksize);
+            work += count;
             for (quint64 i=0; i<count; i++)
             {
                 _ss->launch(&pp,ell,L);
-                peeloffemission(&pp,&ppp);
+                peeloffemission(&pp,&pppv[0]);
                 if (_ds) while (true)
                 {
+                    work++;
                     _ds->fillOpticalDepth(&pp);
-                    if (_continuousScattering) continuouspeeloffscattering(&pp,&ppp);
+                    if (_continuousScattering) continuouspeeloffscattering(&pp,&pppv[0]);
                     simulateescapeandabsorption(&pp,_ds->dustemission());
                     if (pp.luminosity() <= Lmin) break;
                     simulatepropagation(&pp);
-                    if (!_continuousScattering) peeloffscattering(&pp,&ppp);
+                    if (!_continuousScattering) peeloffscattering(&pp,&pppv[0]);
                     simulatescattering(&pp);
                 }
             }
             logprogress(count);
             remaining -= count;
         }
+        recordchunkwork(work);
     }
     else logprogress(_chunksize);
 }
 
 ////////////////////////////////////////////////////////////////////
 
-void MonteCarloSimulation::peeloffemission(PhotonPackage* pp, PhotonPackage* ppp)
+void MonteCarloSimulation::peeloffemission(PhotonPackage* pp, PhotonPackage* pppv)
 {
     Position bfr = pp->position();
 
-    foreach (Instrument* instr, _is->instruments())
+    // launch a single peel off photon package for each group of instruments sharing the same direction
+    const vector< vector<Instrument*> >& groups = _is->groups();
+    int Ngroups = groups.size();
+    for (int g=0; g<Ngroups; g++)
     {
-        Direction bfknew = instr->bfkobs(bfr);
-        ppp->launchEmissionPeelOff(pp, bfknew);
-        instr->detect(ppp);
+        Direction bfknew = groups[g][0]->bfkobs(bfr);
+        pppv[g].launchEmissionPeelOff(pp, bfknew);
     }
+    detectpeeloffs(pppv);
 }
 
 ////////////////////////////////////////////////////////////////////
 
-void MonteCarloSimulation::peeloffscattering(PhotonPackage* pp, PhotonPackage* ppp)
+void MonteCarloSimulation::peeloffscattering(PhotonPackage* pp, PhotonPackage* pppv)
 {
     int Ncomp = _ds->Ncomp();
     int ell = pp->ell();
@@ -239,22 +408,24 @@ void MonteCarloSimulation::peeloffscattering(PhotonPackage* pp, PhotonPackage* p
         wv /= wv.sum();
     }
 
-    // Now do the actual peel-off
+    // Now do the actual peel-off, once for each group of instruments sharing the same direction
     Direction bfkold = pp->direction();
-    foreach (Instrument* instr, _is->instruments())
+    const vector< vector<Instrument*> >& groups = _is->groups();
+    int Ngroups = groups.size();
+    for (int g=0; g<Ngroups; g++)
     {
-        Direction bfknew = instr->bfkobs(bfr);
+        Direction bfknew = groups[g][0]->bfkobs(bfr);
         double w = 0.0;
         for (int h=0; h<Ncomp; h++)
             w += wv[h] * _ds->mix(h)->phasefunction(ell,bfkold,bfknew);
-        ppp->launchScatteringPeelOff(pp, bfknew, w);
-        instr->detect(ppp);
+        pppv[g].launchScatteringPeelOff(pp, bfknew, w);
     }
+    detectpeeloffs(pppv);
 }
 
 ////////////////////////////////////////////////////////////////////
 
-void MonteCarloSimulation::continuouspeeloffscattering(PhotonPackage *pp, PhotonPackage *ppp)
+void MonteCarloSimulation::continuouspeeloffscattering(PhotonPackage *pp, PhotonPackage *pppv)
 {
     int ell = pp->ell();
     Position bfr = pp->position();
@@ -270,6 +441,9 @@ void MonteCarloSimulation::continuouspeeloffscattering(PhotonPackage *pp, Photon
         kappaextv[h] = mix->kappaext(ell);
     }
 
+    const vector< vector<Instrument*> >& groups = _is->groups();
+    int Ngroups = groups.size();
+
     int Ncells = pp->size();
     for (int n=0; n<Ncells; n++)
     {
@@ -297,15 +471,15 @@ void MonteCarloSimulation::continuouspeeloffscattering(PhotonPackage *pp, Photon
                 double factorm = albedo * exp(-tau0) * (-expm1(-dtau));
                 double s = s0 + _random->uniform()*ds;
                 Position bfrnew(bfr+s*bfk);
-                foreach (Instrument* instr, _is->instruments())
+                for (int g=0; g<Ngroups; g++)
                 {
-                    Direction bfknew = instr->bfkobs(bfrnew);
+                    Direction bfknew = groups[g][0]->bfkobs(bfrnew);
                     double w = 0.0;
                     for (int h=0; h<Ncomp; h++) w += wv[h] * _ds->mix(h)->phasefunction(ell,bfk,bfknew);
 
-                    ppp->launchScatteringPeelOff(pp, bfrnew, bfknew, factorm*w);
-                    instr->detect(ppp);
+                    pppv[g].launchScatteringPeelOff(pp, bfrnew, bfknew, factorm*w);
                 }
+                detectpeeloffs(pppv);
             }
         }
     }
@@ -313,6 +487,32 @@ void MonteCarloSimulation::continuouspeeloffscattering(PhotonPackage *pp, Photon
 
 ////////////////////////////////////////////////////////////////////
 
+void MonteCarloSimulation::detectpeeloffs(PhotonPackage* pppv)
+{
+    const vector< vector<Instrument*> >& groups = _is->groups();
+    int Ngroups = groups.size();
+
+    // trace the paths of the peel off photon packages towards all distant observers as a single batch;
+    // the instruments then reuse the optical depth cached in each photon package
+    if (_ds && Ngroups > 1)
+    {
+        QVarLengthArray<PhotonPackage*,16> batch;
+        for (int g=0; g<Ngroups; g++)
+            if (groups[g][0]->hasFixedDirection()) batch.append(&pppv[g]);
+        if (batch.size() > 1) _ds->opticaldepths(batch.data(), batch.size());
+    }
+
+    // feed each peel off photon package to the instruments in its group
+    for (int g=0; g<Ngroups; g++)
+    {
+        const vector<Instrument*>& group = groups[g];
+        int Ninstr = group.size();
+        for (int i=0; i<Ninstr; i++) group[i]->detect(&pppv[g]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
 void MonteCarloSimulation::simulateescapeandabsorption(PhotonPackage* pp, bool dustemission)
 {
     double taupath = pp->tau();
@@ -435,6 +635,8 @@ void MonteCarloSimulation::simulatescattering(PhotonPackage* pp)
 void MonteCarloSimulation::write()
 {
     TimeLogger logger(_log, "writing results");
+    if (_is) _is->sumResults();
+    if (!_comm->isRoot()) return;
     if (_is) _is->write();
     if (_ds) _ds->write();
 }
@@ -9,6 +9,7 @@
 #include "Simulation.hpp"
 #include <QTime>
 #include <atomic>
+class Checkpoint;
 class DustSystem;
 class InstrumentSystem;
 class PhotonPackage;
@@ -44,6 +45,11 @@ class MonteCarloSimulation : public Simulation
     Q_CLASSINFO("Default", "no")
     Q_CLASSINFO("Silent", "yes")
 
+    Q_CLASSINFO("Property", "tuneChunks")
+    Q_CLASSINFO("Title", "adjust the number of chunks between phases to balance the work")
+    Q_CLASSINFO("Default", "no")
+    Q_CLASSINFO("Silent", "yes")
+
     //============= Construction - Setup - Destruction =============
 
 protected:
@@ -74,7 +80,19 @@ protected:
         \f[N_\text{chunks} = {\text{ceil}}\left[ \min(\frac{N_\text{pp}}{2\,S_\text{min}},
         \max(\frac{N_\text{pp}}{S_\text{max}}, \frac{b\,N_\text{threads}}{N_\lambda})) \right]\f]
         where \f$S_\text{min}=10^4\f$ is the minimum chunk size, \f$S_\text{max}=10^7\f$ is the
-        maximum chunk size, and \f$b=10\f$ is the load balancing safety factor. */
+        maximum chunk size, and \f$b=10\f$ is the load balancing safety factor. With the Philox
+        random generator, the random streams are keyed on the chunk index (see Random), so that
+        the chunk layout determines the results. In that case the formula is evaluated with a fixed
+        reference value \f$N_\text{threads}=16\f$ (also for a single execution thread), so that the
+        results do not depend on the actual number of threads.
+
+        If the simulation is performed by multiple processes (see ProcessCommunicator), each
+        process handles a block of consecutive chunks for every wavelength. For an even division,
+        the number of chunks per wavelength is rounded up to a multiple of the number of processes,
+        except with the Philox random generator, so that its results do not depend on the number of
+        processes either. The function also calls Random::randomize() so that the processes draw
+        independent random sequences after setup. The partial
+        results obtained by the processes are summed at the end of each photon shooting phase. */
     void setupSelfAfter();
 
     //======== Setters & Getters for Discoverable Attributes =======
@@ -110,6 +128,14 @@ public:
     /** Returns the flag that indicates whether continuous scattering should be used. */
     Q_INVOKABLE bool continuousScattering() const;
 
+    /** Sets the flag that indicates whether the number of chunks should be adjusted between photon
+        shooting phases, as described for the tunechunks() function. The default value is false. */
+    Q_INVOKABLE void setTuneChunks(bool value);
+
+    /** Returns the flag that indicates whether the number of chunks should be adjusted between
+        photon shooting phases. */
+    Q_INVOKABLE bool tuneChunks() const;
+
     //======================== Other Functions =======================
 
 public:
@@ -131,6 +157,51 @@ protected:
         number of photon packages processed since the most recent invocation in the same thread. */
     void logprogress(quint64 extraDone);
 
+    /** This function prepares the random number generator for processing the chunk with the
+        specified index in the phase most recently started with initprogress(). It must be called
+        at the start of each chunk by the corresponding parallel loop body, so that a random number
+        generator offering reproducible streams can key the stream on the phase and the chunk index
+        rather than on the thread processing the chunk. The index passed to this function is local
+        to the calling process; when the chunks or the wavelengths are divided over multiple
+        processes, the function converts it to an index in the complete set of chunks for the
+        phase, so that the random streams do not depend on the number of processes. The function
+        returns this global chunk index; the corresponding wavelength index is the chunk index
+        modulo the number of wavelengths. */
+    size_t initchunk(size_t index);
+
+    /** This function records the amount of work performed by a chunk in the current photon
+        shooting phase, measured as the number of photon packages launched plus the number of
+        propagation steps through the dust system. It must be called by each parallel loop body at
+        the end of the chunk. In contrast to a timing measurement, this quantity depends only on the
+        random numbers consumed by the chunk, so that it is reproducible with the Philox
+        generator. */
+    void recordchunkwork(quint64 work);
+
+    /** If the tuneChunks property is enabled, this function adjusts the number of chunks per
+        wavelength for subsequent photon shooting phases based on the work recorded by the chunks
+        of the phase that just finished (see recordchunkwork()). Since the cost of a chunk may vary
+        by orders of magnitude between wavelengths, the threads may sit idle while the last few
+        expensive chunks of a phase are being processed. If the most expensive chunk performed more
+        than \f$1/(b\,N_\text{ref})\f$ of the total work in the phase, where \f$b=10\f$ and
+        \f$N_\text{ref}=16\f$ are the safety factor and the reference number of threads also used
+        in setupSelfAfter(), the function doubles the number of chunks (halving the chunk size), as
+        long as each chunk still contains at least \f$10^4\f$ photon packages. Because the
+        criterion does not depend on the timing or on the actual number of threads, the resulting
+        chunk layout, and thus the output produced with the Philox generator, is reproducible. The
+        function does nothing if the chunks are divided over multiple processes, since the
+        processes would then no longer agree on the number of chunks. */
+    void tunechunks();
+
+    /** This function writes the state maintained by this class to the specified checkpoint,
+        including the number of phases started so far, the number of chunks per wavelength, the
+        state of the random number generator, and the data accumulated by the instruments. It must
+        be called between photon shooting phases, after the instrument data has been flushed. */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the state written by writeCheckpoint() from the specified
+        checkpoint. It throws a fatal error if the checkpoint does not match the simulation. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
     /** This function drives the stellar emission phase in a Monte Carlo simulation. It consists of
         a parallelized loop that iterates over \f$N_{\text{pp}}\times N_\lambda\f$ monochromatic
         photons packages. Within this loop, the function simulates the life cycle of a single
@@ -163,8 +234,12 @@ protected:
         that it is emitted in any other direction. For each instrument in the instrument system,
         the function creates such a peel-off photon package and feeds it to the instrument. The
         first argument specifies the photon package that was just emitted; the second argument
-        provides a placeholder peel off photon package for use by the function. */
-    void peeloffemission(PhotonPackage* pp, PhotonPackage* ppp);
+        provides an array of placeholder peel off photon packages for use by the function, with one
+        element for each group of instruments returned by InstrumentSystem::groups(). Instruments
+        that observe the system from the same direction share a single peel off photon package, so
+        that its path through the dust grid is determined only once. The peel off photon packages
+        for all groups are launched before any of them is detected (see detectpeeloffs()). */
+    void peeloffemission(PhotonPackage* pp, PhotonPackage* pppv);
 
     /** This function simulates the peel-off of a photon package before a scattering event. This
         means that, just before a scattering event, we create peel-off or shadow photon packages,
@@ -193,9 +268,11 @@ protected:
         \f$h\f$'th dust component respectively (both evaluated at the wavelength index \f$\ell\f$
         of the photon package). For each instrument in the instrument system, the function creates
         such a peel-off photon package and feeds it to the instrument. The first argument specifies
-        the photon package that was just emitted; the second argument provides a placeholder peel
-        off photon package for use by the function. */
-    void peeloffscattering(PhotonPackage* pp, PhotonPackage* ppp);
+        the photon package that was just emitted; the second argument provides an array of
+        placeholder peel off photon packages for use by the function. As for peeloffemission(), a
+        single peel off photon package is shared by all instruments observing from the same
+        direction. */
+    void peeloffscattering(PhotonPackage* pp, PhotonPackage* pppv);
 
     /** This function simulates the continuous peel-off of a series of photon packages along the
         path of the original photon package. It should be called before the
@@ -213,8 +290,18 @@ protected:
         the dust and \f$\tau_{\ell,n}\f$ the optical depth measured from the initial position of
         the path until the exit point of the \f$n\f$'th dust cell along the path. The second weight
         factor \f$w_{\text{obs}}\f$ compensates for the change in propagation direction, and is
-        determined as explained for the function peeloffscattering(). */
-    void continuouspeeloffscattering(PhotonPackage* pp, PhotonPackage* ppp);
+        determined as explained for the function peeloffscattering(). The second argument provides
+        an array of placeholder peel off photon packages as for peeloffemission(). */
+    void continuouspeeloffscattering(PhotonPackage* pp, PhotonPackage* pppv);
+
+    /** This function feeds the peel off photon packages in the specified array, one for each group
+        of instruments returned by InstrumentSystem::groups(), to the instruments in the
+        corresponding group. If there is a dust system and more than one group observes the system
+        from a fixed direction, the paths of the peel off photon packages for these groups are first
+        traced through the dust grid as a single batch by DustSystem::opticaldepths(), which caches
+        the optical depth in each photon package so that the instruments do not trace them again.
+        With a single group, the path is traced by the instrument itself, as before. */
+    void detectpeeloffs(PhotonPackage* pppv);
 
     /** This function simulates the escape from the system and the absorption by dust of a fraction
         of the luminosity of a photon package. It actually splits the luminosity \f$L_\ell\f$ of
@@ -297,7 +384,9 @@ protected:
 
     /** This function performs the final step in a Monte Carlo simulation. It writes out the useful
         information in the instrument system and in the dust system so that the results of the
-        simulation can be analyzed. */
+        simulation can be analyzed. If the simulation is performed by multiple processes, the
+        instrument data is first summed over all processes, and the results are written only by
+        the root process. */
     void write();
 
     //======================== Data Members ========================
@@ -312,10 +401,14 @@ protected:
     InstrumentSystem* _is;
     double _packages;       // the specified number of photon packages to be launched per wavelength
     bool _continuousScattering;  // true if continuous scattering should be used
+    bool _tuneChunks;       // true if the number of chunks should be adjusted between phases
 
     // *** data members initialized by this class during setup ***
     quint64 _Nlambda;       // the number of wavelengths in the simulation's wavelength grid
     quint64 _Nchunks;       // the number of chunks to be launched per wavelength
+    quint64 _firstlocalchunk;  // the index of the first chunk per wavelength launched by this process
+    quint64 _Nlocalchunks;  // the number of chunks to be launched per wavelength by this process
+    quint64 _Nlocallambda;  // the number of wavelengths handled by this process
     quint64 _chunksize;     // the number of photon packages in one chunk
     quint64 _Npp;           // the precise number of photon packages to be launched per wavelength
     quint64 _logchunksize;  // the number of photon packages to be processed between logprogress() invocations
@@ -324,6 +417,9 @@ private:
     // *** data members used by the XXXprogress() functions in this class ***
     QString _phase;         // a string identifying the photon shooting phase for use in the log message
     std::atomic<quint64> _Ndone;  // the number of photon packages processed so far (for all wavelengths)
+    quint64 _Nphases;       // the number of phases started so far (identifies the phase for initchunk())
+    std::atomic<quint64> _phasework;     // the total work recorded by the chunks in the current phase
+    std::atomic<quint64> _maxchunkwork;  // the largest work recorded by a single chunk in the current phase
     QTime _timer;           // measures the time elapsed since the most recent log message
 };
 
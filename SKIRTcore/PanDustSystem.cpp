@@ -6,6 +6,7 @@
 #include <cmath>
 #include <fstream>
 #include "ArrayTable.hpp"
+#include "Checkpoint.hpp"
 #include "DustEmissivity.hpp"
 #include "DustGridStructure.hpp"
 #include "DustLib.hpp"
@@ -20,6 +21,7 @@
 #include "PanDustSystem.hpp"
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
+#include "ProcessCommunicator.hpp"
 #include "Units.hpp"
 #include "WavelengthGrid.hpp"
 
@@ -29,7 +31,8 @@ using namespace std;
 
 PanDustSystem::PanDustSystem()
     : _dustemissivity(0), _dustlib(0), _selfabsorption(true), _writeEmissivity(false),
-      _writeTemp(true), _writeISRF(true), _Nlambda(0)
+      _writeTemp(true), _writeISRF(true), _Nlambda(0), _lambdastride(1), _lambdaoffset(0),
+      _accstellar(true)
 {
 }
 
@@ -113,13 +116,26 @@ void PanDustSystem::setupSelfAfter()
     // - absorbed dust emission is relevant for calculating dust self-absorption
     _haveLabsstel = false;
     _haveLabsdust = false;
+    // - the tables are wavelength-major so that threads working at different wavelengths update different rows
+    // - in data-parallel mode, each process holds only the rows for its own wavelengths
     if (dustemission())
     {
-        _Labsstelvv.resize(_Ncells,_Nlambda);
+        ProcessCommunicator* comm = find<ProcessCommunicator>();
+        if (comm->dataParallel())
+        {
+            _lambdastride = comm->size();
+            _lambdaoffset = comm->rank();
+        }
+        int Nrows = comm->localCount(_Nlambda);
+
+        _accstellar = true;
+        _Labsstelvv.resize(Nrows,_Ncells);
+        _Labsstelv.resize(_Ncells);
         _haveLabsstel = true;
         if (selfAbsorption())
         {
-            _Labsdustvv.resize(_Ncells,_Nlambda);
+            _Labsdustvv.resize(Nrows,_Ncells);
+            _Labsdustv.resize(_Ncells);
             _haveLabsdust = true;
         }
     }
@@ -255,12 +271,12 @@ void PanDustSystem::absorb(int m, int ell, double DeltaL, bool ynstellar)
     if (ynstellar)
     {
         if (!_haveLabsstel) throw FATALERROR("This dust system does not support absorption of stellar emission");
-        LockFree::add(_Labsstelvv(m,ell), DeltaL);
+        LockFree::add(_Labsstelvv(ell/_lambdastride,m), DeltaL);
     }
     else
     {
         if (!_haveLabsdust) throw FATALERROR("This dust system does not support absorption of dust emission");
-        LockFree::add(_Labsdustvv(m,ell), DeltaL);
+        LockFree::add(_Labsdustvv(ell/_lambdastride,m), DeltaL);
     }
 }
 
@@ -269,15 +285,139 @@ void PanDustSystem::absorb(int m, int ell, double DeltaL, bool ynstellar)
 void PanDustSystem::rebootLabsdust()
 {
     _Labsdustvv.clear();
+    _Labsdustv = 0.;
+    _accstellar = false;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // the number of cells handled by a single invocation of PanDustSystem::sumcells()
+    const int cellBlockSize = 4096;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::sumResults()
+{
+    if (!_haveLabsstel) return;
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+
+    // if each process handles all wavelengths, sum the complete table over all processes
+    Table<2>& target = _accstellar ? _Labsstelvv : _Labsdustvv;
+    if (comm->isMultiProc() && !comm->dataParallel())
+        comm->sum(&target(0,0), target.size(0)*_Ncells);
+
+    // calculate the bolometric luminosities from the rows held by this process, for blocks of cells in parallel
+    int Nblocks = (_Ncells + cellBlockSize - 1) / cellBlockSize;
+    find<ParallelFactory>()->parallel()->call(this, &PanDustSystem::sumcells, Nblocks);
+
+    // in data-parallel mode, sum the bolometric luminosities over all processes
+    if (comm->dataParallel()) comm->sum(_accstellar ? _Labsstelv : _Labsdustv);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::sumcells(size_t i)
+{
+    const Table<2>& source = _accstellar ? _Labsstelvv : _Labsdustvv;
+    Array& target = _accstellar ? _Labsstelv : _Labsdustv;
+    int mbegin = i*cellBlockSize;
+    int mend = min(_Ncells, mbegin+cellBlockSize);
+
+    for (int m=mbegin; m<mend; m++) target[m] = 0.;
+    int Nrows = source.size(0);
+    for (int k=0; k<Nrows; k++)
+    {
+        const double* rowv = &source(k,0);
+        for (int m=mbegin; m<mend; m++) target[m] += rowv[m];
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::gatherResults()
+{
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+    if (!comm->dataParallel() || !(writeISRF() || writeTemperature())) return;
+
+    if (_haveLabsstel) gathertable(_Labsstelvv);
+    if (_haveLabsdust) gathertable(_Labsdustvv);
+    _lambdastride = 1;
+    _lambdaoffset = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::gathertable(Table<2>& table)
+{
+    ProcessCommunicator* comm = find<ProcessCommunicator>();
+
+    Table<2> fullvv;
+    if (comm->isRoot()) fullvv.resize(_Nlambda,_Ncells);
+    Array rowv(_Ncells);
+    for (int ell=0; ell<_Nlambda; ell++)
+    {
+        int owner = comm->owner(ell);
+        if (owner == comm->rank())
+        {
+            const double* localv = &table(comm->localIndex(ell),0);
+            for (int m=0; m<_Ncells; m++) rowv[m] = localv[m];
+        }
+        comm->broadcast(&rowv[0], _Ncells, owner);
+        if (comm->isRoot())
+        {
+            double* fullrowv = &fullvv(ell,0);
+            for (int m=0; m<_Ncells; m++) fullrowv[m] = rowv[m];
+        }
+    }
+    table.swap(fullvv);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    if (_haveLabsstel)
+    {
+        checkpoint.write(_Labsstelvv);
+        checkpoint.write(_Labsstelv);
+    }
+    if (_haveLabsdust)
+    {
+        checkpoint.write(_Labsdustvv);
+        checkpoint.write(_Labsdustv);
+    }
+    if (_dustlib) _dustlib->writeCheckpoint(checkpoint);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::readCheckpoint(Checkpoint& checkpoint)
+{
+    if (_haveLabsstel)
+    {
+        checkpoint.read(_Labsstelvv);
+        checkpoint.read(_Labsstelv);
+    }
+    if (_haveLabsdust)
+    {
+        checkpoint.read(_Labsdustvv);
+        checkpoint.read(_Labsdustv);
+    }
+    if (_dustlib) _dustlib->readCheckpoint(checkpoint);
 }
 
 //////////////////////////////////////////////////////////////////////
 
 double PanDustSystem::Labs(int m, int ell) const
 {
+    if (ell % _lambdastride != _lambdaoffset) return 0.;
+    int k = ell / _lambdastride;
     double sum = 0;
-    if (_haveLabsstel) sum += _Labsstelvv(m,ell);
-    if (_haveLabsdust) sum += _Labsdustvv(m,ell);
+    if (_haveLabsstel) sum += _Labsstelvv(k,m);
+    if (_haveLabsdust) sum += _Labsdustvv(k,m);
     return sum;
 }
 
@@ -286,12 +426,8 @@ double PanDustSystem::Labs(int m, int ell) const
 double PanDustSystem::Labs(int m) const
 {
     double sum = 0;
-    if (_haveLabsstel)
-        for (int ell=0; ell<_Nlambda; ell++)
-            sum += _Labsstelvv(m,ell);
-    if (_haveLabsdust)
-        for (int ell=0; ell<_Nlambda; ell++)
-            sum += _Labsdustvv(m,ell);
+    if (_haveLabsstel) sum += _Labsstelv[m];
+    if (_haveLabsdust) sum += _Labsdustv[m];
     return sum;
 }
 
@@ -299,35 +435,40 @@ double PanDustSystem::Labs(int m) const
 
 double PanDustSystem::Labsstellartot() const
 {
-    double sum = 0;
-    if (_haveLabsstel)
-        for (int m=0; m<_Ncells; m++)
-            for (int ell=0; ell<_Nlambda; ell++)
-                sum += _Labsstelvv(m,ell);
-    return sum;
+    return _haveLabsstel ? _Labsstelv.sum() : 0.;
 }
 
 //////////////////////////////////////////////////////////////////////
 
 double PanDustSystem::Labsdusttot() const
 {
-    double sum = 0;
-    if (_haveLabsdust)
-        for (int m=0; m<_Ncells; m++)
-            for (int ell=0; ell<_Nlambda; ell++)
-                sum += _Labsdustvv(m,ell);
-    return sum;
+    return _haveLabsdust ? _Labsdustv.sum() : 0.;
 }
 
 //////////////////////////////////////////////////////////////////////
 
 Array PanDustSystem::meanintensityv(int m) const
+{
+    Array Jv;
+    meanintensityv(m, Jv);
+    return Jv;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void PanDustSystem::meanintensityv(int m, Array& Jv) const
 {
     WavelengthGrid* lambdagrid = find<WavelengthGrid>();
-    Array Jv(lambdagrid->Nlambda());
+    if (Jv.size() != static_cast<size_t>(lambdagrid->Nlambda())) Jv.resize(lambdagrid->Nlambda());
     double fac = 4.0*M_PI*volume(m);
     for (int ell=0; ell<lambdagrid->Nlambda(); ell++)
     {
+        // in data-parallel mode, leave the wavelengths handled by other processes at zero
+        if (ell % _lambdastride != _lambdaoffset)
+        {
+            Jv[ell] = 0.0;
+            continue;
+        }
         double kappaabsrho = 0.0;
         for (int h=0; h<_Ncomp; h++)
         {
@@ -339,7 +480,6 @@ Array PanDustSystem::meanintensityv(int m) const
         // guard against (rare) situations where both Labs and kappa*fac are zero
         Jv[ell] = std::isfinite(J) ? J : 0.0;
     }
-    return Jv;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -489,15 +629,16 @@ void PanDustSystem::write() const
         for (int ell=0; ell<_Nlambda; ell++)
             file << units->owavelength(lambdagrid->lambda(ell)) << '\t';
         file << '\n' << '\n';
-        for (int m=0; m<_Ncells; m++)
+        for (int i=0; i<_Ncells; i++)
         {
+            int m = _grid->cellAtOutputIndex(i);
             double Ltotm = Labs(m);
             if (Ltotm>0.0)
             {
                 Position bfr = _grid->centralPositionInCell(m);
                 double x, y, z;
                 bfr.cartesian(x,y,z);
-                file << m << '\t'
+                file << i << '\t'
                           << units->olength(x) << '\t'
                           << units->olength(y) << '\t'
                           << units->olength(z) << '\t';
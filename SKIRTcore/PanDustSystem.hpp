@@ -7,6 +7,7 @@
 #define PANDUSTSYSTEM_HPP
 
 #include "DustSystem.hpp"
+class Checkpoint;
 class DustEmissivity;
 class DustLib;
 
@@ -17,7 +18,14 @@ class DustLib;
     and additionaly supports dust emission. It maintains information on the absorbed energy for
     each cell at each wavelength in a (potentially very large) table. It also holds a
     DustEmissivity object and a DustLib object used to calculate the dust emission spectrum for
-    dust cells. */
+    dust cells.
+
+    The absorbed energy is stored in wavelength-major tables, in which each wavelength occupies its
+    own contiguous row. Since each parallel chunk of photon packages is launched at a single
+    wavelength, concurrent threads usually work at different wavelengths while crossing the same
+    cells, so that they update different rows rather than neighbouring entries of the same cell,
+    which would cause heavy contention on shared cache lines. The updates are still performed
+    atomically, because multiple chunks for the same wavelength may be processed concurrently. */
 class PanDustSystem : public DustSystem
 {
     Q_OBJECT
@@ -136,15 +144,48 @@ public:
         called from multiple threads. */
     void absorb(int m, int ell, double DeltaL, bool ynstellar);
 
-    /** This function resets the absorbed dust luminosity to zero in all cells of the dust system. */
+    /** This function resets the absorbed dust luminosity to zero in all cells of the dust system.
+        Subsequent calls to sumResults() apply to the absorbed dust luminosity rather than to the
+        absorbed stellar luminosity. */
     void rebootLabsdust();
 
+    /** This function completes the absorbed luminosities recorded during the most recent photon
+        shooting phase (stellar emission, or dust emission after rebootLabsdust() has been called).
+        If the simulation is performed by multiple processes that each handle all wavelengths, the
+        luminosities for each cell and wavelength are replaced by their sums over all processes.
+        The function then calculates the bolometric absorbed luminosity in each cell. In
+        data-parallel mode (see ProcessCommunicator::dataParallel()), each process holds the
+        luminosities only for its own wavelengths, and just the bolometric luminosities are summed
+        over all processes. The function must be called (by all processes) after each photon
+        shooting phase that records absorption, and before any of the Labs() functions is used. */
+    void sumResults();
+
+    /** In data-parallel mode, and if the ISRF or the dust temperatures will be written, this
+        function assembles the absorbed luminosities for all wavelengths in the root process, so
+        that the root process can calculate the complete mean intensity in each cell. Other
+        processes release their luminosity tables. The root process must thus be able to hold the
+        tables for all wavelengths at this point. The function must be called (by all processes)
+        after the last photon shooting phase and before write(). Otherwise it does nothing. */
+    void gatherResults();
+
+    /** This function writes the absorbed luminosities for each cell and wavelength held by this
+        process, the bolometric absorbed luminosities for each cell, and the state of the dust
+        library (see DustLib::writeCheckpoint()), to the specified checkpoint. It must be called
+        after sumResults() has been called for the most recent photon shooting phase. */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the state written by writeCheckpoint() from the specified
+        checkpoint. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
     /** This function returns the absorbed luminosity \f$L_{\ell,m}\f$ at wavelength index
-        \f$\ell\f$ in the dust cell with cell number \f$m\f$. */
+        \f$\ell\f$ in the dust cell with cell number \f$m\f$. In data-parallel mode, the function
+        returns zero for wavelengths handled by other processes. */
     double Labs(int m, int ell) const;
 
     /** This function returns the total (bolometric) absorbed luminosity in the dust cell with cell
-        number \f$m\f$. It is calculated by summing the absorbed luminosity at all the wavelength indices. */
+        number \f$m\f$, i.e. the absorbed luminosity summed over all the wavelength indices, as
+        calculated by sumResults(). */
     double Labs(int m) const;
 
     /** This function returns the total (bolometric) absorbed dust luminosity in the entire dust system.
@@ -161,9 +202,16 @@ public:
         \kappa_{\ell,h}^{\text{abs}}\, \rho_{m,h} } \f] with \f$L_{\ell,m}^{\text{abs}}\f$ the
         absorbed luminosity, \f$\kappa_{\ell,h}^{\text{abs}}\f$ the absorption coefficient
         corresponding to the \f$h\f$'th dust component, \f$\rho_{m,h}\f$ the dust density
-        corresponding to the \f$h\f$'th dust component, and \f$V_m\f$ the volume of the cell. */
+        corresponding to the \f$h\f$'th dust component, and \f$V_m\f$ the volume of the cell. In
+        data-parallel mode, the values for the wavelengths handled by other processes are zero. */
     Array meanintensityv(int m) const;
 
+    /** This function stores the mean radiation field \f$J_{\ell,m}\f$ at all wavelength indices in
+        the dust cell with cell number \f$m\f$ into the specified array, as described for the other
+        version of this function. The array is resized only if its size differs from the number of
+        wavelengths, so that a caller handling many cells can reuse the same array. */
+    void meanintensityv(int m, Array& Jv) const;
+
     /** This function (re-)calculates the relevant dust emission spectra for the dust system, based
         on the absorption data currently stored in the dust cells, and internally caches the
         results. If dust emission is turned off, this function does nothing. */
@@ -201,6 +249,17 @@ public:
         that the dust emits as a modified blackbody at an equibrium temperature. */
     void write() const;
 
+private:
+    /** This function calculates the bolometric luminosities for the block of cells with the
+        specified index, from the rows of the luminosity table for the current phase held by this
+        process. It is called in parallel by sumResults(). */
+    void sumcells(size_t i);
+
+    /** This function assembles the specified luminosity table for all wavelengths in the root
+        process, from the rows held by each process, and releases the table in the other processes.
+        */
+    void gathertable(Table<2>& table);
+
     //======================== Data Members ========================
 
 private:
@@ -214,10 +273,15 @@ private:
 
     // data members initialized during setup
     int _Nlambda;
-    Table<2> _Labsstelvv;   // absorbed stellar emission for each cell and each wavelength (indexed on m,ell)
-    Table<2> _Labsdustvv;   // absorbed dust emission for each cell and each wavelength (indexed on m,ell)
+    int _lambdastride;      // the number of processes sharing the wavelengths (1 if not in data-parallel mode)
+    int _lambdaoffset;      // the first wavelength index handled by this process (0 if not in data-parallel mode)
+    Table<2> _Labsstelvv;   // absorbed stellar emission for each local wavelength and each cell (indexed on ell,m)
+    Table<2> _Labsdustvv;   // absorbed dust emission for each local wavelength and each cell (indexed on ell,m)
+    Array _Labsstelv;       // bolometric absorbed stellar emission for each cell
+    Array _Labsdustv;       // bolometric absorbed dust emission for each cell
     bool _haveLabsstel;     // true if absorbed stellar emission is relevant for this simulation
     bool _haveLabsdust;     // true if absorbed dust emission is relevant for this simulation
+    bool _accstellar;       // true if the current phase records stellar emission, false if dust emission
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -3,14 +3,18 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include <QFile>
+#include "FatalError.hpp"
+#include "FilePaths.hpp"
+#include "InstrumentSystem.hpp"
 #include "Log.hpp"
-#include "NR.hpp"
 #include "PanDustSystem.hpp"
 #include "PanMonteCarloSimulation.hpp"
 #include "PanWavelengthGrid.hpp"
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
 #include "PhotonPackage.hpp"
+#include "ProcessCommunicator.hpp"
 #include "Random.hpp"
 #include "SED.hpp"
 #include "StellarSystem.hpp"
@@ -21,8 +25,22 @@ using namespace std;
 
 ////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    // the stages of the simulation recorded in a checkpoint
+    enum { NoStage, StellarEmissionDone, DustSelfAbsorptionDone, DustEmissionDone };
+
+    // the name of the checkpoint file in the output directory, without extension
+    const char* checkpointName = "checkpoint";
+
+    // the maximum amount of memory occupied by the emission tables for a batch of wavelengths, in bytes
+    const double maxEmissionTableMemory = 1e9;
+}
+
+////////////////////////////////////////////////////////////////////
+
 PanMonteCarloSimulation::PanMonteCarloSimulation()
-    : _pds(0)
+    : _pds(0), _Ncells(0), _firstbatchlambda(0), _Nbatchlambda(0), _stage(NoStage), _cycle(0)
 {
 }
 
@@ -90,28 +108,107 @@ PanDustSystem* PanMonteCarloSimulation::dustSystem() const
 
 void PanMonteCarloSimulation::runSelf()
 {
-    runstellaremission();
+    if (checkpointing()) loadcheckpoint();
+
+    if (_stage < StellarEmissionDone)
+    {
+        runstellaremission();
+        if (_pds && _pds->dustemission()) _pds->sumResults();
+        savecheckpoint(StellarEmissionDone, 0);
+    }
     if (_pds && _pds->dustemission())
     {
-        if (_pds && _pds->selfAbsorption()) rundustselfabsorption();
-        rundustemission();
+        if (_stage < DustSelfAbsorptionDone && _pds->selfAbsorption()) rundustselfabsorption();
+        if (_stage < DustEmissionDone)
+        {
+            rundustemission();
+            savecheckpoint(DustEmissionDone, _cycle);
+        }
+        _pds->gatherResults();
     }
     write();
+
+    // the results have been written, so the checkpoint is no longer needed
+    if (checkpointing())
+    {
+        _checkpoint.wait();
+        QFile::remove(checkpointpath());
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+void PanMonteCarloSimulation::savecheckpoint(int stage, int cycle)
+{
+    _stage = stage;
+    _cycle = cycle;
+    if (!checkpointing()) return;
+
+    if (!_checkpoint.wait()) _log->warning("Could not write the previous checkpoint");
+    _checkpoint.begin(checkpointpath());
+    _checkpoint.write(static_cast<quint64>(_stage));
+    _checkpoint.write(static_cast<quint64>(_cycle));
+    writeCheckpoint(_checkpoint);
+    if (_pds) _pds->writeCheckpoint(_checkpoint);
+    _checkpoint.save();
+}
+
+////////////////////////////////////////////////////////////////////
+
+void PanMonteCarloSimulation::loadcheckpoint()
+{
+    QString filepath = checkpointpath();
+    if (_checkpoint.load(filepath))
+    {
+        _log->info("Reading checkpoint from file " + filepath + "...");
+        int stage = _checkpoint.readInt();
+        int cycle = _checkpoint.readInt();
+        readCheckpoint(_checkpoint);
+        if (_pds) _pds->readCheckpoint(_checkpoint);
+        _stage = stage;
+        _cycle = cycle;
+    }
+
+    // all processes must resume from the same stage
+    double stagev[2] = { static_cast<double>(_stage), static_cast<double>(_cycle) };
+    _comm->sum(stagev, 2);
+    if (stagev[0] != _stage*_comm->size() || stagev[1] != _cycle*_comm->size())
+        throw FATALERROR("The checkpoints of the processes participating in the simulation are inconsistent");
+    if (_stage == NoStage) return;
+
+    QString done = "the stellar emission phase";
+    if (_stage == StellarEmissionDone && _cycle > 0) done = "dust self-absorption cycle " + QString::number(_cycle);
+    if (_stage == DustSelfAbsorptionDone) done = "the dust self-absorption phase";
+    if (_stage == DustEmissionDone) done = "the dust emission phase";
+    _log->info("Resuming the simulation after " + done);
+}
+
+////////////////////////////////////////////////////////////////////
+
+QString PanMonteCarloSimulation::checkpointpath() const
+{
+    QString name = checkpointName;
+    if (_comm->isMultiProc()) name += "_" + QString::number(_comm->rank());
+    return _paths->output(name + ".dat");
 }
 
 ////////////////////////////////////////////////////////////////////
 
 void PanMonteCarloSimulation::rundustselfabsorption()
 {
-    TimeLogger logger(_log, "the dust self-absorption phase");
+    Parallel* parallel = find<ParallelFactory>()->parallel();
+    TimeLogger logger(_log, "the dust self-absorption phase", parallel);
 
     const int Ncyclesmax = 100;
     const double epsmax = 0.005;
     Array Labsdusttotv(Ncyclesmax+1);
 
-    for (int cycle=1; cycle<=Ncyclesmax; cycle++)
+    // when resuming from a checkpoint, continue after the last completed cycle
+    if (_cycle > 0) Labsdusttotv[_cycle] = _pds->Labsdusttot();
+
+    for (int cycle=_cycle+1; cycle<=Ncyclesmax; cycle++)
     {
-        TimeLogger logger(_log, "the dust self-absorption cycle " + QString::number(cycle));
+        TimeLogger logger(_log, "the dust self-absorption cycle " + QString::number(cycle), parallel);
 
         // Construct the dust emission spectra
         _log->info("Calculating dust emission spectra...");
@@ -127,8 +224,9 @@ void PanMonteCarloSimulation::rundustselfabsorption()
 
         // Run a simulation
         initprogress("dust self-absorption cycle " + QString::number(cycle));
-        Parallel* parallel = find<ParallelFactory>()->parallel();
-        parallel->call(this, &PanMonteCarloSimulation::dodustselfabsorptionchunk, _Nchunks*_Nlambda);
+        launchdustchunks(parallel, &PanMonteCarloSimulation::dodustselfabsorptionchunk);
+        _pds->sumResults();
+        tunechunks();
 
         // Update the absorbed luminosity in each cell. Save the total absorbed luminosity in the vector Labstotv.
         Labsdusttotv[cycle] = _pds->Labsdusttot();
@@ -146,56 +244,53 @@ void PanMonteCarloSimulation::rundustselfabsorption()
         {
             _log->info("Convergence reached; the last increase in the absorbed dust luminosity was "
                        + QString::number(eps*100, 'f', 2) + "%");
+            savecheckpoint(DustSelfAbsorptionDone, cycle);
             return;
         }
         else
         {
             _log->info("Convergence not yet reached; the increase in the absorbed dust luminosity was "
                        + QString::number(eps*100, 'f', 2) + "%");
+            savecheckpoint(StellarEmissionDone, cycle);
         }
     }
     _log->error("Convergence not yet reached after " + QString::number(Ncyclesmax) + " cycles!");
+    savecheckpoint(DustSelfAbsorptionDone, Ncyclesmax);
 }
 
 ////////////////////////////////////////////////////////////////////
 
 void PanMonteCarloSimulation::dodustselfabsorptionchunk(size_t index)
 {
-    // Determine the wavelength index for this chunk
-    int ell = index % _Nlambda;
-
-    // Determine the luminosity to be emitted at this wavelength index
-    Array Lv(_Ncells);
-    for (int m=0; m<_Ncells; m++)
-    {
-        double Labsbol = _Labsbolv[m];
-        if (Labsbol>0.0) Lv[m] = Labsbol * _pds->dustluminosity(m,ell);
-    }
-    double Ltot = Lv.sum();
+    // Determine the wavelength index for this chunk, and get the luminosity to be emitted at this wavelength
+    int ell;
+    size_t slot = initdustchunk(index, ell);
+    const AliasTable& table = _emissiontables[slot];
+    double Ltot = _Ltotv[slot];
 
     // Emit photon packages
     if (Ltot > 0)
     {
-        Array Xv;
-        NR::cdf(Xv, Lv);
-
         PhotonPackage pp;
         double L = Ltot / _Npp;
         double Lmin = 1e-4*L;
 
+        quint64 work = 0;
         quint64 remaining = _chunksize;
         while (remaining > 0)
         {
             quint64 count = qMin(remaining, _logchunksize);
+            work += count;
             for (quint64 i=0; i<count; i++)
             {
                 double X = _random->uniform();
-                int m = NR::locate_clip(Xv,X);
+                int m = table.sample(X);
                 Position bfr = _pds->randomPositionInCell(m);
                 Direction bfk = _random->direction();
                 pp.launch(L,ell,bfr,bfk);
                 while (true)
                 {
+                    work++;
                     _pds->fillOpticalDepth(&pp);
                     simulateescapeandabsorption(&pp,true);
                     if (pp.luminosity() <= Lmin) break;
@@ -206,15 +301,68 @@ void PanMonteCarloSimulation::dodustselfabsorptionchunk(size_t index)
             logprogress(count);
             remaining -= count;
         }
+        recordchunkwork(work);
     }
     else logprogress(_chunksize);
 }
 
 ////////////////////////////////////////////////////////////////////
 
+void PanMonteCarloSimulation::launchdustchunks(Parallel* parallel,
+                                               void (PanMonteCarloSimulation::*chunkfunction)(size_t))
+{
+    // determine the number of wavelengths in a batch
+    double tableMemory = double(_Ncells) * (sizeof(double)+sizeof(int));
+    size_t Nbatch = max(size_t(1), min(size_t(_Nlocallambda), size_t(maxEmissionTableMemory/max(tableMemory,1.))));
+    if (Nbatch < _Nlocallambda)
+        _log->info("Processing the emission tables in batches of " + QString::number(Nbatch) + " wavelengths");
+    _emissiontables.resize(Nbatch);
+    _Ltotv.resize(Nbatch);
+
+    // process the wavelengths batch by batch
+    for (_firstbatchlambda=0; _firstbatchlambda<_Nlocallambda; _firstbatchlambda+=Nbatch)
+    {
+        _Nbatchlambda = min(Nbatch, size_t(_Nlocallambda-_firstbatchlambda));
+        parallel->call(this, &PanMonteCarloSimulation::calculateemissiontable, _Nbatchlambda);
+        parallel->call(this, chunkfunction, _Nlocalchunks*_Nbatchlambda);
+    }
+
+    // release the emission tables
+    vector<AliasTable>().swap(_emissiontables);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void PanMonteCarloSimulation::calculateemissiontable(size_t slot)
+{
+    // Determine the wavelength index corresponding to this slot (see MonteCarloSimulation::initchunk)
+    size_t index = _firstbatchlambda + slot;
+    int ell = _comm->dataParallel() ? _comm->globalIndex(index) : index;
+
+    // Construct the table from the luminosity emitted by each cell at this wavelength index
+    _Ltotv[slot] = _emissiontables[slot].initialize(_Ncells, [this,ell](int m)
+    {
+        double Labsbol = _Labsbolv[m];
+        return Labsbol>0.0 ? Labsbol * _pds->dustluminosity(m,ell) : 0.0;
+    });
+}
+
+////////////////////////////////////////////////////////////////////
+
+size_t PanMonteCarloSimulation::initdustchunk(size_t index, int& ell)
+{
+    // translate the index within the batch to the index for launching all wavelengths in a single batch
+    size_t slot = index % _Nbatchlambda;
+    ell = initchunk((index / _Nbatchlambda)*_Nlocallambda + _firstbatchlambda + slot) % _Nlambda;
+    return slot;
+}
+
+////////////////////////////////////////////////////////////////////
+
 void PanMonteCarloSimulation::rundustemission()
 {
-    TimeLogger logger(_log, "the dust emission phase");
+    Parallel* parallel = find<ParallelFactory>()->parallel();
+    TimeLogger logger(_log, "the dust emission phase", parallel);
 
     // Construct the dust emission spectra
     _log->info("Calculating dust emission spectra...");
@@ -227,62 +375,59 @@ void PanMonteCarloSimulation::rundustemission()
 
     // perform the actual dust emission
     initprogress("dust emission");
-    Parallel* parallel = find<ParallelFactory>()->parallel();
-    parallel->call(this, &PanMonteCarloSimulation::dodustemissionchunk, _Nchunks*_Nlambda);
+    launchdustchunks(parallel, &PanMonteCarloSimulation::dodustemissionchunk);
+    _is->flush();
+    tunechunks();
 }
 
 ////////////////////////////////////////////////////////////////////
 
 void PanMonteCarloSimulation::dodustemissionchunk(size_t index)
 {
-    // Determine the wavelength index for this chunk
-    int ell = index % _Nlambda;
-
-    // Determine the luminosity to be emitted at this wavelength index
-    Array Lv(_Ncells);
-    for (int m=0; m<_Ncells; m++)
-    {
-        double Labsbol = _Labsbolv[m];
-        if (Labsbol>0.0) Lv[m] = Labsbol * _pds->dustluminosity(m,ell);
-    }
-    double Ltot = Lv.sum();
+    // Determine the wavelength index for this chunk, and get the luminosity to be emitted at this wavelength
+    int ell;
+    size_t slot = initdustchunk(index, ell);
+    const AliasTable& table = _emissiontables[slot];
+    double Ltot = _Ltotv[slot];
 
     // Emit photon packages
     if (Ltot > 0)
     {
-        Array Xv;
-        NR::cdf(Xv, Lv);
-
-        PhotonPackage pp,ppp;
+        PhotonPackage pp;
+        vector<PhotonPackage> pppv(_is->groups().size());
         double L = Ltot / _Npp;
         double Lmin = 1e-4 * L;
 
+        quint64 work = 0;
         quint64 remaining = _chunksize;
         while (remaining > 0)
         {
             quint64 count = qMin(remaining, _logchunksize);
+            work += count;
             for (quint64 i=0; i<count; i++)
             {
                 double X = _random->uniform();
-                int m = NR::locate_clip(Xv,X);
+                int m = table.sample(X);
                 Position bfr = _pds->randomPositionInCell(m);
                 Direction bfk = _random->direction();
                 pp.launch(L,ell,bfr,bfk);
-                peeloffemission(&pp,&ppp);
+                peeloffemission(&pp,&pppv[0]);
                 while (true)
                 {
+                    work++;
                     _pds->fillOpticalDepth(&pp);
-                    if (_continuousScattering) continuouspeeloffscattering(&pp,&ppp);
+                    if (_continuousScattering) continuouspeeloffscattering(&pp,&pppv[0]);
                     simulateescapeandabsorption(&pp,false);
                     if (pp.luminosity() <= Lmin) break;
                     simulatepropagation(&pp);
-                    if (!_continuousScattering) peeloffscattering(&pp,&ppp);
+                    if (!_continuousScattering) peeloffscattering(&pp,&pppv[0]);
                     simulatescattering(&pp);
                 }
             }
             logprogress(count);
             remaining -= count;
         }
+        recordchunkwork(work);
     }
     else logprogress(_chunksize);
 }
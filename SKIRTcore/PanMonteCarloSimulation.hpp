@@ -6,10 +6,14 @@
 #ifndef PANMONTECARLOSIMULATION_HPP
 #define PANMONTECARLOSIMULATION_HPP
 
+#include <vector>
+#include "AliasTable.hpp"
 #include "Array.hpp"
+#include "Checkpoint.hpp"
 #include "MonteCarloSimulation.hpp"
 class PanDustSystem;
 class PanWavelengthGrid;
+class Parallel;
 
 //////////////////////////////////////////////////////////////////////
 
@@ -70,10 +74,33 @@ public:
 protected:
     /** This function actually runs the simulation. For a panchromatic simulation, this includes
         the stellar emission phase, the dust self-absorption phase, and the dust emission phase
-        (plus writing the results). */
+        (plus writing the results). If checkpointing is enabled (see
+        Simulation::setCheckpointing()), a checkpoint is saved at the end of each phase and of each
+        dust self-absorption cycle, and the simulation resumes after the phase or cycle recorded in
+        the checkpoint file left by a previous run, if there is one. The checkpoint file is removed
+        after the results have been written. */
     void runSelf();
 
 private:
+    /** This function records the specified stage as the most recently completed stage of the
+        simulation, i.e. one of the constants defined in the implementation, and the specified
+        number of completed dust self-absorption cycles. If checkpointing is enabled, it then saves
+        a checkpoint with the complete state of the simulation, including the absorbed luminosities
+        in the dust system and the state kept by the dust library across self-absorption cycles.
+        The checkpoint file is written by a separate thread, in blocks as the state is being
+        collected, so that the simulation can proceed with the next phase in the mean time. */
+    void savecheckpoint(int stage, int cycle);
+
+    /** This function loads the checkpoint saved by a previous run of the simulation, if there is
+        one, and restores the complete state of the simulation, including the most recently
+        completed stage and the number of completed dust self-absorption cycles. */
+    void loadcheckpoint();
+
+    /** This function returns the path of the checkpoint file in the output directory. If the
+        simulation is performed by multiple processes, each process uses a separate file, because
+        the processes may hold different parts of the simulation state. */
+    QString checkpointpath() const;
+
     /** This function drives the dust self-absorption phase in a panchromatic Monte Carlo
         simulation. This function consists of a big loop, which represents the different cycles of
         the dust self-absorption phase. This outer loop, and the function, terminates when either
@@ -94,7 +121,11 @@ private:
         vector \f$X_m\f$ that describes the normalized cumulative luminosity distribution as a
         function of the cell number \f$m\f$, \f[ X_m = \frac{ \sum_{m'=0}^m L_{\ell,m'} }{ L_\ell
         }. \f] This vector is used to generate random dust cells from which photon packages can be
-        launched. Now the actual dust self-absorption can start, i.e. we launch \f$N_{\text{pp}}\f$
+        launched. In practice, the distribution is represented by an alias table (see the
+        AliasTable class), so that a cell can be drawn in constant time. The tables for all
+        wavelengths are constructed in parallel before any photon packages are launched; if they
+        would occupy too much memory, the wavelengths are processed in consecutive batches. Now
+        the actual dust self-absorption can start, i.e. we launch \f$N_{\text{pp}}\f$
         different photon packages at wavelength index \f$\ell\f$, with the original position chosen
         as a random position in the cell \f$m\f$ chosen randomly from the cumulative luminosity
         distribution \f$X_m\f$. The remaining life cycle of a photon package in the dust emission
@@ -120,7 +151,8 @@ private:
         L_{\ell,m}, \f] and create a vector \f$X_m\f$ that describes the normalized cumulative
         luminosity distribution as a function of the cell number \f$m\f$, \f[ X_m = \frac{
         \sum_{m'=0}^m L_{\ell,m'} }{ L_\ell }. \f] This vector is used to generate random dust
-        cells from which photon packages can be launched. Now the actual dust emission can start,
+        cells from which photon packages can be launched (see rundustselfabsorption() for the
+        actual representation of this distribution). Now the actual dust emission can start,
         i.e. we launch \f$N_{\text{pp}}\f$ different photon packages at wavelength index
         \f$\ell\f$, with the original position chosen as a random position in the cell \f$m\f$
         chosen randomly from the cumulative luminosity distribution \f$X_m\f$. The remaining life
@@ -131,6 +163,25 @@ private:
     /** This function implements the loop body for rundustemission(). */
     void dodustemissionchunk(size_t index);
 
+    /** This function launches all chunks of photon packages for the dust self-absorption or dust
+        emission phase, depending on the specified loop body. The wavelengths handled by this
+        process are divided into batches so that the emission tables for a batch fit within a
+        fixed memory budget. For each batch, the function first calculates the emission tables in
+        parallel and then launches the corresponding chunks. The chunk indices passed to the loop
+        body are translated so that each chunk is initialized exactly as it would be when
+        launching all wavelengths in a single batch. */
+    void launchdustchunks(Parallel* parallel, void (PanMonteCarloSimulation::*chunkfunction)(size_t));
+
+    /** This function calculates the luminosity emitted by each dust cell at the wavelength
+        corresponding to the specified index in the current batch, and constructs the emission
+        table for that wavelength. */
+    void calculateemissiontable(size_t slot);
+
+    /** This function initializes the chunk with the specified index in the current batch, and
+        returns the index of the corresponding wavelength in the current batch. It stores the
+        wavelength index \f$\ell\f$ in the output argument. */
+    size_t initdustchunk(size_t index, int& ell);
+
     //======================== Data Members ========================
 
 private:
@@ -139,6 +190,15 @@ private:
     // data members used to communicate between rundustXXX() and the corresponding parallel loop
     int _Ncells;           // number of dust cells
     Array _Labsbolv;       // vector that contains the bolometric absorbed luminosity in each cell
+    size_t _firstbatchlambda;  // the local index of the first wavelength in the current batch
+    size_t _Nbatchlambda;      // the number of wavelengths in the current batch
+    std::vector<AliasTable> _emissiontables;  // the emission table for each wavelength in the current batch
+    Array _Ltotv;          // the total luminosity emitted at each wavelength in the current batch
+
+    // data members used for checkpointing
+    int _stage;            // the most recently completed stage of the simulation
+    int _cycle;            // the number of completed dust self-absorption cycles
+    Checkpoint _checkpoint;  // the most recently saved or loaded checkpoint
 };
 
 ////////////////////////////////////////////////////////////////////
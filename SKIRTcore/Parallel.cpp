@@ -6,10 +6,12 @@
 #include "FatalError.hpp"
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
+#include <QElapsedTimer>
 
 ////////////////////////////////////////////////////////////////////
 
 Parallel::Parallel(int threadCount, ParallelFactory* factory)
+    : _busyTime(0), _callTime(0), _utilization(1.)
 {
     // remember the current thread
     _parentThread = QThread::currentThread();
@@ -60,12 +62,38 @@ int Parallel::threadCount() const
 
 ////////////////////////////////////////////////////////////////////
 
+double Parallel::utilization() const
+{
+    return _utilization;
+}
+
+////////////////////////////////////////////////////////////////////
+
+qint64 Parallel::callTime() const
+{
+    return _callTime;
+}
+
+////////////////////////////////////////////////////////////////////
+
+qint64 Parallel::busyTime() const
+{
+    return _busyTime;
+}
+
+////////////////////////////////////////////////////////////////////
+
 void Parallel::call(ParallelTarget* target, size_t limit)
 {
     // verify that we're being called from our parent thread
     if (QThread::currentThread() != _parentThread)
         throw FATALERROR("Parallel call not invoked from thread that constructed this object");
 
+    // start measuring the time spent in this call
+    QElapsedTimer timer;
+    timer.start();
+    qint64 busyTime = _busyTime;
+
     // copy the arguments so they can be used from any of the threads
     _target = target;
     _limit = limit;
@@ -88,6 +116,11 @@ void Parallel::call(ParallelTarget* target, size_t limit)
     // wait until all parallel threads are done
     waitForThreads();
 
+    // update the utilization statistics
+    qint64 callTime = timer.nsecsElapsed();
+    _callTime += callTime;
+    _utilization = callTime > 0 ? double(_busyTime - busyTime) / (double(callTime) * threadCount()) : 1.;
+
     // check for and process the exception, if any
     if (_exception)
     {
@@ -121,14 +154,29 @@ void Parallel::run()
 
 void Parallel::doWork()
 {
+    QElapsedTimer timer;
+    timer.start();
+
     try
     {
+        // use guided self-scheduling: each thread claims a block of consecutive indices, with a size
+        // proportional to the number of remaining indices, so that the blocks shrink to a single index
+        // as the loop approaches its limit
+        size_t divisor = 4*threadCount();
+
         // do work as long as some is available
+        size_t first = _next;
         forever
         {
-            size_t index = _next++;         // get the next index atomically
-            if (index >= _limit) break;     // break if no more are available
-            _target->body(index);           // execute the body
+            // claim the next block of indices atomically; break if no more are available
+            size_t limit = _limit;
+            if (first >= limit) break;
+            size_t last = first + qMax(size_t(1), (limit-first)/divisor);
+            if (!_next.compare_exchange_weak(first, last)) continue;  // another thread was first; retry
+
+            // execute the body for each index in the block, unless another thread has taken away the work
+            for (size_t index=first; index<last && index<_limit; index++) _target->body(index);
+            first = _next;
         }
     }
     catch (FatalError& error)
@@ -141,6 +189,9 @@ void Parallel::doWork()
         // create a fresh exception
         reportException(new FATALERROR("Unhandled exception (not of type FatalError) in a parallel thread"));
     }
+
+    // add the time spent doing work to the statistics
+    _busyTime += timer.nsecsElapsed();
 }
 
 ////////////////////////////////////////////////////////////////////
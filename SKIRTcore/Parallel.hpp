@@ -58,7 +58,21 @@ class ParallelFactory;
 
     The Parallel class uses Qt's multi-threading capabilities, avoiding the complexities of using
     yet another library (such as OpenMP) and making it possible to properly handle exceptions. It
-    is designed to minimize the run-time overhead for loops with many iterations. */
+    is designed to minimize the run-time overhead for loops with many iterations.
+
+    The iterations are handed out from a shared atomic counter using guided self-scheduling: a
+    thread that finishes its current work claims a block of consecutive indices with a size equal
+    to the number of remaining indices divided by four times the number of threads. Loops with many
+    cheap iterations thus require few atomic operations, while the block size shrinks to a single
+    iteration as the loop approaches its limit, so that the threads finish at nearly the same time.
+    Loops with fewer than eight iterations per thread are handed out one iteration at a time from
+    the start. The order in which the iterations are executed remains unpredictable; a loop body
+    should therefore never depend on the thread executing it. To help the caller tune the
+    granularity of its iterations, the Parallel instance keeps track of the time spent by the
+    threads executing the loop body compared to the wall-clock time spent in the call() function.
+    The resulting utilization is available through the utilization(), callTime() and busyTime()
+    functions, and can be logged for a section of code by passing the Parallel instance to a
+    TimeLogger. */
 class Parallel
 {
     friend class ParallelFactory;
@@ -90,6 +104,21 @@ public:
         over the parallel threads in an unpredicable manner. */
     template<class T> void call(T* targetObject, void (T::*targetMember)(size_t index), size_t limit);
 
+    /** Returns the utilization of the parallel threads during the most recent invocation of the
+        call() function, i.e. the time spent by all threads executing the loop body divided by the
+        product of the wall-clock time spent in the call() function and the number of threads. A
+        value close to one indicates that the work was well balanced over the threads. Before the
+        first invocation of the call() function, the returned value is one. */
+    double utilization() const;
+
+    /** Returns the cumulative wall-clock time, in nanoseconds, spent in the call() function since
+        this instance was constructed. */
+    qint64 callTime() const;
+
+    /** Returns the cumulative time, in nanoseconds, spent by all threads executing the loop body
+        (including the overhead of obtaining the next index) since this instance was constructed. */
+    qint64 busyTime() const;
+
 private:
     /** The function that gets executed inside each of the parallel threads. */
     void run();
@@ -167,7 +196,12 @@ private:
                                 // or zero if no exception was thrown
 
     // data member shared by all threads; changes are atomic (no need for protection)
-    std::atomic<size_t> _next;  // the current index of the for loop being implemented
+    std::atomic<size_t> _next;  // the first index of the for loop not yet claimed by a thread
+
+    // data members for the utilization statistics
+    std::atomic<qint64> _busyTime;  // the cumulative time spent by all threads doing work, in ns (changes are atomic)
+    qint64 _callTime;           // the cumulative wall-clock time spent in call(), in ns
+    double _utilization;        // the utilization of the threads during the most recent call()
 };
 
 ////////////////////////////////////////////////////////////////////
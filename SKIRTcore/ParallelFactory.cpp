@@ -3,17 +3,35 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include <atomic>
 #include "FatalError.hpp"
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
 
 ////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    // the serial number to be handed out to the next factory object; zero is never used
+    // so that it can serve as an "invalid" value in the per-thread cache
+    std::atomic<quint64> nextSerial(1);
+}
+
+////////////////////////////////////////////////////////////////////
+
+thread_local quint64 ParallelFactory::_cachedSerial = 0;
+thread_local int ParallelFactory::_cachedIndex = 0;
+
+////////////////////////////////////////////////////////////////////
+
 ParallelFactory::ParallelFactory()
 {
     // initialize default maximum number of threads
     _maxThreadCount = defaultThreadCount();
 
+    // obtain a unique serial number for validating the per-thread index cache
+    _serial = nextSerial++;
+
     // remember the current thread, and provide it with an index
     _parentThread = QThread::currentThread();
     addThreadIndex(_parentThread, 0);
@@ -69,10 +87,14 @@ Parallel* ParallelFactory::parallel(int maxThreadCount)
 
 ////////////////////////////////////////////////////////////////////
 
-int ParallelFactory::currentThreadIndex() const
+int ParallelFactory::lookupThreadIndex() const
 {
     int index = _indices.value(QThread::currentThread(), -1);
     if (index<0) throw FATALERROR("Current thread index was not found");
+
+    // remember the result for subsequent invocations from this thread
+    _cachedSerial = _serial;
+    _cachedIndex = index;
     return index;
 }
 
@@ -66,10 +66,22 @@ public:
         from within a loop body being iterated by one of the factory's Parallel children, the
         function returns an index from zero to the number of threads in the Parallel instance minus
         one. When invoked from a thread that does not belong to any of the factory's children, the
-        function throws a fatal error. */
+        function throws a fatal error.
+
+        This function is called for every random number generated during a simulation, so it must
+        be fast. The index found for the calling thread is cached in thread-local storage together
+        with an identifier for this factory, so that only the first invocation from a given thread
+        performs the actual dictionary lookup (see lookupThreadIndex()). Subsequent invocations
+        from the same thread for the same factory simply return the cached value. */
     int currentThreadIndex() const;
 
 private:
+    /** Looks up the index for the calling thread in the dictionary maintained by this factory and
+        stores the result in the thread-local cache used by currentThreadIndex(). If the calling
+        thread does not belong to any of the factory's children, the function throws a fatal
+        error. */
+    int lookupThreadIndex() const;
+
     /** Adds a dictionary item linking the specified thread to a particular index. This is a
         private function used from the Parallel() constructor to provide the information required
         by the currentThreadIndex() function. */
@@ -82,6 +94,23 @@ private:
     const QThread* _parentThread;       // the thread that invoked our constructor
     QHash<int, Parallel*> _children;    // our children, keyed on number of threads
     QHash<const QThread*,int> _indices; // the index for each thread, including parent, for all our children
+    quint64 _serial;                    // a number uniquely identifying this factory in the current process
+
+    // the per-thread cache used by currentThreadIndex(); the cached index is valid only if the cached
+    // serial number matches the serial number of the factory being queried
+    static thread_local quint64 _cachedSerial;
+    static thread_local int _cachedIndex;
 };
 
+////////////////////////////////////////////////////////////////////
+
+// inline implementation of the fast path; the slow path is handled by lookupThreadIndex()
+inline int ParallelFactory::currentThreadIndex() const
+{
+    if (_cachedSerial == _serial) return _cachedIndex;
+    return lookupThreadIndex();
+}
+
+////////////////////////////////////////////////////////////////////
+
 #endif // PARALLELFACTORY_HPP
@@ -3,6 +3,7 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include <algorithm>
 #include <cfloat>
 #include "BinTreeNode.hpp"
 #include "DustDistribution.hpp"
@@ -13,6 +14,9 @@
 #include "FatalError.hpp"
 #include "Log.hpp"
 #include "OctTreeNode.hpp"
+#include "Parallel.hpp"
+#include "ParallelFactory.hpp"
+#include "ParallelTarget.hpp"
 #include "ParticleTreeDustGridStructure.hpp"
 #include "Random.hpp"
 
@@ -37,37 +41,49 @@ ParticleTreeDustGridStructure::~ParticleTreeDustGridStructure()
 
 namespace
 {
-    // private function to add a particle to a node, performing recursive subdivision if needed;
-    // returns the level of the leaf node to which the particle was finally added,
-    // or -1 if the particle is outside the node
-    int addParticleToNode(int newparticle, TreeNode* parent,
-                          DustParticleInterface* dpi, vector<int>& particlev, vector<TreeNode*>& tree)
-    {
-        // find the leaf node that contains this particle
-        TreeNode* node = const_cast<TreeNode*>(parent->whichnode(dpi->particleCenter(newparticle)));
-        if (!node) return -1;
-        int id = node->id();
+    // the maximum number of children for any of the supported node types
+    const int MAXCHILDREN = 8;
 
-        // if the leaf node is still empty, just add the particle to it
-        if (particlev[id]<0)
+    // helper class to subdivide the nodes of a single tree level in parallel; a node is subdivided
+    // if it contains more than one particle, and its particles are then distributed over its children
+    class LevelSubdivider : public ParallelTarget
+    {
+    private:
+        // data members initialized in constructor
+        const vector<TreeNode*>& _tree;                 // the tree vector
+        size_t _levelbegin;                             // index in the tree vector of the first node in the level
+        DustParticleInterface* _dpi;                    // the particle locations
+        const vector< vector<int> >& _particlevv;       // the particles in each node, indexed on node in the level
+        vector< vector<int> >& _childparticlevv;        // the particles in each child, indexed on node and child
+
+    public:
+        // constructor
+        LevelSubdivider(const vector<TreeNode*>& tree, size_t levelbegin, DustParticleInterface* dpi,
+                        const vector< vector<int> >& particlevv, vector< vector<int> >& childparticlevv)
+            : _tree(tree), _levelbegin(levelbegin), _dpi(dpi),
+              _particlevv(particlevv), _childparticlevv(childparticlevv)
         {
-            particlev[id] = newparticle;
-            return node->level();
+            _childparticlevv.clear();
+            _childparticlevv.resize(MAXCHILDREN*particlevv.size());
         }
 
-        // if the leaf node already contains a particle, subdivide the node,
-        // and add both the old and new particles to the appropriate child
-        node->createchildren(tree.size());
-        const vector<TreeNode*>& children = node->children();
-        int n = children.size();
-        for (int i = 0; i<n; i++)
+        // subdivide the node with the specified index in the level (the children receive a temporary identifier)
+        void body(size_t index)
         {
-            tree.push_back(children[i]);
-            particlev.push_back(-1);
+            const vector<int>& particlev = _particlevv[index];
+            if (particlev.size() < 2) return;
+
+            TreeNode* node = _tree[_levelbegin+index];
+            node->createchildren(0);
+            const vector<TreeNode*>& children = node->children();
+            for (unsigned int i=0; i<particlev.size(); i++)
+            {
+                TreeNode* child = node->child(_dpi->particleCenter(particlev[i]));
+                int c = std::find(children.begin(), children.end(), child) - children.begin();
+                _childparticlevv[MAXCHILDREN*index+c].push_back(particlev[i]);
+            }
         }
-        addParticleToNode(particlev[id], node, dpi, particlev, tree);
-        return addParticleToNode(newparticle, node, dpi, particlev, tree);
-    }
+    };
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -86,11 +102,6 @@ void ParticleTreeDustGridStructure::setupSelfBefore()
     int numParticles = dpi->numParticles();
     log->info("Constructing tree for " + QString::number(numParticles) + " particles...");
 
-    // Create a list, used only during construction, that contains the index of the particle
-    // contained in each leaf node so far created, or -1 if the node is empty
-    // (the value is undefined for nonleaf nodes)
-    vector<int> particlev;
-
     // Create the root node (which at this point is an empty leaf) using the requested type
     switch (_treeType)
     {
@@ -102,17 +113,43 @@ void ParticleTreeDustGridStructure::setupSelfBefore()
         _tree.push_back(new BinTreeNode(0,0,extent()));
         break;
     }
-    particlev.push_back(-1);
-    int maxlevel = 0;
 
-    // Add particles one by one, subdividing if the leaf node containing the new particle
-    // already contains another particle
+    // Create a list, used only during construction, that contains the indices of the particles
+    // contained in each node of the level being subdivided; initially, this is just the root node
+    vector< vector<int> > particlevv(1);
     for (int i=0; i<numParticles; i++)
+        if (root()->contains(dpi->particleCenter(i))) particlevv[0].push_back(i);
+
+    // Subdivide the tree level by level until each leaf node contains at most one particle;
+    // the nodes of a level are subdivided in parallel, and the new children are then numbered
+    // and added to the tree in the order of their fathers
+    Parallel* parallel = find<ParallelFactory>()->parallel();
+    vector< vector<int> > childparticlevv;
+    size_t levelbegin = 0;
+    int maxlevel = 0;
+    while (levelbegin < _tree.size())
     {
-        if (i%50000 == 0) log->info("Adding particle number " + QString::number(i) +
-                                    " (" + QString::number(i*100/numParticles) + "%)...");
-        int level = addParticleToNode(i, root(), dpi, particlev, _tree);
-        maxlevel = max(maxlevel, level);
+        size_t levelend = _tree.size();
+        maxlevel = _tree[levelbegin]->level();
+        log->info("Subdividing level " + QString::number(maxlevel) +
+                  " (" + QString::number(levelend-levelbegin) + " nodes)...");
+        LevelSubdivider subdivider(_tree, levelbegin, dpi, particlevv, childparticlevv);
+        parallel->call(&subdivider, levelend-levelbegin);
+
+        vector< vector<int> > nextparticlevv;
+        for (size_t l=levelbegin; l<levelend; l++)
+        {
+            const vector<TreeNode*>& children = _tree[l]->children();
+            for (unsigned int c=0; c<children.size(); c++)
+            {
+                children[c]->setid(_tree.size());
+                _tree.push_back(children[c]);
+                nextparticlevv.push_back(vector<int>());
+                nextparticlevv.back().swap(childparticlevv[MAXCHILDREN*(l-levelbegin)+c]);
+            }
+        }
+        particlevv.swap(nextparticlevv);
+        levelbegin = levelend;
     }
 
     // Perform additional subdivisions as requested
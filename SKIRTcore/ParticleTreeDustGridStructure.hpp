@@ -69,7 +69,10 @@ protected:
     /** This function verifies that all attribute values have been appropriately set and actually
         constructs the tree. The particle locations are retrieved from the dust distribution
         through the DustParticleInterface interface, and the tree nodes are subdivided (using
-        regular subdivision) until each leaf cell contains at most one particle. If requested,
+        regular subdivision) until each leaf cell contains at most one particle. The tree is
+        constructed level by level; the nodes of each level are subdivided in parallel, and the
+        new nodes are numbered in breadth-first order so that the result does not depend on the
+        number of threads. If requested,
         each leaf node is further subdivided by a fixed number of levels. When this task is
         accomplished, the function creates a vector that contains the node IDs of all leaves. This
         is the actual dust cell vector (only the leaf nodes are the actual dust cells). The
@@ -8,7 +8,6 @@
 #include "FatalError.hpp"
 #include "FilePaths.hpp"
 #include "FITSInOut.hpp"
-#include "LockFree.hpp"
 #include "Log.hpp"
 #include "PhotonPackage.hpp"
 #include "Units.hpp"
@@ -94,8 +93,7 @@ void PerspectiveInstrument::setupSelfBefore()
     _transform.translate(_Nx/2., _Ny/2., 0);
 
     // the data cube
-    int Nlambda = find<WavelengthGrid>()->Nlambda();
-    _ftotv.resize(Nlambda*_Nx*_Ny);
+    _ftotk = setupRecordCube(_ftotv, _Nx*_Ny);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -328,8 +326,8 @@ void PerspectiveInstrument::detect(PhotonPackage* pp)
 
         // add the adjusted luminosity to the appropriate pixel in the data cube
         int ell = pp->ell();
-        int m = i + _Nx*j + _Nx*_Ny*ell;
-        LockFree::add(_ftotv[m], L);
+        int m = i + _Nx*j + _Nx*_Ny*cubePlane(ell);
+        record(_ftotk, m, L);
     }
 }
 
@@ -215,6 +215,7 @@ private:
 
     // data cube
     Array _ftotv;
+    int _ftotk;             // record index of the data cube
 };
 
 ////////////////////////////////////////////////////////////////////
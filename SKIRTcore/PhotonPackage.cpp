@@ -11,7 +11,7 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////
 
 PhotonPackage::PhotonPackage()
-    : _L(0), _ell(0), _nscatt(0), _stellar(-1), _ad(0)
+    : _L(0), _ell(0), _nscatt(0), _stellar(-1), _ad(0), _taucache(-1)
 {
 }
 
@@ -26,6 +26,7 @@ void PhotonPackage::launch(double L, int ell, Position bfr, Direction bfk)
     _nscatt = 0;
     _stellar = -1;
     _ad = 0;
+    _taucache = -1;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -39,6 +40,7 @@ void PhotonPackage::launchEmissionPeelOff(const PhotonPackage* pp, Direction bfk
     _nscatt = 0;
     _stellar = pp->_stellar;
     _ad = 0;
+    _taucache = -1;
 
     // apply emission direction bias if not isotropic
     if (pp->_ad) _L *= pp->_ad->probabilityForDirection(_bfr, _bfk);
@@ -55,6 +57,7 @@ void PhotonPackage::launchScatteringPeelOff(const PhotonPackage* pp, Direction b
     _nscatt = pp->_nscatt + 1;
     _stellar = pp->_stellar;
     _ad = 0;
+    _taucache = -1;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -68,6 +71,7 @@ void PhotonPackage::launchScatteringPeelOff(const PhotonPackage* pp, Position bf
     _nscatt = pp->_nscatt + 1;
     _stellar = pp->_stellar;
     _ad = 0;
+    _taucache = -1;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -89,6 +93,7 @@ void PhotonPackage::setAngularDistribution(const AngularDistribution* ad)
 void PhotonPackage::propagate(double s)
 {
     _bfr += s*_bfk;
+    _taucache = -1;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -98,6 +103,7 @@ void PhotonPackage::scatter(Direction bfk)
     _nscatt++;
     _bfk = bfk;
     _ad = 0;
+    _taucache = -1;
 }
 
 ////////////////////////////////////////////////////////////////////
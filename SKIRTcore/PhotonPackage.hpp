@@ -95,6 +95,21 @@ public:
     /** This function sets the luminosity of the photon package to a new value. */
     void setLuminosity(double L);
 
+    // ------- Caching the optical depth for peel off photon packages -------
+
+    /** This function stores the optical depth along the complete path of the photon package, so
+        that it can be reused by all instruments that receive the same peel off photon package. The
+        cached value is invalidated by any of the functions that invalidate the current path. */
+    void setCachedOpticalDepth(double tau) { _taucache = tau; }
+
+    /** This function returns true if an optical depth has been cached for the current path through
+        setCachedOpticalDepth(), and false otherwise. */
+    bool hasCachedOpticalDepth() const { return _taucache >= 0; }
+
+    /** This function returns the optical depth cached for the current path through
+        setCachedOpticalDepth(). */
+    double cachedOpticalDepth() const { return _taucache; }
+
     // ------- Getting trivial properties -------
 
     /** This function returns true if the photon package has a stellar origin, false otherwise. */
@@ -131,6 +146,7 @@ private:
     int _nscatt;
     int _stellar;
     const AngularDistribution* _ad;
+    double _taucache;   // the cached optical depth along the complete path, or -1 if there is none
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -0,0 +1,114 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#include "Array.hpp"
+#include "ProcessCommunicator.hpp"
+
+////////////////////////////////////////////////////////////////////
+
+ProcessCommunicator::ProcessCommunicator()
+    : _dataParallel(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////
+
+void ProcessCommunicator::setDataParallel(bool value)
+{
+    _dataParallel = value;
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool ProcessCommunicator::dataParallel() const
+{
+    return _dataParallel && isMultiProc();
+}
+
+////////////////////////////////////////////////////////////////////
+
+int ProcessCommunicator::size() const
+{
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int ProcessCommunicator::rank() const
+{
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool ProcessCommunicator::isRoot() const
+{
+    return rank() == 0;
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool ProcessCommunicator::isMultiProc() const
+{
+    return size() > 1;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int ProcessCommunicator::owner(int index) const
+{
+    return dataParallel() ? index % size() : rank();
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool ProcessCommunicator::isLocal(int index) const
+{
+    return owner(index) == rank();
+}
+
+////////////////////////////////////////////////////////////////////
+
+int ProcessCommunicator::localIndex(int index) const
+{
+    return dataParallel() ? index / size() : index;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int ProcessCommunicator::globalIndex(int localIndex) const
+{
+    return dataParallel() ? localIndex*size() + rank() : localIndex;
+}
+
+////////////////////////////////////////////////////////////////////
+
+int ProcessCommunicator::localCount(int count) const
+{
+    return dataParallel() ? (count - rank() + size() - 1) / size() : count;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void ProcessCommunicator::sum(double* data, size_t count)
+{
+    Q_UNUSED(data) Q_UNUSED(count)
+}
+
+////////////////////////////////////////////////////////////////////
+
+void ProcessCommunicator::broadcast(double* data, size_t count, int sender)
+{
+    Q_UNUSED(data) Q_UNUSED(count) Q_UNUSED(sender)
+}
+
+////////////////////////////////////////////////////////////////////
+
+void ProcessCommunicator::sum(Array& data)
+{
+    if (data.size()) sum(&data[0], data.size());
+}
+
+////////////////////////////////////////////////////////////////////
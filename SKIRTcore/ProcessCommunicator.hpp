@@ -0,0 +1,117 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef PROCESSCOMMUNICATOR_HPP
+#define PROCESSCOMMUNICATOR_HPP
+
+#include "SimulationItem.hpp"
+class Array;
+
+////////////////////////////////////////////////////////////////////
+
+/** A ProcessCommunicator object represents the group of processes cooperating on a single
+    simulation, and offers the collective operations needed to combine their results. The
+    photon shooting phases of a Monte Carlo simulation are divided over the processes in the
+    group, each process handling a subset of the chunks of photon packages. At the end of each
+    phase, the partial results (such as the absorbed luminosities in the dust system) are summed
+    over all processes, so that each process holds the complete results before continuing.
+
+    Alternatively, the communicator can be configured in data-parallel mode (see
+    setDataParallel()). In this mode, the wavelengths of the simulation are distributed over the
+    processes rather than the chunks, and each process stores only those parts of the per-wavelength
+    data structures that correspond to its own wavelengths. Wavelength indices are assigned to the
+    processes in a cyclic fashion, so that the cost of expensive wavelengths is spread evenly. The
+    owner(), isLocal(), localIndex() and localCount() functions implement this assignment; they are
+    formulated in terms of generic item indices. When the communicator is not in data-parallel
+    mode, the calling process owns all items.
+
+    This base class represents a group consisting of a single process, so that all collective
+    operations are trivial. It is used by default so that the simulation code does not need to
+    distinguish between single-process and multi-process runs. A subclass may implement actual
+    communication between multiple processes, for example using MPI. Because the MPI-related
+    code is concentrated in a separate library, the subclass is provided by that library and
+    installed by the application through the Simulation::setCommunicator() function.
+
+    The collective operations must be invoked by all processes in the group, in the same order,
+    and always from the thread that started the simulation. */
+class ProcessCommunicator : public SimulationItem
+{
+    Q_OBJECT
+
+    //============= Construction - Setup - Destruction =============
+
+public:
+    /** Constructs a communicator representing a group consisting of a single process. */
+    ProcessCommunicator();
+
+    /** Sets the flag that indicates whether the communicator operates in data-parallel mode. The
+        flag has no effect if the group contains just a single process. */
+    void setDataParallel(bool value);
+
+    /** Returns true if the communicator operates in data-parallel mode, i.e. if the data-parallel
+        flag has been set and the group contains more than a single process. */
+    bool dataParallel() const;
+
+    //====================== Other Functions =======================
+
+public:
+    /** Returns the number of processes in the group. The implementation in this base class always
+        returns one. */
+    virtual int size() const;
+
+    /** Returns the rank of the calling process in the group, ranging from zero to size()-1. The
+        implementation in this base class always returns zero. */
+    virtual int rank() const;
+
+    /** Returns true if the calling process is the root process of the group, i.e. if it has rank
+        zero. The root process is responsible for writing the simulation results. */
+    bool isRoot() const;
+
+    /** Returns true if the group contains more than a single process. */
+    bool isMultiProc() const;
+
+    /** Returns the rank of the process that owns the item with the specified index. In
+        data-parallel mode, items are assigned cyclically, i.e. the owner is the index modulo the
+        number of processes. Otherwise the calling process owns all items. */
+    int owner(int index) const;
+
+    /** Returns true if the calling process owns the item with the specified index. */
+    bool isLocal(int index) const;
+
+    /** Returns the index of the specified item within the list of items owned by the calling
+        process. The item must be owned by the calling process. */
+    int localIndex(int index) const;
+
+    /** Returns the index in the complete list of items corresponding to the specified index within
+        the list of items owned by the calling process. This is the inverse of localIndex(). */
+    int globalIndex(int localIndex) const;
+
+    /** Returns the number of items owned by the calling process, given the total number of items.
+        */
+    int localCount(int count) const;
+
+    /** Replaces each of the \em count values starting at the specified address by the sum of the
+        corresponding values over all processes in the group. The implementation in this base
+        class does nothing. */
+    virtual void sum(double* data, size_t count);
+
+    /** Copies the \em count values starting at the specified address in the process with the
+        specified rank to the corresponding memory locations in all other processes of the group.
+        The implementation in this base class does nothing. */
+    virtual void broadcast(double* data, size_t count, int sender);
+
+    /** Replaces each of the values in the specified array by the sum of the corresponding values
+        over all processes in the group. This function simply calls the general sum() function. */
+    void sum(Array& data);
+
+    //======================== Data Members ========================
+
+private:
+    bool _dataParallel;
+};
+
+////////////////////////////////////////////////////////////////////
+
+#endif // PROCESSCOMMUNICATOR_HPP
@@ -5,11 +5,13 @@
 
 #include <cmath>
 #include "Box.hpp"
+#include "Checkpoint.hpp"
 #include "FatalError.hpp"
 #include "Log.hpp"
 #include "NR.hpp"
 #include "ParallelFactory.hpp"
 #include "Position.hpp"
+#include "ProcessCommunicator.hpp"
 #include "Random.hpp"
 
 using namespace std;
@@ -17,7 +19,7 @@ using namespace std;
 //////////////////////////////////////////////////////////////////////
 
 Random::Random()
-    : _seed(4357), _parfac(0)
+    : _seed(4357), _generator(MersenneTwister), _parfac(0)
 {
 }
 
@@ -29,6 +31,21 @@ void Random::setupSelfBefore()
 
     _parfac = find<ParallelFactory>();
     int Nthreads = _parfac->maxThreadCount();
+
+    // for the Philox generator, key the initial stream of each thread on the thread index
+    _philoxv.resize(Nthreads);
+    for (int thread=0; thread<Nthreads; thread++)
+    {
+        _philoxv[thread].own.init(_seed, 0, thread);
+        _philoxv[thread].inChunk = false;
+    }
+    if (_generator == Philox)
+    {
+        find<Log>()->info("Initializing Philox random number generator for " + QString::number(Nthreads)
+                          + " thread(s) with seed " + QString::number(_seed) + "... ");
+        return;
+    }
+
     _mtv.resize(Nthreads);
     _mtiv.resize(Nthreads);
     unsigned long seed = _seed;
@@ -36,18 +53,25 @@ void Random::setupSelfBefore()
     {
         find<Log>()->info("Initializing random number generator for thread number "
                           + QString::number(thread) + " with seed " + QString::number(seed) + "... ");
-        vector<unsigned long>& mt = _mtv[thread];
-        int& mti = _mtiv[thread];
-        mt.resize(624);
-        mt[0] = seed & 0xffffffff;
-        for (mti=1; mti<624; mti++)
-            mt[mti] = (69069 * mt[mti-1]) & 0xffffffff;
+        seedMT(thread, seed);
         ++seed;
     }
 }
 
 //////////////////////////////////////////////////////////////////////
 
+void Random::seedMT(int thread, unsigned long seed)
+{
+    vector<unsigned long>& mt = _mtv[thread];
+    int& mti = _mtiv[thread];
+    mt.resize(624);
+    mt[0] = seed & 0xffffffff;
+    for (mti=1; mti<624; mti++)
+        mt[mti] = (69069 * mt[mti-1]) & 0xffffffff;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void Random::setSeed(int seed)
 {
     _seed = seed;
@@ -62,10 +86,114 @@ int Random::seed() const
 
 //////////////////////////////////////////////////////////////////////
 
+void Random::setGenerator(Random::Generator value)
+{
+    _generator = value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Random::Generator Random::generator() const
+{
+    return _generator;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Random::startChunk(quint64 phase, quint64 chunk)
+{
+    if (_generator == Philox)
+    {
+        // key value zero is reserved for the threads' own streams
+        ThreadStreams& streams = _philoxv[_parfac->currentThreadIndex()];
+        streams.chunk.init(_seed, phase+1, chunk);
+        streams.inChunk = true;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Random::randomize()
+{
+    int rank = find<ProcessCommunicator>()->rank();
+    if (rank == 0) return;
+
+    int Nthreads = _philoxv.size();
+    unsigned long seed = _seed + rank*Nthreads;
+    find<Log>()->info("Reseeding random number generators with seed " + QString::number(seed)
+                      + " for process " + QString::number(rank));
+    for (int thread=0; thread<Nthreads; thread++)
+    {
+        _philoxv[thread].own.init(_seed, 0, rank*Nthreads + thread);
+        if (_generator == MersenneTwister) seedMT(thread, seed + thread);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Random::endChunk()
+{
+    _philoxv[_parfac->currentThreadIndex()].inChunk = false;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Random::writeCheckpoint(Checkpoint& checkpoint) const
+{
+    if (_generator == Philox) return;
+
+    checkpoint.write(static_cast<quint64>(_mtv.size()));
+    for (unsigned int thread=0; thread<_mtv.size(); thread++)
+    {
+        checkpoint.write(static_cast<quint64>(_mtiv[thread]));
+        foreach (unsigned long value, _mtv[thread]) checkpoint.write(static_cast<quint64>(value));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Random::readCheckpoint(Checkpoint& checkpoint)
+{
+    if (_generator == Philox) return;
+
+    size_t Nthreads = checkpoint.readInt();
+    bool restore = Nthreads == _mtv.size();
+    for (size_t thread=0; thread<Nthreads; thread++)
+    {
+        int mti = checkpoint.readInt();
+        if (restore) _mtiv[thread] = mti;
+        for (unsigned int i=0; i<_mtv[0].size(); i++)
+        {
+            unsigned long value = checkpoint.readInt();
+            if (restore) _mtv[thread][i] = value;
+        }
+    }
+    if (!restore)
+        find<Log>()->warning("Random generator state not restored because the number of threads differs");
+}
+
+//////////////////////////////////////////////////////////////////////
+
 double
 Random::uniform()
 {
     int thread = _parfac->currentThreadIndex();
+    ThreadStreams& streams = _philoxv[thread];
+    if (streams.inChunk) return streams.chunk.uniform();
+    if (_generator == Philox) return streams.own.uniform();
+    return uniformMT(thread);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+double
+Random::uniformMT(int thread)
+{
     vector<unsigned long>& mt = _mtv[thread];
     int& mti = _mtiv[thread];
     double ans = 0.0;
@@ -103,6 +231,58 @@ Random::uniform()
 
 //////////////////////////////////////////////////////////////////////
 
+void
+Random::PhiloxState::init(quint32 seed, quint64 phase, quint64 chunk)
+{
+    key[0] = seed;
+    key[1] = static_cast<quint32>(phase);
+    ctr[0] = 0;
+    ctr[1] = 0;
+    ctr[2] = static_cast<quint32>(chunk);
+    ctr[3] = static_cast<quint32>(chunk >> 32);
+    next = 2;  // force a new invocation for the first deviate
+}
+
+//////////////////////////////////////////////////////////////////////
+
+double
+Random::PhiloxState::uniform()
+{
+    if (next >= 2)
+    {
+        // perform the ten rounds of the Philox4x32 bijection on a copy of the counter and key
+        quint32 c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+        quint32 k0 = key[0], k1 = key[1];
+        for (int round=0; round<10; round++)
+        {
+            quint64 p0 = static_cast<quint64>(0xD2511F53) * c0;
+            quint64 p1 = static_cast<quint64>(0xCD9E8D57) * c2;
+            quint32 hi0 = p0 >> 32, lo0 = static_cast<quint32>(p0);
+            quint32 hi1 = p1 >> 32, lo1 = static_cast<quint32>(p1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+
+        // convert each 64-bit half of the result to a deviate in the open interval (0,1)
+        quint64 u0 = (static_cast<quint64>(c0) << 32) | c1;
+        quint64 u1 = (static_cast<quint64>(c2) << 32) | c3;
+        const double scale = 1.0 / 9007199254740992.0;  // 2^-53
+        buf[0] = ((u0 >> 11) + 0.5) * scale;
+        buf[1] = ((u1 >> 11) + 0.5) * scale;
+        next = 0;
+
+        // increment the 64-bit draw counter
+        if (++ctr[0] == 0) ++ctr[1];
+    }
+    return buf[next++];
+}
+
+//////////////////////////////////////////////////////////////////////
+
 double
 Random::cdf(const Array& xv, const Array& Xv)
 {
@@ -10,6 +10,7 @@
 #include "Array.hpp"
 #include "SimulationItem.hpp"
 class Box;
+class Checkpoint;
 class Direction;
 class ParallelFactory;
 class Position;
@@ -18,9 +19,21 @@ class Position;
 
 /** This class contains a random number generator, and can be used to produce series of random
     numbers for different probability distributions. Typically, only a single instance of the class
-    should be constructed for each simulation. This random number class is adapted from a C library
-    known as genrand(), written by Takuji Nishimura. More information can be found at
-    http://www.math.keio.ac.jp/matumoto/emt.html. */
+    should be constructed for each simulation. There is a choice between two generator algorithms.
+
+    The default Mersenne twister generator is adapted from a C library known as genrand(), written
+    by Takuji Nishimura. More information can be found at
+    http://www.math.keio.ac.jp/matumoto/emt.html. A separate generator is maintained for each
+    parallel execution thread, seeded with consecutive seed values. As a result, the random
+    sequence consumed by a particular photon package depends on the number of threads and on the
+    order in which the threads happen to pick up work.
+
+    The alternative Philox generator is the counter-based Philox4x32-10 generator described by
+    Salmon et al. (2011, Proceedings of SC11). Each random number is obtained by applying a keyed
+    bijection to a counter, so that a stream can be positioned instantaneously by setting its key
+    and counter. The startChunk() function uses this property to key the stream of the calling
+    thread on the photon shooting phase and the chunk index, so that the random numbers consumed
+    by a chunk are independent of the number of threads and of the thread that processes it. */
 class Random : public SimulationItem
 {
     Q_OBJECT
@@ -31,6 +44,12 @@ class Random : public SimulationItem
     Q_CLASSINFO("MinValue", "1")
     Q_CLASSINFO("Default", "4357")
 
+    Q_CLASSINFO("Property", "generator")
+    Q_CLASSINFO("Title", "the random number generator algorithm")
+    Q_CLASSINFO("MersenneTwister", "Mersenne twister (sequence depends on the number of threads)")
+    Q_CLASSINFO("Philox", "Philox counter-based generator (reproducible streams for each chunk)")
+    Q_CLASSINFO("Default", "MersenneTwister")
+
     //============= Construction - Setup - Destruction =============
 
 public:
@@ -39,7 +58,9 @@ public:
 
 protected:
     /** This function initializes the data structure that is used for the calculation of the random
-        numbers, using the current value of the seed. */
+        numbers, using the current value of the seed. For the Philox generator, the stream for each
+        thread is initially keyed on the thread index, so that random numbers drawn outside of a
+        chunk (e.g. during setup) are still independent between threads. */
     void setupSelfBefore();
 
     //======== Setters & Getters for Discoverable Attributes =======
@@ -52,12 +73,74 @@ public:
     /** This function returns the current value of the seed. */
     Q_INVOKABLE int seed() const;
 
+    /** The enumeration type indicating the random number generator algorithm. */
+    Q_ENUMS(Generator)
+    enum Generator { MersenneTwister, Philox };
+
+    /** Sets the enumeration value indicating the random number generator algorithm. The default
+        value is MersenneTwister. */
+    Q_INVOKABLE void setGenerator(Generator value);
+
+    /** Returns the enumeration value indicating the random number generator algorithm. */
+    Q_INVOKABLE Generator generator() const;
+
     //======================== Other Functions =======================
 
 public:
+    /** The phase identifiers reserved for the parallel loops during setup, to be passed to
+        startChunk(). The photon shooting phases are numbered consecutively starting from one, so
+        that they never reach these values. */
+    enum SetupPhase { DensitySamplingPhase = 0x40000000, TreeConstructionPhase };
+
+    /** This function positions the random number stream of the calling thread at the start of the
+        stream reserved for the chunk with index \em chunk in the phase with identifier \em phase.
+        The subsequent random numbers drawn by the calling thread depend only on the seed and on
+        these two values. The photon shooting phases are numbered starting from one; parallel loops
+        during setup use one of the identifiers listed in the SetupPhase enumeration. The function
+        should be called by a parallel loop body at the start of each chunk.
+
+        For the Mersenne twister generator, the function does nothing, so that the calling thread
+        keeps drawing from its own Mersenne twister sequence, both during setup and during photon
+        shooting. The random numbers consumed by a parallel setup loop (such as the density sampling
+        in the cells of a dust grid) and by the photon packages thus depend on the number of
+        threads and on the thread scheduling. */
+    void startChunk(quint64 phase, quint64 chunk);
+
+    /** This function gives the random number generators of the calling process a state that
+        differs from the generators in the other processes cooperating in the simulation (see
+        ProcessCommunicator). It must be called after setup is complete, so that any random
+        numbers drawn during setup (e.g. to construct a dust grid) are identical in all processes,
+        and before photon shooting starts, so that the photon packages launched by different
+        processes are independent. In the root process, or if there is only a single process, the
+        function does nothing. In the other processes, the Mersenne twister generator for each
+        thread is reseeded with the value \f$s + r\,N_\text{threads} + t\f$, where \f$s\f$ is the
+        seed, \f$r\f$ is the rank of the process, and \f$t\f$ is the thread index, and the own
+        Philox stream of each thread is keyed in the same way. The chunk streams of the Philox
+        generator need no adjustment, because they are keyed on global chunk indices. */
+    void randomize();
+
+    /** This function returns the calling thread to its own random number stream, i.e. the stream
+        it used before the most recent call to startChunk(). A parallel loop body during setup
+        should call this function at the end of each chunk, so that random numbers drawn after the
+        loop do not depend on the chunk that happened to be processed last by a given thread. */
+    void endChunk();
+
+    /** This function writes the state of the Mersenne twister generators for all threads to the
+        specified checkpoint. Nothing is written for the Philox generator, since its streams are
+        fully determined by the seed, the phase and the chunk index (see startChunk()). */
+    void writeCheckpoint(Checkpoint& checkpoint) const;
+
+    /** This function restores the state written by writeCheckpoint() from the specified
+        checkpoint. If the number of threads differs from the number at the time the checkpoint
+        was written, the stored state is skipped and the generators simply continue from their
+        current state. */
+    void readCheckpoint(Checkpoint& checkpoint);
+
     /** This function generates a random uniform deviate, i.e. a random double precision number in
-        the interval [0,1]. For details how this is exactly done, see the information at
-        http://www.math.keio.ac.jp/matumoto/emt.html. */
+        the interval [0,1]. For details how this is exactly done for the Mersenne twister, see the
+        information at http://www.math.keio.ac.jp/matumoto/emt.html. For the Philox generator, each
+        invocation of the Philox4x32-10 bijection yields 128 random bits, which are converted to
+        two deviates with a 53-bit mantissa. */
     double uniform();
 
     /** This function generates a random number drawn from an arbitrary probability distribution
@@ -115,6 +198,45 @@ public:
         cuboid lined up with the coordinate axes). */
     Position position(const Box& box);
 
+private:
+    /** This function initializes the Mersenne twister generator for the specified thread index
+        with the specified seed. */
+    void seedMT(int thread, unsigned long seed);
+
+    /** This function generates a uniform deviate for the Mersenne twister generator with the
+        specified thread index. */
+    double uniformMT(int thread);
+
+    //======================== Nested Classes =======================
+
+private:
+    /** The state of a Philox stream: the key, the counter and the deviates remaining from the most
+        recent invocation of the bijection. */
+    struct PhiloxState
+    {
+        quint32 key[2];     // the key: the seed and the phase identifier
+        quint32 ctr[4];     // the counter: the draw index (low words) and the chunk index (high words)
+        double buf[2];      // the deviates generated by the most recent invocation
+        int next;           // the index in buf of the next deviate to be returned
+
+        /** Sets the key and the counter so that the stream starts at the beginning. */
+        void init(quint32 seed, quint64 phase, quint64 chunk);
+
+        /** Returns the next uniform deviate from the stream. */
+        double uniform();
+    };
+
+    /** The Philox streams used by a single thread. The padding at the end guarantees that the
+        streams of consecutive threads in a vector never share a cache line, regardless of the
+        alignment of the vector's storage, which avoids false sharing between threads. */
+    struct ThreadStreams
+    {
+        PhiloxState own;        // the thread's own stream, used outside of chunks
+        PhiloxState chunk;      // the stream for the chunk being processed by the thread
+        bool inChunk;           // true between startChunk() and endChunk()
+        char padding[64];
+    };
+
     //======================== Data Members ========================
 
 private:
@@ -122,10 +244,14 @@ private:
     // (maintaining a separate generator per thread avoids time-consuming data locking)
     std::vector< std::vector<unsigned long> > _mtv;
     std::vector<int> _mtiv;
+    std::vector<ThreadStreams> _philoxv;
 
     // the seed used to initialize the random generators (the value is incremented between generators)
     int _seed;
 
+    // the generator algorithm
+    Generator _generator;
+
     // a cached pointer to the ParallelFactory instance associated with this simulation hierarchy
     ParallelFactory* _parfac;
 };
@@ -4,7 +4,6 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include "FatalError.hpp"
-#include "LockFree.hpp"
 #include "PhotonPackage.hpp"
 #include "SEDInstrument.hpp"
 #include "WavelengthGrid.hpp"
@@ -25,6 +24,7 @@ void SEDInstrument::setupSelfBefore()
 
     int Nlambda = find<WavelengthGrid>()->Nlambda();
     _Ftotv.resize(Nlambda);
+    _Ftotk = addRecordArray(_Ftotv);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -38,7 +38,7 @@ SEDInstrument::detect(PhotonPackage* pp)
     double extf = exp(-taupath);
     double Lextf = L*extf;
 
-    LockFree::add(_Ftotv[ell], Lextf);
+    record(_Ftotk, ell, Lextf);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -43,6 +43,7 @@ protected:
 
 private:
     Array _Ftotv;
+    int _Ftotk;     // record index of _Ftotv
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -42,6 +42,7 @@ HEADERS += \
     AdaptiveMeshGeometry.hpp \
     AdaptiveMeshInterface.hpp \
     AdaptiveMeshNode.hpp \
+    AliasTable.hpp \
     AllCellsDustLib.hpp \
     AngularDistribution.hpp \
     AxDustGridStructure.hpp \
@@ -51,12 +52,14 @@ HEADERS += \
     BaryOctTreeNode.hpp \
     Benchmark1DDustMix.hpp \
     Benchmark2DDustMix.hpp \
+    BinLocator.hpp \
     BinTreeDustGridStructure.hpp \
     BinTreeNode.hpp \
     BlackBodySED.hpp \
     BolLuminosityStellarCompNormalization.hpp \
     BruzualCharlotSED.hpp \
     BruzualCharlotSEDFamily.hpp \
+    Checkpoint.hpp \
     ClumpyGeometry.hpp \
     CompDustDistribution.hpp \
     ConfigurableDustMix.hpp \
@@ -92,6 +95,7 @@ HEADERS += \
     DustSystemDepthCalculator.hpp \
     EdgeOnDustCompNormalization.hpp \
     EinastoGeometry.hpp \
+    EmissivityCache.hpp \
     ExpDiskGeometry.hpp \
     ExtragalacticUnits.hpp \
     FITSInOut.hpp \
@@ -181,6 +185,7 @@ HEADERS += \
     PowCubDustGridStructure.hpp \
     PowSpheDustGridStructure.hpp \
     PowerLawGrainSizeDistribution.hpp \
+    ProcessCommunicator.hpp \
     PseudoSersicGeometry.hpp \
     QuasarSED.hpp \
     RadialDustCompNormalization.hpp \
@@ -218,6 +223,7 @@ HEADERS += \
     TimeLogger.hpp \
     TorusGeometry.hpp \
     TransientDustEmissivity.hpp \
+    TransientHeating.hpp \
     TreeDustGridStructure.hpp \
     TreeNode.hpp \
     TreeNodeBoxDensityCalculator.hpp \
@@ -282,6 +288,7 @@ SOURCES += \
     AdaptiveMeshFile.cpp \
     AdaptiveMeshGeometry.cpp \
     AdaptiveMeshNode.cpp \
+    AliasTable.cpp \
     AllCellsDustLib.cpp \
     AxDustGridStructure.cpp \
     AxGeometry.cpp \
@@ -290,12 +297,14 @@ SOURCES += \
     BaryOctTreeNode.cpp \
     Benchmark1DDustMix.cpp \
     Benchmark2DDustMix.cpp \
+    BinLocator.cpp \
     BinTreeDustGridStructure.cpp \
     BinTreeNode.cpp \
     BlackBodySED.cpp \
     BolLuminosityStellarCompNormalization.cpp \
     BruzualCharlotSED.cpp \
     BruzualCharlotSEDFamily.cpp \
+    Checkpoint.cpp \
     ClumpyGeometry.cpp \
     CompDustDistribution.cpp \
     ConfigurableDustMix.cpp \
@@ -328,6 +337,7 @@ SOURCES += \
     DustSystemDepthCalculator.cpp \
     EdgeOnDustCompNormalization.cpp \
     EinastoGeometry.cpp \
+    EmissivityCache.cpp \
     ExpDiskGeometry.cpp \
     ExtragalacticUnits.cpp \
     FITSInOut.cpp \
@@ -415,6 +425,7 @@ SOURCES += \
     PowCubDustGridStructure.cpp \
     PowSpheDustGridStructure.cpp \
     PowerLawGrainSizeDistribution.cpp \
+    ProcessCommunicator.cpp \
     PseudoSersicGeometry.cpp \
     QuasarSED.cpp \
     RadialDustCompNormalization.cpp \
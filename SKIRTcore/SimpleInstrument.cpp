@@ -4,7 +4,6 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include "FatalError.hpp"
-#include "LockFree.hpp"
 #include "PhotonPackage.hpp"
 #include "SimpleInstrument.hpp"
 #include "WavelengthGrid.hpp"
@@ -24,8 +23,9 @@ void SimpleInstrument::setupSelfBefore()
     SingleFrameInstrument::setupSelfBefore();
 
     int Nlambda = find<WavelengthGrid>()->Nlambda();
-    _ftotv.resize(Nlambda*_Nxp*_Nyp);
+    _ftotk = setupRecordCube(_ftotv, _Nxp*_Nyp);
     _Ftotv.resize(Nlambda);
+    _Ftotk = addRecordArray(_Ftotv);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -35,14 +35,14 @@ SimpleInstrument::detect(PhotonPackage* pp)
 {
     int l = pixelondetector(pp);
     int ell = pp->ell();
-    int m = l + ell*_Nxp*_Nyp;
+    int m = l + cubePlane(ell)*_Nxp*_Nyp;
     double L = pp->luminosity();
     double taupath = opticalDepth(pp);
     double extf = exp(-taupath);
     double Lextf = L*extf;
 
-    LockFree::add(_Ftotv[ell], Lextf);
-    if (l>=0) LockFree::add(_ftotv[m], Lextf);
+    record(_Ftotk, ell, Lextf);
+    if (l>=0) record(_ftotk, m, Lextf);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -64,6 +64,8 @@ protected:
 private:
     Array _ftotv;
     Array _Ftotv;
+    int _ftotk;     // record index of _ftotv
+    int _Ftotk;     // record index of _Ftotv
 };
 
 ////////////////////////////////////////////////////////////////////
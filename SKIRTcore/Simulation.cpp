@@ -7,6 +7,7 @@
 #include "FatalError.hpp"
 #include "FilePaths.hpp"
 #include "ParallelFactory.hpp"
+#include "ProcessCommunicator.hpp"
 #include "Random.hpp"
 #include "Simulation.hpp"
 #include "SIUnits.hpp"
@@ -15,6 +16,7 @@
 ////////////////////////////////////////////////////////////////////
 
 Simulation::Simulation()
+    : _checkpointing(false)
 {
     _paths = new FilePaths();
     _paths->setParent(this);
@@ -22,6 +24,8 @@ Simulation::Simulation()
     _log->setParent(this);
     _parfac = new ParallelFactory();
     _parfac->setParent(this);
+    _comm = new ProcessCommunicator();
+    _comm->setParent(this);
     _random = new Random();
     _random->setParent(this);
     _units = new SIUnits();
@@ -112,6 +116,36 @@ ParallelFactory* Simulation::parallelFactory() const
 
 ////////////////////////////////////////////////////////////////////
 
+void Simulation::setCommunicator(ProcessCommunicator* value)
+{
+    if (_comm) delete _comm;
+    _comm = value;
+    if (_comm) _comm->setParent(this);
+}
+
+////////////////////////////////////////////////////////////////////
+
+ProcessCommunicator* Simulation::communicator() const
+{
+    return _comm;
+}
+
+////////////////////////////////////////////////////////////////////
+
+void Simulation::setCheckpointing(bool value)
+{
+    _checkpointing = value;
+}
+
+////////////////////////////////////////////////////////////////////
+
+bool Simulation::checkpointing() const
+{
+    return _checkpointing;
+}
+
+////////////////////////////////////////////////////////////////////
+
 void Simulation::setRandom(Random* value)
 {
     if (_random) delete _random;
@@ -10,6 +10,7 @@
 class FilePaths;
 class Log;
 class ParallelFactory;
+class ProcessCommunicator;
 class Random;
 class Units;
 
@@ -18,16 +19,17 @@ class Units;
 /** Simulation is the abstract base class for a simulation item that represents a complete
     simulation and sits at the top of a run-time simulation hierarchy (i.e. it has no parent). A
     Simulation instance holds basic attributes including a logging mechanism, a parallel execution
-    instance, a random number generator, and a system of units. The constructor provides useful
-    defaults for all of these attributes. This is an exception to the rule that all attributes in
-    the simulation hierarchy must be explicitly set by the caller before invoking setup(). */
+    instance, a process communicator, a random number generator, and a system of units. The
+    constructor provides useful defaults for all of these attributes. This is an exception to the
+    rule that all attributes in the simulation hierarchy must be explicitly set by the caller
+    before invoking setup(). */
 class Simulation : public SimulationItem
 {
     Q_OBJECT
     Q_CLASSINFO("Title", "the simulation")
 
-    // Note: the filePaths, log and parallel properties are not declared because (in the current implementation)
-    // they are initialized based on command-line options, not from the ski file
+    // Note: the filePaths, log, parallel and communicator properties are not declared because
+    // (in the current implementation) they are initialized based on command-line options, not from the ski file
 
     Q_CLASSINFO("Property", "random")
     Q_CLASSINFO("Title", "the random number generator")
@@ -92,6 +94,22 @@ public:
     /** Returns the logging mechanism for this simulation hierarchy. */
     ParallelFactory* parallelFactory() const;
 
+    /** Sets the process communicator for this simulation hierarchy. By default, an instance of the
+        ProcessCommunicator class is used, representing a single process. */
+    void setCommunicator(ProcessCommunicator* value);
+
+    /** Returns the process communicator for this simulation hierarchy. */
+    ProcessCommunicator* communicator() const;
+
+    /** Sets the flag that indicates whether the simulation saves a checkpoint after each photon
+        shooting phase, and resumes from the most recently saved checkpoint, if there is one, when
+        it is run (see the Checkpoint class). By default, the flag is false. */
+    void setCheckpointing(bool value);
+
+    /** Returns the flag that indicates whether the simulation saves and resumes from checkpoints.
+        */
+    bool checkpointing() const;
+
     /** Sets the random number generator for this simulation hierarchy. By default, an instance of
         the Random class is used with the default seed. */
     Q_INVOKABLE void setRandom(Random* value);
@@ -113,6 +131,8 @@ protected:
     FilePaths* _paths;          // the file paths object for the simulation
     Log* _log;                  // the logging mechanism for the simulation
     ParallelFactory* _parfac;   // the parallel factory for the simulation
+    ProcessCommunicator* _comm; // the process communicator for the simulation
+    bool _checkpointing;        // true if the simulation saves and resumes from checkpoints
     Random* _random;            // the random number generator for the simulation
     Units* _units;              // the units system for the simulation
 };
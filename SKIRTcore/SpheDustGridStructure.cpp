@@ -7,7 +7,6 @@
 #include <cstdlib>
 #include "DustGridPath.hpp"
 #include "DustGridPlotFile.hpp"
-#include "NR.hpp"
 #include "Random.hpp"
 #include "SpheDustGridStructure.hpp"
 
@@ -22,6 +21,15 @@ SpheDustGridStructure::SpheDustGridStructure()
 
 //////////////////////////////////////////////////////////////////////
 
+void SpheDustGridStructure::setupSelfAfter()
+{
+    DustGridStructure::setupSelfAfter();
+
+    _rbins.setGrid(_rv);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 int SpheDustGridStructure::dimension() const
 {
     return 1;
@@ -67,7 +75,7 @@ double SpheDustGridStructure::volume(int m) const
 
 int SpheDustGridStructure::whichcell(Position bfr) const
 {
-    return NR::locate_fail(_rv, bfr.radius());
+    return _rbins.locateFail(bfr.radius());
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -92,6 +100,19 @@ Position SpheDustGridStructure::randomPositionInCell(int m) const
 //////////////////////////////////////////////////////////////////////
 
 void SpheDustGridStructure::path(DustGridPath* path) const
+{
+    switch (_rbins.mapping())
+    {
+    case BinLocator::Linear:      return tracePath<BinLocator::Linear>(path);
+    case BinLocator::Logarithmic: return tracePath<BinLocator::Logarithmic>(path);
+    case BinLocator::Power:       return tracePath<BinLocator::Power>(path);
+    default:                      return tracePath<BinLocator::Generic>(path);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+template<BinLocator::Mapping M> void SpheDustGridStructure::tracePath(DustGridPath* path) const
 {
     // Determination of the initial position and direction of the path,
     // and calculation of some initial values
@@ -123,7 +144,7 @@ void SpheDustGridStructure::path(DustGridPath* path) const
 
     // Determination of the initial grid cell
 
-    int i = NR::locate_clip(_rv, r);
+    int i = _rbins.locateClip<M>(r);
 
     // And here we go...
 
@@ -133,7 +154,7 @@ void SpheDustGridStructure::path(DustGridPath* path) const
 
     if (q<0.0)
     {
-        int imin = NR::locate_clip(_rv,p);
+        int imin = _rbins.locateClip<M>(p);
         rN = _rv[i];
         qN = -sqrt((rN-p)*(rN+p));
         while (i>imin)
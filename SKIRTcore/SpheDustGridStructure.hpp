@@ -7,6 +7,7 @@
 #define SPHEDUSTGRIDSTRUCTURE_HPP
 
 #include "Array.hpp"
+#include "BinLocator.hpp"
 #include "DustGridStructure.hpp"
 
 ////////////////////////////////////////////////////////////////////
@@ -38,6 +39,12 @@ protected:
     /** The default constructor; it is protected since this is an abstract class. */
     SpheDustGridStructure();
 
+    /** This function detects whether the radial grid points set up by the subclass follow a
+        linear, logarithmic or power-law mapping, so that whichcell() and path() can locate the
+        radial bin containing a given radius in closed form rather than through a binary search.
+        See the BinLocator class for more information. */
+    void setupSelfAfter();
+
     //======================== Other Functions =======================
 
 public:
@@ -87,7 +94,9 @@ public:
 
     /** This function calculates a path through the grid. The DustGridPath object passed as an
         argument specifies the starting position \f${\bf{r}}\f$ and the direction \f${\bf{k}}\f$
-        for the path. The data on the calculated path are added back into the same object. */
+        for the path. The data on the calculated path are added back into the same object. The
+        function dispatches on the mapping of the radial grid points to an instantiation of the
+        tracePath() template. */
     void path(DustGridPath* path) const;
 
 protected:
@@ -95,6 +104,11 @@ protected:
         specified DustGridPlotFile object. */
     void write_xy(DustGridPlotFile* outfile) const;
 
+private:
+    /** This function implements path() for radial grid points with the mapping specified as
+        template argument, so that the radial bins can be located without a binary search. */
+    template<BinLocator::Mapping M> void tracePath(DustGridPath* path) const;
+
     //======================== Data Members ========================
 
 protected:
@@ -102,6 +116,10 @@ protected:
     int _Nr;
     double _rmax;
     Array _rv;
+
+private:
+    // data member initialized during setup
+    BinLocator _rbins;
 };
 
 ////////////////////////////////////////////////////////////////////
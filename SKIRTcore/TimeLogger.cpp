@@ -5,12 +5,14 @@
 
 #include <exception>
 #include "Log.hpp"
+#include "Parallel.hpp"
 #include "TimeLogger.hpp"
 
 ////////////////////////////////////////////////////////////////////
 
-TimeLogger::TimeLogger(Log *log, QString scope)
-    :_log(log), _scope(scope), _started(QDateTime::currentDateTime())
+TimeLogger::TimeLogger(Log *log, QString scope, Parallel* parallel)
+    :_log(log), _scope(scope), _started(QDateTime::currentDateTime()), _parallel(parallel),
+      _callTime(parallel ? parallel->callTime() : 0), _busyTime(parallel ? parallel->busyTime() : 0)
 {
     log->info("Starting " + scope + "...");
 }
@@ -54,6 +56,19 @@ TimeLogger::~TimeLogger()
         elapsed += QString::number(seconds) + "s)";
     }
 
+    // if requested, report the utilization of the parallel threads
+    if (_parallel && _parallel->threadCount() > 1)
+    {
+        qint64 callTime = _parallel->callTime() - _callTime;
+        qint64 busyTime = _parallel->busyTime() - _busyTime;
+        if (callTime > 0)
+        {
+            double utilization = double(busyTime) / (double(callTime) * _parallel->threadCount());
+            _log->info("Parallel utilization of " + QString::number(_parallel->threadCount()) + " threads in "
+                       + _scope + ": " + QString::number(100.*utilization,'f',1) + "%");
+        }
+    }
+
     _log->success("Finished " + _scope + " in " + elapsed + ".");
 }
 
@@ -9,6 +9,7 @@
 #include <QDateTime>
 #include <QString>
 class Log;
+class Parallel;
 
 ////////////////////////////////////////////////////////////////////
 
@@ -18,25 +19,34 @@ class Log;
     respectively. Typical use is to construct an instance at the beginning of a scope; the finish
     message is automatically generated by the destructor when the instance goes out of scope.
     Nested pairs of start/finish messages can easily be obtained by using TimeLogger in different
-    scopes. */
+    scopes. If a Parallel instance is specified in the constructor, the finish message is preceded
+    by a message reporting the utilization of the parallel threads in the calls made to that
+    instance during the lifetime of the TimeLogger. */
 class TimeLogger
 {
 public:
     /** The constructor logs a start message with level Info to the specified log instance, and
         stores the current time for use by the destructor. The start message is formed by prefixing
-        the specified scope name with the string "Starting ". */
-    TimeLogger(Log* log, QString scope);
+        the specified scope name with the string "Starting ". If a Parallel instance is specified,
+        the constructor also records the current values of its utilization statistics. */
+    TimeLogger(Log* log, QString scope, Parallel* parallel = 0);
 
     /** The destructor logs a finish message with level Success to the log instance specified in
         the constructor. The finish message is formed by prefixing the specified scope name with
         the string "Finished " and appending the time elapsed between start and finish in a nice
-        format. */
+        format. If a Parallel instance was specified in the constructor and it employs multiple
+        threads, the destructor first logs the utilization of the parallel threads, i.e. the
+        fraction of the time spent inside Parallel::call() during which the threads were doing
+        work. */
     ~TimeLogger();
 
 private:
     Log* _log;
     QString _scope;
     QDateTime _started;
+    Parallel* _parallel;
+    qint64 _callTime;
+    qint64 _busyTime;
 };
 
 ////////////////////////////////////////////////////////////////////
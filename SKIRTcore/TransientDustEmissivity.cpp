@@ -8,7 +8,9 @@
 #include "MultiGrainDustMix.hpp"
 #include "Log.hpp"
 #include "NR.hpp"
+#include "ParallelFactory.hpp"
 #include "TransientDustEmissivity.hpp"
+#include "TransientHeating.hpp"
 #include "Table.hpp"
 #include "Units.hpp"
 #include "WavelengthGrid.hpp"
@@ -17,46 +19,9 @@ using namespace std;
 
 ////////////////////////////////////////////////////////////////////
 
-// container classes that are highly specialized to optimize the operations in this class
-namespace
-{
-    // square matrix
-    template<typename T> class Square
-    {
-    private:
-        size_t _n;
-        T* _v;
-
-    public:
-        // constructor sets maximum size and logical size
-        Square(size_t n) : _n(n), _v(new T[n*n]) { }
-        ~Square() { delete[] _v; }
-
-        // sets logical size, which must not be larger than maximum size set in constructor (is not checked)
-        // does not clear values; does not resize underlying memory
-        void resize(size_t n) { _n = n; }
-
-        // access to values  (const version currently not needed)
-        T& operator()(size_t i, size_t j) { return _v[i*_n+j]; }
-    };
-
-    // square matrix with only items below the diagonal (i>j)
-    template<typename T> class Triangle
-    {
-    private:
-        T* _v;
-        static size_t offset(size_t i) { return ((i-1)*i)>>1; }
-
-    public:
-        // constructor sets size (can't be changed)
-        Triangle(size_t n) : _v(new T[offset(n)]) { }
-        ~Triangle() { delete[] _v; }
-
-        // access to values; must have i>j (is not checked)
-        const T& operator()(size_t i, size_t j) const { return _v[offset(i)+j]; }
-        T& operator()(size_t i, size_t j) { return _v[offset(i)+j]; }
-    };
-}
+// the container classes used by the transient heating solver
+using TransientHeating::Square;
+using TransientHeating::Triangle;
 
 ////////////////////////////////////////////////////////////////////
 
@@ -188,47 +153,8 @@ public:
         ioff = NR::locate_clip(_grid->_Tv, Tmin);
         int NT = NR::locate_clip(_grid->_Tv, Tmax) - ioff + 2;
 
-        // copy/calculate the transition matrix coefficients
-        Am.resize(NT);
-        for (int f=1; f<NT; f++)
-        {
-            const short* ELLv = &_ELLm(f+ioff,ioff);
-            const double* HRv = &_HRm(f+ioff,ioff);
-            for (int i=0; i<f; i++)
-            {
-                int ell = ELLv[i];
-                Am(f,i) = ell>=0 ? HRv[i] * Jv[ell] : 0.;
-            }
-        }
-        for (int i=1; i<NT; i++)
-        {
-            Am(i-1,i) = _CRv[i+ioff];
-        }
-
-        // calculate the cumulative matrix coefficients, in place
-        for (int f=NT-2; f>0; f--)
-        {
-            for (int i=0; i<f; i++)
-            {
-                Am(f,i) += Am(f+1,i);
-            }
-        }
-
-        // calculate the probabilities
-        Pv.resize(NT);
-        Pv[0] = 1.;
-        for (int i=1; i<NT; i++)
-        {
-            double sum = 0.;
-            for (int j=0; j<i; j++) sum += Am(i,j) * Pv[j];
-            Pv[i] = sum / Am(i-1,i);
-
-            // rescale if needed to keep infinities from happening
-            if (Pv[i] > 1e10) for (int j=0; j<=i; j++) Pv[j]/=Pv[i];
-        }
-
-        // normalize probabilities to unity
-        Pv /= Pv.sum();
+        // calculate the probabilities over the selected portion of the temperature grid
+        TransientHeating::probabilities(Pv, Am, _ELLm, _HRm, _CRv, ioff, NT, Jv);
 
         // determine the temperature range where the probabability is above a given fraction of its maximum
         double frac = 1e-20 * Pv.max();
@@ -267,6 +193,26 @@ public:
 
 ////////////////////////////////////////////////////////////////////
 
+// helper class to hold the scratch memory used by a single thread while calculating an emissivity,
+// so that it can be reused for subsequent calculations; all members are public for ease of use
+class TDE_Workspace
+{
+public:
+    // the transition matrix for the largest temperature grid in use (indexed on f,i)
+    Square<double> _Am;
+
+    // the probabilities calculated over each of the temperature grids (indexed on i)
+    Array _Pv;
+
+    // for each type of grain composition, the grain mass above which the dust population is in equilibrium
+    QHash<QString,double> _eqMass;
+
+    // constructor
+    TDE_Workspace(int NT) : _Am(NT) { }
+};
+
+////////////////////////////////////////////////////////////////////
+
 // configuration constants
 namespace
 {
@@ -293,7 +239,7 @@ namespace
 ////////////////////////////////////////////////////////////////////
 
 TransientDustEmissivity::TransientDustEmissivity()
-    : _Nlambda(0)
+    : _Nlambda(0), _parfac(0)
 {
 }
 
@@ -304,6 +250,7 @@ TransientDustEmissivity::~TransientDustEmissivity()
     foreach (const TDE_Calculator* calculator, _calculatorsA.values()) delete calculator;
     foreach (const TDE_Calculator* calculator, _calculatorsB.values()) delete calculator;
     foreach (const TDE_Grid* grid, _grids) delete grid;
+    foreach (TDE_Workspace* workspace, _workspaces) delete workspace;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -339,6 +286,13 @@ void TransientDustEmissivity::setupSelfBefore()
             _calculatorsC.insert(QPair<const DustMix*,int>(mix,c), new TDE_Calculator(gridC,mix,c));
         }
     }
+
+    // create a workspace for each parallel thread, sized to the largest temperature grid
+    int NTmax = 0;
+    foreach (const TDE_Grid* grid, _grids) NTmax = max(NTmax, grid->_NT);
+    _parfac = find<ParallelFactory>();
+    int Nthreads = _parfac->maxThreadCount();
+    for (int t=0; t<Nthreads; t++) _workspaces << new TDE_Workspace(NTmax);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -347,14 +301,16 @@ Array TransientDustEmissivity::emissivity(const DustMix* mix, const Array& Jv) c
 {
     const MultiGrainDustMix* mgmix = mix->find<MultiGrainDustMix>();
 
+    // get the scratch memory for the calling thread
+    TDE_Workspace* workspace = _workspaces[_parfac->currentThreadIndex()];
+    Square<double>& Am = workspace->_Am;
+    Array& Pv = workspace->_Pv;
+
     // This dictionary is updated as the loop over all dust populations in the mix proceeds.
     // For each type of grain composition, it keeps track of the grain mass above which
     // the dust population is most certainly in equilibrium.
-    QHash<QString,double> eqMass;
-
-    // provide room for the probabilities calculated over each of the temperature grids
-    Array Pv;
-    Square<double> Am(ceil(Tuppermax)+1);
+    QHash<QString,double>& eqMass = workspace->_eqMass;
+    eqMass.clear();
 
     // accumulate the emissivities for all populations in the dust mix
     Array ev(_Nlambda);
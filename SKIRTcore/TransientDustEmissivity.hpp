@@ -8,8 +8,10 @@
 
 #include <QHash>
 #include "DustEmissivity.hpp"
+class ParallelFactory;
 class TDE_Calculator;
 class TDE_Grid;
+class TDE_Workspace;
 
 //////////////////////////////////////////////////////////////////////
 
@@ -78,7 +80,11 @@ public:
     ~TransientDustEmissivity();
 
     /** This function verifies that all dust components in the dust system have a dust mix based on
-        the MultiGrainDustMix class. */
+        the MultiGrainDustMix class. It also constructs the temperature grids and the calculators
+        for each dust population, and a workspace for each parallel thread holding the scratch
+        memory used by the emissivity() function. The scratch matrix in each workspace is sized
+        to the largest temperature grid actually in use, and its memory is committed only when a
+        thread first uses it. */
     void setupSelfBefore();
 
     //======================== Other Functions =======================
@@ -86,7 +92,9 @@ public:
 public:
     /** This function returns the dust emissivity \f$\varepsilon_\ell\f$ at all wavelength indices
         \f$\ell\f$ for a dust mix of the specified type residing in the specified mean radiation
-        field \f$J_\ell\f$, assuming the simulation's wavelength grid. */
+        field \f$J_\ell\f$, assuming the simulation's wavelength grid. The function performs its
+        calculations in the workspace for the calling thread, so that no large blocks of memory
+        need to be allocated for each invocation. */
 
     Array emissivity(const DustMix* mix, const Array& Jv) const;
     /** The return value of this function indicates a meaningful frequency for console-logging when
@@ -108,6 +116,10 @@ private:
     QHash< QPair<const DustMix*,int>, const TDE_Calculator* > _calculatorsA;     // coarse grid
     QHash< QPair<const DustMix*,int>, const TDE_Calculator* > _calculatorsB;     // medium grid
     QHash< QPair<const DustMix*,int>, const TDE_Calculator* > _calculatorsC;     // fine grid
+
+    // setupSelfBefore adds a workspace to this list for each parallel thread, indexed on thread index
+    ParallelFactory* _parfac;
+    QList<TDE_Workspace*> _workspaces;
 };
 
 ////////////////////////////////////////////////////////////////////
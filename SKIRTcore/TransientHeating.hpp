@@ -0,0 +1,159 @@
+/*//////////////////////////////////////////////////////////////////
+////       SKIRT -- an advanced radiative transfer code         ////
+////       © Astronomical Observatory, Ghent University         ////
+///////////////////////////////////////////////////////////////// */
+
+#ifndef TRANSIENTHEATING_HPP
+#define TRANSIENTHEATING_HPP
+
+#include <cstddef>
+#include "Array.hpp"
+
+////////////////////////////////////////////////////////////////////
+
+/** This namespace contains the computational kernel of the transient heating solver used by the
+    TransientDustEmissivity class, together with the container classes that are highly
+    specialized to optimize its operations. All implementations are provided inline in the
+    header. The namespace does not depend on Qt or on any simulation item, so that the kernel can
+    also be compiled and timed in isolation (see the SKIRTbench application). */
+namespace TransientHeating
+{
+    /** This template class represents a square matrix with a maximum size set at construction, and
+        a smaller logical size that can be changed without reallocating memory. */
+    template<typename T> class Square
+    {
+    private:
+        size_t _n;
+        T* _v;
+
+    public:
+        /** The constructor sets the maximum size and the logical size. It does not initialize the
+            values, so that the underlying memory is committed only when it is actually used. */
+        Square(size_t n) : _n(n), _v(new T[n*n]) { }
+
+        /** The destructor releases the memory. */
+        ~Square() { delete[] _v; }
+
+        /** This function sets the logical size, which must not be larger than the maximum size set
+            in the constructor (this is not checked). It does not clear the values and does not
+            resize the underlying memory. */
+        void resize(size_t n) { _n = n; }
+
+        /** This function provides access to the value at the specified row and column. */
+        T& operator()(size_t i, size_t j) { return _v[i*_n+j]; }
+    };
+
+    /** This template class represents a square matrix of fixed size that stores only the items
+        below the diagonal, i.e. the items with row index \f$i\f$ larger than column index
+        \f$j\f$. */
+    template<typename T> class Triangle
+    {
+    private:
+        T* _v;
+        static size_t offset(size_t i) { return ((i-1)*i)>>1; }
+
+    public:
+        /** The constructor sets the size, which can't be changed. */
+        Triangle(size_t n) : _v(new T[offset(n)]) { }
+
+        /** The destructor releases the memory. */
+        ~Triangle() { delete[] _v; }
+
+        /** This function provides read access to the value at the specified row and column; the
+            row index must be larger than the column index (this is not checked). */
+        const T& operator()(size_t i, size_t j) const { return _v[offset(i)+j]; }
+
+        /** This function provides write access to the value at the specified row and column; the
+            row index must be larger than the column index (this is not checked). */
+        T& operator()(size_t i, size_t j) { return _v[offset(i)+j]; }
+    };
+
+    /** This function returns the dot product of the first \em n elements of two arrays. Using four
+        independent partial sums allows the compiler to vectorize the loop and to overlap the
+        latencies of consecutive additions. */
+    inline double dot(const double* a, const double* b, int n)
+    {
+        double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+        int k = 0;
+        for (; k+4<=n; k+=4)
+        {
+            s0 += a[k]*b[k];
+            s1 += a[k+1]*b[k+1];
+            s2 += a[k+2]*b[k+2];
+            s3 += a[k+3]*b[k+3];
+        }
+        for (; k<n; k++) s0 += a[k]*b[k];
+        return (s0+s1) + (s2+s3);
+    }
+
+    /** This function calculates the normalized temperature probability distribution \em Pv of a
+        dust population over the \em NT consecutive bins of a temperature grid starting at index
+        \em ioff. The heating rates \em HRm from bin \f$i\f$ to bin \f$f\f$, barring the
+        dependency on the radiation field, and the wavelength index \em ELLm of the radiation
+        field for each such transition (or -1 if the transition falls outside of the wavelength
+        grid) are given for the complete temperature grid, as are the cooling rates \em CRv from
+        each bin to the bin just below it. The radiation field \em Jv is indexed on wavelength.
+        The matrix \em Am serves as scratch memory; its maximum size must be at least \em NT.
+
+        The function first calculates the cumulative transition matrix coefficients below the
+        diagonal, i.e. the sum of the heating rates from bin \f$i\f$ to bin \f$f\f$ and to all
+        higher bins. Proceeding from the last row upwards, each row is obtained in a single pass
+        by adding the heating rates to the row below it. The probabilities then follow from a
+        forward substitution, rescaling the values calculated so far if needed to avoid
+        overflow. */
+    inline void probabilities(Array& Pv, Square<double>& Am, const Triangle<short>& ELLm,
+                              const Triangle<double>& HRm, const Array& CRv, int ioff, int NT, const Array& Jv)
+    {
+        // calculate the cumulative transition matrix coefficients below the diagonal
+        Am.resize(NT);
+        for (int f=NT-1; f>0; f--)
+        {
+            const short* ELLv = &ELLm(f+ioff,ioff);
+            const double* HRv = &HRm(f+ioff,ioff);
+            double* Av = &Am(f,0);
+            if (f == NT-1)
+            {
+                for (int i=0; i<f; i++)
+                {
+                    int ell = ELLv[i];
+                    Av[i] = ell>=0 ? HRv[i] * Jv[ell] : 0.;
+                }
+            }
+            else
+            {
+                const double* Anextv = &Am(f+1,0);
+                for (int i=0; i<f; i++)
+                {
+                    int ell = ELLv[i];
+                    Av[i] = (ell>=0 ? HRv[i] * Jv[ell] : 0.) + Anextv[i];
+                }
+            }
+        }
+
+        // copy the cooling rates just above the diagonal
+        for (int i=1; i<NT; i++)
+        {
+            Am(i-1,i) = CRv[i+ioff];
+        }
+
+        // calculate the probabilities
+        Pv.resize(NT);
+        Pv[0] = 1.;
+        double* P = &Pv[0];
+        for (int i=1; i<NT; i++)
+        {
+            double sum = dot(&Am(i,0), P, i);
+            Pv[i] = sum / Am(i-1,i);
+
+            // rescale if needed to keep infinities from happening
+            if (Pv[i] > 1e10) for (int j=0; j<=i; j++) Pv[j]/=Pv[i];
+        }
+
+        // normalize probabilities to unity
+        Pv /= Pv.sum();
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+#endif // TRANSIENTHEATING_HPP
@@ -3,8 +3,10 @@
 ////       © Astronomical Observatory, Ghent University         ////
 ///////////////////////////////////////////////////////////////// */
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <QVarLengthArray>
 #include "DustDistribution.hpp"
 #include "DustGridPath.hpp"
 #include "DustGridPlotFile.hpp"
@@ -30,8 +32,8 @@ TreeDustGridStructure::TreeDustGridStructure()
       _maxOpticalDepth(0), _maxMassFraction(0), _maxDensDispFraction(0),
       _parallel(0), _dd(0), _dmib(0),
       _totalmass(0), _eps(0),
-      _Nnodes(0), _highestWriteLevel(0),
-      _useDmibForSubdivide(false)
+      _Nnodes(0), _highestWriteLevel(0), _levelbegin(0),
+      _lineardepth(0), _useDmibForSubdivide(false)
 {
 }
 
@@ -39,7 +41,7 @@ TreeDustGridStructure::TreeDustGridStructure()
 
 TreeDustGridStructure::~TreeDustGridStructure()
 {
-    for (int l=0; l<_Nnodes; l++)
+    for (unsigned int l=0; l<_tree.size(); l++)
         delete _tree[l];
 }
 
@@ -57,7 +59,7 @@ void TreeDustGridStructure::setupSelfBefore()
 
     // Cache some often used values
 
-    _parallel = find<ParallelFactory>()->parallel(4);   // limit number of threads for performance reasons
+    _parallel = find<ParallelFactory>()->parallel();
     _dd = find<DustDistribution>();
     _dmib = _dd->interface<DustMassInBoxInterface>();
     _useDmibForSubdivide = _dmib && !_maxDensDispFraction;
@@ -69,25 +71,27 @@ void TreeDustGridStructure::setupSelfBefore()
     _tree.push_back(createRoot(extent()));
 
     // Recursively subdivide the root node until all nodes satisfy the
-    // necessary criteria. When finished, set the number _Nnodes.
+    // necessary criteria. The nodes of each level are subdivided in parallel.
+    // The new children are then numbered and added to the tree in the order
+    // of their fathers, so that the node numbering does not depend on the
+    // number of threads. When finished, set the number _Nnodes.
 
-    int currentlevel = -1;
-    unsigned int l = 0;
-    while (true)
+    while (_levelbegin < _tree.size())
     {
-        TreeNode* node = _tree[l];
-        int level = node->level();
-        if (level>currentlevel)
+        size_t levelend = _tree.size();
+        log->info("Starting subdivision of level " + QString::number(_tree[_levelbegin]->level()) +
+                  " (" + QString::number(levelend-_levelbegin) + " nodes)...");
+        _parallel->call(this, &TreeDustGridStructure::subdivide, levelend-_levelbegin);
+        for (size_t l=_levelbegin; l<levelend; l++)
         {
-            log->info("Starting subdivision of level " + QString::number(level) + "...");
-            currentlevel = level;
+            const vector<TreeNode*>& children = _tree[l]->children();
+            for (unsigned int c=0; c<children.size(); c++)
+            {
+                children[c]->setid(_tree.size());
+                _tree.push_back(children[c]);
+            }
         }
-        if (l%50000 == 0)
-            log->info("Subdividing node number " + QString::number(l) + "...");
-        if (node->ynchildless())
-            subdivide(node);
-        l++;
-        if (l>=_tree.size()) break;
+        _levelbegin = levelend;
     }
     _Nnodes = _tree.size();
 
@@ -148,20 +152,150 @@ void TreeDustGridStructure::setupSelfBefore()
     {
         log->info("Adding neighbors to the tree nodes...");
         for (int l=0; l<_Nnodes; l++) _tree[l]->addneighbors();
-        for (int l=0; l<_Nnodes; l++) _tree[l]->sortneighbors();
+        _parallel->call(this, &TreeDustGridStructure::sortneighbors, _Nnodes);
     }
+
+    // Convert the tree to the compact representation (but only if required for the search method)
+
+    if (_search == Linear) linearize();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void TreeDustGridStructure::linearize()
+{
+    Log* log = find<Log>();
+    log->info("Converting the tree to a linear node array...");
+
+    // Add the nodes in depth-first order, so that the children of each node are stored contiguously
+    // and the leaves end up in Morton order
+
+    _linearv.reserve(_Nnodes);
+    _linearv.resize(1);
+    _splitv.reserve(_Nnodes-_Ncells);
+    _leafv.resize(_Ncells);
+    _lineardepth = 0;
+    addlinearnode(root(), 0, 0);
+
+    // Release the original tree nodes, which are no longer needed
+
+    for (unsigned int l=0; l<_tree.size(); l++) delete _tree[l];
+    vector<TreeNode*>().swap(_tree);
+    vector<int>().swap(_cellnumberv);
+    vector<int>().swap(_idv);
+
+    double bytes = _Nnodes*sizeof(LinearNode) + _splitv.size()*sizeof(Vec) + _Ncells*sizeof(quint32);
+    log->info("  Size of each node in the linear node array: " + QString::number(sizeof(LinearNode)) + " bytes");
+    log->info("  Average memory per node including split points and cell index: "
+              + QString::number(bytes/_Nnodes, 'f', 1) + " bytes");
+    log->info("  Total size of the linear node representation: " + QString::number(bytes/1048576., 'f', 1) + " MB");
 }
 
 //////////////////////////////////////////////////////////////////////
 
-void TreeDustGridStructure::subdivide(TreeNode* node)
+void TreeDustGridStructure::addlinearnode(const TreeNode* node, int index, int father)
 {
+    _linearv[index].father = father;
+    _linearv[index].level = node->level();
+    _lineardepth = max(_lineardepth, node->level()+1);
+
+    if (node->ynchildless())
+    {
+        int m = cellnumber(node);
+        _linearv[index].child = 0;
+        _linearv[index].data = m;
+        _linearv[index].splitmask = 0;
+        _leafv[m] = index;
+    }
+    else
+    {
+        // the first child has the minimum corner of the father, so its maximum corner reveals
+        // both the subdivision directions and the split point
+        const TreeNode* child0 = node->child(0);
+        int splitmask = (child0->xmax() < node->xmax() ? 1 : 0)
+                      + (child0->ymax() < node->ymax() ? 2 : 0)
+                      + (child0->zmax() < node->zmax() ? 4 : 0);
+        int Nchildren = node->children().size();
+        if (Nchildren != (1 << ((splitmask&1) + ((splitmask>>1)&1) + ((splitmask>>2)&1))))
+            throw FATALERROR("The linear search method does not support this type of tree node");
+
+        // allocate the children before filling in the node, since resizing the array may move it
+        int first = _linearv.size();
+        _linearv.resize(first+Nchildren);
+        _linearv[index].child = first;
+        _linearv[index].data = _splitv.size();
+        _linearv[index].splitmask = splitmask;
+        _splitv.push_back(child0->extent().rmax());
+        for (int k=0; k<Nchildren; k++) addlinearnode(node->child(k), first+k, index);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int TreeDustGridStructure::whichlinearnode(Vec r) const
+{
+    if (!extent().contains(r)) return -1;
+
+    int l = 0;
+    while (_linearv[l].child) l = linearchild(l, r.x(), r.y(), r.z());
+    return l;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int TreeDustGridStructure::linearchild(int index, double x, double y, double z) const
+{
+    const LinearNode& node = _linearv[index];
+    const Vec& split = _splitv[node.data];
+    int k = 0;
+    int offset = 1;
+    if (node.splitmask & 1) { if (x >= split.x()) k += offset; offset *= 2; }
+    if (node.splitmask & 2) { if (y >= split.y()) k += offset; offset *= 2; }
+    if (node.splitmask & 4) { if (z >= split.z()) k += offset; }
+    return node.child + k;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Box TreeDustGridStructure::linearchildextent(int index, int child, const Box& extent) const
+{
+    const LinearNode& node = _linearv[index];
+    const Vec& split = _splitv[node.data];
+    double xmin, ymin, zmin, xmax, ymax, zmax;
+    extent.extent(xmin, ymin, zmin, xmax, ymax, zmax);
+    int k = child - node.child;
+    int offset = 1;
+    if (node.splitmask & 1) { if (k & offset) xmin = split.x(); else xmax = split.x(); offset *= 2; }
+    if (node.splitmask & 2) { if (k & offset) ymin = split.y(); else ymax = split.y(); offset *= 2; }
+    if (node.splitmask & 4) { if (k & offset) zmin = split.z(); else zmax = split.z(); }
+    return Box(xmin, ymin, zmin, xmax, ymax, zmax);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Box TreeDustGridStructure::linearextent(int index) const
+{
+    // collect the ancestors of the node, and then apply their split points from the root node down
+    QVarLengthArray<int,32> chainv;
+    for (int l=index; l; l=_linearv[l].father) chainv.append(l);
+    Box box = extent();
+    for (int d=chainv.size()-1; d>=0; d--) box = linearchildextent(_linearv[chainv[d]].father, chainv[d], box);
+    return box;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void TreeDustGridStructure::subdivide(size_t index)
+{
+    // the children receive a temporary identifier; they are numbered and added to the tree by the caller
+    size_t l = _levelbegin + index;
+    TreeNode* node = _tree[l];
+
     // If level is below or at minlevel, there is always subdivision, and the subdivision is "regular"
     int level = node->level();
     if (level <= _minlevel)
     {
-        node->createchildren(_tree.size());
-        _tree.insert(_tree.end(), node->children().begin(), node->children().end());
+        node->createchildren(0);
     }
 
     // if level is below maxlevel, there may be subdivision depending on various stopping criteria
@@ -176,10 +310,12 @@ void TreeDustGridStructure::subdivide(TreeNode* node)
         }
         else
         {
-            // sample the density in the cell
+            // sample the density in the cell; with the Philox generator, the random stream is keyed on the node number
+            _random->startChunk(Random::TreeConstructionPhase, l);
             TreeNodeSampleDensityCalculator* sampleCalc =
                     new TreeNodeSampleDensityCalculator(_random, _Nrandom, _dd, node);
-            _parallel->call(sampleCalc, _Nrandom);
+            for (int n=0; n<_Nrandom; n++) sampleCalc->body(n);
+            _random->endChunk();
             calc = sampleCalc;
         }
 
@@ -212,8 +348,7 @@ void TreeDustGridStructure::subdivide(TreeNode* node)
         if (needDivision)
         {
             // there is subdivision, possibly using calculated properties such as barycenter
-            node->createchildren(_tree.size(), calc);
-            _tree.insert(_tree.end(), node->children().begin(), node->children().end());
+            node->createchildren(0, calc);
         }
 
         delete calc;
@@ -222,6 +357,13 @@ void TreeDustGridStructure::subdivide(TreeNode* node)
 
 //////////////////////////////////////////////////////////////////////
 
+void TreeDustGridStructure::sortneighbors(size_t l)
+{
+    _tree[l]->sortneighbors();
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void TreeDustGridStructure::setExtentX(double value)
 {
     if (value <= 0.0) throw FATALERROR("The maximum extent (in the X direction) should be positive");
@@ -401,14 +543,18 @@ double TreeDustGridStructure::volume(int m) const
 {
     if (m<0 || m>_Ncells)
         throw FATALERROR("Invalid cell number: " + QString::number(m));
-    TreeNode* node = getnode(m);
-    return node->xwidth() * node->ywidth() * node->zwidth();
+    return cellextent(m).volume();
 }
 
 //////////////////////////////////////////////////////////////////////
 
 int TreeDustGridStructure::whichcell(Position bfr) const
 {
+    if (_search == Linear)
+    {
+        int l = whichlinearnode(bfr);
+        return l >= 0 ? static_cast<int>(_linearv[l].data) : -1;
+    }
     const TreeNode* node = root()->whichnode(bfr);
     return node ? cellnumber(node) : -1;
 }
@@ -417,14 +563,14 @@ int TreeDustGridStructure::whichcell(Position bfr) const
 
 Position TreeDustGridStructure::centralPositionInCell(int m) const
 {
-    return Position(getnode(m)->extent().center());
+    return Position(cellextent(m).center());
 }
 
 //////////////////////////////////////////////////////////////////////
 
 Position TreeDustGridStructure::randomPositionInCell(int m) const
 {
-    return _random->position(getnode(m)->extent());
+    return _random->position(cellextent(m));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -437,11 +583,6 @@ void TreeDustGridStructure::path(DustGridPath* path) const
     // If the photon package starts outside the dust grid, move it into the first grid cell that it will pass
     Position r = path->moveInside(extent(), _eps);
 
-    // Get the node containing the current location;
-    // if the position is not inside the grid, return an empty path
-    const TreeNode* node = root()->whichnode(r);
-    if (!node) return path->clear();
-
     // Start the loop over nodes/path segments until we leave the grid.
     // Use a different code segment depending on the search method.
     double x,y,z;
@@ -449,6 +590,61 @@ void TreeDustGridStructure::path(DustGridPath* path) const
     double kx,ky,kz;
     path->direction().cartesian(kx,ky,kz);
 
+    // ----------- Linear -----------
+
+    // this code section does not use the original tree nodes, which have been released
+
+    if (_search == Linear)
+    {
+        // if the position is not inside the grid, return an empty path
+        if (!extent().contains(r)) return path->clear();
+
+        // the stack of nodes from the root node down to the current node, and their extents
+        QVarLengthArray<int,32> nodev(_lineardepth);
+        QVarLengthArray<Box,32> boxv(_lineardepth);
+        int depth = 0;
+        nodev[0] = 0;
+        boxv[0] = extent();
+
+        while (true)
+        {
+            // descend to the leaf node containing the current location
+            while (_linearv[nodev[depth]].child)
+            {
+                int l = linearchild(nodev[depth], x, y, z);
+                boxv[depth+1] = linearchildextent(nodev[depth], l, boxv[depth]);
+                nodev[depth+1] = l;
+                depth++;
+            }
+
+            const Box& box = boxv[depth];
+            double xnext = (kx<0.0) ? box.xmin() : box.xmax();
+            double ynext = (ky<0.0) ? box.ymin() : box.ymax();
+            double znext = (kz<0.0) ? box.zmin() : box.zmax();
+            double dsx = (fabs(kx)>1e-15) ? (xnext-x)/kx : DBL_MAX;
+            double dsy = (fabs(ky)>1e-15) ? (ynext-y)/ky : DBL_MAX;
+            double dsz = (fabs(kz)>1e-15) ? (znext-z)/kz : DBL_MAX;
+
+            double ds;
+            if (dsx<=dsy && dsx<=dsz) ds = dsx;
+            else if (dsy<=dsx && dsy<=dsz) ds = dsy;
+            else ds = dsz;
+            path->addSegment(_linearv[nodev[depth]].data, ds);
+            x += (ds+_eps)*kx;
+            y += (ds+_eps)*ky;
+            z += (ds+_eps)*kz;
+
+            // ascend to the smallest node containing the new location; stop if we left the grid
+            while (depth >= 0 && !boxv[depth].contains(x,y,z)) depth--;
+            if (depth < 0) return;
+        }
+    }
+
+    // Get the node containing the current location;
+    // if the position is not inside the grid, return an empty path
+    const TreeNode* node = root()->whichnode(r);
+    if (!node) return path->clear();
+
     // ----------- Top-down -----------
 
     if (_search == TopDown)
@@ -674,8 +870,8 @@ QList<SimulationItem*> TreeDustGridStructure::interfaceCandidates(const type_inf
 
 double TreeDustGridStructure::density(int h, int m) const
 {
-    TreeNode* node = getnode(m);
-    return _dmib->massInBox(h, node->extent()) / node->volume();
+    const Box& box = cellextent(m);
+    return _dmib->massInBox(h, box) / box.volume();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -686,10 +882,10 @@ void TreeDustGridStructure::write_xy(DustGridPlotFile* outfile) const
     outfile->writeRectangle(_xmin, _ymin, _xmax, _ymax);
     for (int m=0; m<_Ncells; m++)
     {
-        TreeNode* node = getnode(m);
-        if (fabs(node->zmin()) < 1e-8*extent().zwidth())
+        const Box& node = cellextent(m);
+        if (fabs(node.zmin()) < 1e-8*extent().zwidth())
         {
-            outfile->writeRectangle(node->xmin(), node->ymin(), node->xmax(), node->ymax());
+            outfile->writeRectangle(node.xmin(), node.ymin(), node.xmax(), node.ymax());
         }
     }
 }
@@ -702,10 +898,10 @@ void TreeDustGridStructure::write_xz(DustGridPlotFile* outfile) const
     outfile->writeRectangle(_xmin, _zmin, _xmax, _zmax);
     for (int m=0; m<_Ncells; m++)
     {
-        TreeNode* node = getnode(m);
-        if (fabs(node->ymin()) < 1e-8*extent().ywidth())
+        const Box& node = cellextent(m);
+        if (fabs(node.ymin()) < 1e-8*extent().ywidth())
         {
-            outfile->writeRectangle(node->xmin(), node->zmin(), node->xmax(), node->zmax());
+            outfile->writeRectangle(node.xmin(), node.zmin(), node.xmax(), node.zmax());
         }
     }
 }
@@ -718,10 +914,10 @@ void TreeDustGridStructure::write_yz(DustGridPlotFile* outfile) const
     outfile->writeRectangle(_ymin, _zmin, _ymax, _zmax);
     for (int m=0; m<_Ncells; m++)
     {
-        TreeNode* node = getnode(m);
-        if (fabs(node->xmin()) < 1e-8*extent().xwidth())
+        const Box& node = cellextent(m);
+        if (fabs(node.xmin()) < 1e-8*extent().xwidth())
         {
-            outfile->writeRectangle(node->ymin(), node->zmin(), node->ymax(), node->zmax());
+            outfile->writeRectangle(node.ymin(), node.zmin(), node.ymax(), node.zmax());
         }
     }
 }
@@ -733,9 +929,9 @@ void TreeDustGridStructure::write_xyz(DustGridPlotFile* outfile) const
     // Output all leaf cells up to a certain level
     for (int m=0; m<_Ncells; m++)
     {
-        TreeNode* node = getnode(m);
-        if (node->level() <= _highestWriteLevel)
-            outfile->writeCube(node->xmin(), node->ymin(), node->zmin(), node->xmax(), node->ymax(), node->zmax());
+        const Box& node = cellextent(m);
+        if (celllevel(m) <= _highestWriteLevel)
+            outfile->writeCube(node.xmin(), node.ymin(), node.zmin(), node.xmax(), node.ymax(), node.zmax());
     }
 }
 
@@ -761,3 +957,19 @@ int TreeDustGridStructure::cellnumber(const TreeNode* node) const
 }
 
 //////////////////////////////////////////////////////////////////////
+
+Box TreeDustGridStructure::cellextent(int m) const
+{
+    if (_search == Linear) return linearextent(_leafv[m]);
+    return getnode(m)->extent();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int TreeDustGridStructure::celllevel(int m) const
+{
+    if (_search == Linear) return _linearv[_leafv[m]].level;
+    return getnode(m)->level();
+}
+
+//////////////////////////////////////////////////////////////////////
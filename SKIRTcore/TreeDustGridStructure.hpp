@@ -62,6 +62,7 @@ class TreeDustGridStructure : public GenDustGridStructure, public Box, public Du
     Q_CLASSINFO("TopDown", "top-down (start at root and recursively find appropriate child node)")
     Q_CLASSINFO("Neighbor", "neighbor (construct and use neighbor list for each node wall) ")
     Q_CLASSINFO("Bookkeeping", "bookkeeping (derive appropriate neighbor through node indices)")
+    Q_CLASSINFO("Linear", "linear (compact node array traversed with a stack of ancestors)")
     Q_CLASSINFO("Default", "Neighbor")
 
     Q_CLASSINFO("Property", "sampleCount")
@@ -104,19 +105,27 @@ protected:
         createRoot() to be implemented in each subclass), and store it in the tree vector,
         which is just a list of pointers to nodes). The second phase is to recursively subdivide
         the root node and add the children at the end of the tree vector, until all nodes satisfy
-        the criteria for no further subdivision. When this task is accomplished,
+        the criteria for no further subdivision. The nodes at a given level are subdivided in
+        parallel, after which their children are numbered and added to the tree vector in the order
+        of their fathers; the resulting tree is thus independent of the number of threads (when
+        using the Philox random generator). When this task is accomplished,
         the function creates a vector that contains the node IDs of all leaves. This is the actual
         dust cell vector (only the leaf nodes are the actual dust cells). The function also creates
         a vector with the cell numbers of all the nodes, i.e. the rank \f$m\f$ of the node in the
         ID vector if the node is a leaf, and the number -1 if the node is not a leaf (and hence not
         a dust cell). Finally, the function logs some details on the number of nodes and the number
         of cells, and if writeFlag() returns true, it writes the distribution of the grid cells to
-        a file. */
+        a file. If the Linear search method has been selected, the function finally converts the
+        tree to the compact representation described for setSearchMethod() and releases the
+        original tree nodes. */
     void setupSelfBefore();
 
 private:
-    /** This function, only to be called during the construction phase, investigates whether a node
-        should be further subdivided and also takes care of the actual subdivision. There are
+    /** This function, only to be called during the construction phase, investigates whether the
+        node with the specified index relative to the start of the current level should be further
+        subdivided and also takes care of the actual subdivision. It is designed for use as the
+        body in a parallel loop over the nodes of a level; the children are created with a
+        temporary identifier and are added to the tree by the caller. There are
         several criteria for subdivision. The simplest criterion is the level of subdivision of the
         node: if it is less then a minimum level, the node is always subdivided, if it higher then
         a maximum level, there is no subdivision (these levels are input parameters). In the
@@ -136,8 +145,14 @@ private:
         \f] In the latter case the division point is the centre of mass, which we estimate using
         the \f$N_{\text{random}}\f$ points generated before, \f[ {\bf{r}}_c = \frac{ \sum_n
         \rho({\bf{r}}_n)\, {\bf{r}}_n}{ \sum_n \rho({\bf{r}}_n) }. \f] The last task is to actually
-        create the eight child nodes of the node and add them to the tree. */
-    void subdivide(TreeNode* node);
+        create the eight child nodes of the node. The density samples for a node are drawn from a
+        random stream keyed on the node number. */
+    void subdivide(size_t index);
+
+    /** This function sorts the neighbor lists of the node with the specified index. It is designed
+        for use as the body in a parallel loop over all nodes, after the neighbors have been added
+        for all nodes. */
+    void sortneighbors(size_t l);
 
     //======== Setters & Getters for Discoverable Attributes =======
 
@@ -178,9 +193,21 @@ public:
         Neighbor method constructs a neighbor list for each node (at each of the six walls) during
         setup, and then uses this list to locate the neighboring node containing the new position.
         The Bookkeeping method relies on the order in which the occtree nodes are created and
-        stored to derive the appropriate neighbor solely through the respective node indices. */
+        stored to derive the appropriate neighbor solely through the respective node indices.
+
+        The Linear method converts the tree after construction to a compact representation: a
+        single contiguous array of 16-byte nodes in which the children of each node are stored next
+        to each other, referenced by the 32-bit index of the first child. The nodes are laid out in
+        depth-first order, so that the leaves appear in Morton (Z-curve) order and spatially nearby
+        cells are close together in memory. The nodes do not store their spatial extent; instead,
+        each nonleaf node refers to its split point in a separate array, and the extent of a node
+        is derived exactly from the split points of its ancestors. While tracing a path, the
+        extents of the ancestors of the current node are kept on a stack, so that after crossing
+        a wall the search for the next node ascends only to the smallest ancestor containing the
+        new position and then descends from there. The original tree nodes are released after the
+        conversion. */
     Q_ENUMS(SearchMethod)
-    enum SearchMethod { TopDown, Neighbor, Bookkeeping };
+    enum SearchMethod { TopDown, Neighbor, Bookkeeping, Linear };
 
     /** Sets the enumeration value indicating the search method to be used for finding the
         subsequent node while traversing the tree grid. */
@@ -329,6 +356,41 @@ private:
         vector. */
     int cellnumber(const TreeNode* node) const;
 
+    /** This function returns the spatial extent of the dust cell with cell number \f$m\f$, in
+        either tree representation. */
+    Box cellextent(int m) const;
+
+    /** This function returns the level in the tree of the dust cell with cell number \f$m\f$, in
+        either tree representation. */
+    int celllevel(int m) const;
+
+    /** This function, only to be called during setup, converts the tree to the compact
+        representation used by the Linear search method (see setSearchMethod()). */
+    void linearize();
+
+    /** This function, only to be called during setup, adds the specified node and, recursively,
+        its descendants to the compact node array, at the specified index, with the specified
+        index for its father node. The array element for the node itself must already have been
+        allocated. */
+    void addlinearnode(const TreeNode* node, int index, int father);
+
+    /** This function returns the index in the compact node array of the leaf node containing
+        the specified position, or -1 if the position is outside the grid. */
+    int whichlinearnode(Vec r) const;
+
+    /** This function returns the index in the compact node array of the child containing the
+        specified position, for the nonleaf node with the specified index. */
+    int linearchild(int index, double x, double y, double z) const;
+
+    /** This function returns the spatial extent of the child of the nonleaf node with the
+        specified index, given the child's index in the compact node array and the spatial extent
+        of the father node. */
+    Box linearchildextent(int index, int child, const Box& extent) const;
+
+    /** This function returns the spatial extent of the node with the specified index in the
+        compact node array, derived from the split points of its ancestors. */
+    Box linearextent(int index) const;
+
 protected:
     /** This pure virtual function, to be implemented in each subclass, creates a root node
         of the appropriate type, using a node identifier of zero and the specified spatial extent,
@@ -359,6 +421,21 @@ private:
     std::vector<int> _cellnumberv;
     std::vector<int> _idv;
     int _highestWriteLevel;
+    size_t _levelbegin;     // index of the first node in the level being subdivided
+
+    // the compact node representation used by the Linear search method
+    struct LinearNode
+    {
+        quint32 child;          // the index of the first child, or zero for a leaf
+        quint32 father;         // the index of the father node, or zero for the root node
+        quint32 data;           // the cell number for a leaf, or the index in _splitv for a nonleaf node
+        quint8 splitmask;       // bit 0, 1, 2 is set if the node is subdivided in the x, y, z direction
+        quint8 level;           // the level of the node in the tree
+    };
+    std::vector<LinearNode> _linearv;  // the nodes, with the root node at index zero
+    std::vector<Vec> _splitv;          // the split point of each nonleaf node
+    std::vector<quint32> _leafv;       // the index in _linearv of the node for each cell number
+    int _lineardepth;                  // the number of levels in the tree, i.e. the largest node level plus one
 
 protected:
     bool _useDmibForSubdivide;
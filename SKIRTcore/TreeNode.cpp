@@ -39,6 +39,13 @@ int TreeNode::id() const
 
 //////////////////////////////////////////////////////////////////////
 
+void TreeNode::setid(int id)
+{
+    _id = id;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 int TreeNode::level() const
 {
     return _level;
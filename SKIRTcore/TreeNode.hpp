@@ -75,6 +75,10 @@ public:
     /** This function returns the ID number of the node. */
     int id() const;
 
+    /** This function sets the ID number of the node. It allows the nodes to be numbered after they
+        have been created, e.g. when the nodes of a tree level are subdivided in parallel. */
+    void setid(int id);
+
     /** This function returns the level of the node. */
     int level() const;
 
@@ -7,6 +7,7 @@
 #include "Log.hpp"
 #include "MeshDustComponent.hpp"
 #include "NR.hpp"
+#include "ParallelFactory.hpp"
 #include "Random.hpp"
 #include "VoronoiDustDistribution.hpp"
 #include "VoronoiMesh.hpp"
@@ -54,7 +55,8 @@ void VoronoiDustDistribution::setupSelfAfter()
     }
 
     // import the Voronoi mesh
-    _mesh = new VoronoiMesh(_meshfile, fieldIndices, Box(-_xmax,-_ymax,-_zmax, _xmax,_ymax,_zmax));
+    _mesh = new VoronoiMesh(_meshfile, fieldIndices, Box(-_xmax,-_ymax,-_zmax, _xmax,_ymax,_zmax),
+                             find<ParallelFactory>()->parallel());
     find<Log>()->info("Voronoi mesh data was successfully imported: " + QString::number(_mesh->Ncells()) + " cells.");
 
     // add a density field for each of our components, so that the mesh holds the total density
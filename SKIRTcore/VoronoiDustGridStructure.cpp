@@ -9,6 +9,7 @@
 #include "FatalError.hpp"
 #include "FilePaths.hpp"
 #include "Log.hpp"
+#include "ParallelFactory.hpp"
 #include "Random.hpp"
 #include "Units.hpp"
 #include "VoronoiDustGridStructure.hpp"
@@ -22,7 +23,7 @@ using namespace std;
 //////////////////////////////////////////////////////////////////////
 
 VoronoiDustGridStructure::VoronoiDustGridStructure()
-    : _numParticles(0), _distribution(DustDensity), _meshfile(0), _mesh(0), _meshOwned(true)
+    : _numParticles(0), _distribution(DustDensity), _meshfile(0), _spatialOrder(false), _mesh(0), _meshOwned(true)
 {
 }
 
@@ -53,7 +54,7 @@ void VoronoiDustGridStructure::setupSelfBefore()
             }
             log->info("Computing Voronoi tesselation for " + QString::number(_numParticles)
                       + " uniformly distributed random particles...");
-            _mesh = new VoronoiMesh(rv, extent());
+            _mesh = new VoronoiMesh(rv, extent(), find<ParallelFactory>()->parallel(), _spatialOrder);
             break;
         }
     case CentralPeak:
@@ -78,7 +79,7 @@ void VoronoiDustGridStructure::setupSelfBefore()
             }
             log->info("Computing Voronoi tesselation for " + QString::number(_numParticles)
                       + " random particles distributed in a central peak...");
-            _mesh = new VoronoiMesh(rv, extent());
+            _mesh = new VoronoiMesh(rv, extent(), find<ParallelFactory>()->parallel(), _spatialOrder);
             break;
         }
     case DustDensity:
@@ -100,7 +101,7 @@ void VoronoiDustGridStructure::setupSelfBefore()
             }
             log->info("Computing Voronoi tesselation for " + QString::number(_numParticles)
                       + " random particles distributed according to dust density...");
-            _mesh = new VoronoiMesh(rv, extent());
+            _mesh = new VoronoiMesh(rv, extent(), find<ParallelFactory>()->parallel(), _spatialOrder);
             break;
         }
     case DustTesselation:
@@ -119,14 +120,15 @@ void VoronoiDustGridStructure::setupSelfBefore()
             if (!dpi) throw FATALERROR("Can't retrieve particle locations from this dust distribution");
             log->info("Computing Voronoi tesselation for " + QString::number(dpi->numParticles())
                       + " dust distribution particles...");
-            _mesh = new VoronoiMesh(dpi, extent());
+            _mesh = new VoronoiMesh(dpi, extent(), find<ParallelFactory>()->parallel(), _spatialOrder);
             break;
         }
     case File:
         {
             if (!_meshfile) throw FATALERROR("File containing particle locations is not defined");
             log->info("Computing Voronoi tesselation for particles loaded from file " + _meshfile->filename() + "...");
-            _mesh = new VoronoiMesh(_meshfile, QList<int>(), extent());
+            _mesh = new VoronoiMesh(_meshfile, QList<int>(), extent(),
+                                    find<ParallelFactory>()->parallel(), _spatialOrder);
             break;
         }
     default:
@@ -311,6 +313,21 @@ VoronoiMeshFile* VoronoiDustGridStructure::voronoiMeshFile() const
 {
     return _meshfile;
 }
+
+//////////////////////////////////////////////////////////////////////
+
+void VoronoiDustGridStructure::setSpatialOrder(bool value)
+{
+    _spatialOrder = value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool VoronoiDustGridStructure::spatialOrder() const
+{
+    return _spatialOrder;
+}
+
 //////////////////////////////////////////////////////////////////////
 
 double VoronoiDustGridStructure::xmax() const
@@ -368,3 +385,10 @@ void VoronoiDustGridStructure::path(DustGridPath* path) const
 }
 
 //////////////////////////////////////////////////////////////////////
+
+int VoronoiDustGridStructure::cellAtOutputIndex(int i) const
+{
+    return _mesh->cellIndexForParticle(i);
+}
+
+//////////////////////////////////////////////////////////////////////
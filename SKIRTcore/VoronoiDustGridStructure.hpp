@@ -69,6 +69,10 @@ class VoronoiDustGridStructure : public GenDustGridStructure, public Box
     Q_CLASSINFO("Default", "VoronoiMeshAsciiFile")
     Q_CLASSINFO("RelevantIf", "distribution")
 
+    Q_CLASSINFO("Property", "spatialOrder")
+    Q_CLASSINFO("Title", "number the cells along a space-filling curve to improve memory locality")
+    Q_CLASSINFO("Default", "no")
+
     //============= Construction - Setup - Destruction =============
 
 public:
@@ -140,6 +144,18 @@ public:
         value \em File. */
     Q_INVOKABLE VoronoiMeshFile* voronoiMeshFile() const;
 
+    /** Sets the flag that indicates whether the dust cells are numbered in the order of their
+        particles along a space-filling curve, rather than in the order in which the particles
+        were generated or loaded. Numbering neighboring cells close to each other improves memory
+        locality when tracing paths and when updating per-cell quantities. Per-cell output files
+        still list the cells in the original order. The flag is ignored when the tesselation is
+        copied from the dust distribution. The default value is false. */
+    Q_INVOKABLE void setSpatialOrder(bool value);
+
+    /** Returns the flag that indicates whether the dust cells are numbered in the order of their
+        particles along a space-filling curve. */
+    Q_INVOKABLE bool spatialOrder() const;
+
     //======================== Other Functions =======================
 
 public:
@@ -175,6 +191,11 @@ public:
         VoronoiMesh class for more information. */
     void path(DustGridPath* path) const;
 
+    /** This function returns the number of the dust cell generated by the particle with index \em
+        i in the original particle order, so that per-cell output files list the cells in that
+        order even if spatial ordering was requested. */
+    int cellAtOutputIndex(int i) const;
+
     //======================== Data Members ========================
 
 private:
@@ -182,6 +203,7 @@ private:
     int _numParticles;
     Distribution _distribution;
     VoronoiMeshFile* _meshfile;
+    bool _spatialOrder;
 
     // data members initialized during setup
     VoronoiMesh* _mesh;
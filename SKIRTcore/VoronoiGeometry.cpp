@@ -6,6 +6,7 @@
 #include "FatalError.hpp"
 #include "Log.hpp"
 #include "NR.hpp"
+#include "ParallelFactory.hpp"
 #include "Random.hpp"
 #include "VoronoiMesh.hpp"
 #include "VoronoiMeshFile.hpp"
@@ -39,7 +40,7 @@ void VoronoiGeometry::setupSelfBefore()
 
     // import the Voronoi mesh
     _mesh = new VoronoiMesh(_meshfile, QList<int>() << _densityIndex << _multiplierIndex,
-                             Box(-_xmax,-_ymax,-_zmax, _xmax,_ymax,_zmax));
+                             Box(-_xmax,-_ymax,-_zmax, _xmax,_ymax,_zmax), find<ParallelFactory>()->parallel());
     _mesh->addDensityDistribution(_densityIndex, _multiplierIndex);
     find<Log>()->info("Voronoi mesh data was successfully imported: " + QString::number(_mesh->Ncells()) + " cells.");
 
@@ -10,6 +10,8 @@
 #include "VoronoiMesh.hpp"
 #include "VoronoiMeshFile.hpp"
 #include "FatalError.hpp"
+#include "Parallel.hpp"
+#include "ParallelTarget.hpp"
 #include "Random.hpp"
 #include "container.hh"
 
@@ -19,31 +21,32 @@ using namespace std;
 
 namespace VoronoiMesh_Private
 {
-    // class to hold the information about a Voronoi cell that is relevant for calculating paths and densities
+    // class to hold the information about a Voronoi cell that is obtained from Voro++ while building the mesh;
+    // these objects are discarded once their information has been copied into the compact arrays of the mesh
     class VoronoiCell : public Box  // enclosing box
     {
     private:
-        Vec _r;                     // particle position
         Vec _c;                     // centroid position
         double _volume;             // volume
         vector<int> _neighbors;     // list of neighbor indices in cells vector
 
     public:
-        // constructor stores the specified particle position; the other data members are set to zero
-        VoronoiCell(Vec r) : _r(r), _volume(0) { }
+        // constructor sets all data members to zero
+        VoronoiCell() : _volume(0) { }
 
-        // initializes the receiver with information taken from the specified fully computed Voronoi cell
-        void init(voro::voronoicell_neighbor& cell)
+        // initializes the receiver with information taken from the specified fully computed Voronoi cell,
+        // given the position of the particle that generated the cell
+        void init(voro::voronoicell_neighbor& cell, Vec r)
         {
             // copy basic geometric info
             double cx, cy, cz;
             cell.centroid(cx,cy,cz);
-            _c = Vec(cx,cy,cz) + _r;
+            _c = Vec(cx,cy,cz) + r;
             _volume = cell.volume();
 
             // get the minimal and maximal coordinates of the box enclosing the cell
             vector<double> coords;
-            cell.vertices(_r.x(),_r.y(),_r.z(), coords);
+            cell.vertices(r.x(),r.y(),r.z(), coords);
             _xmin = DBL_MAX;  _ymin = DBL_MAX;  _zmin = DBL_MAX;
             _xmax = -DBL_MAX; _ymax = -DBL_MAX; _zmax = -DBL_MAX;
             int n = coords.size();
@@ -57,12 +60,6 @@ namespace VoronoiMesh_Private
             cell.neighbors(_neighbors);
         }
 
-        // returns the cell's particle position
-        Vec particle() const { return _r; }
-
-        // returns the squared distance from the cell's particle to the specified point
-        double squaredDistanceTo(Vec r) const { return (r-_r).norm2(); }
-
         // returns the central position in the cell
         Vec centroid() const { return _c; }
 
@@ -71,8 +68,52 @@ namespace VoronoiMesh_Private
 
         // returns a list of neighboring cell/particle ids
         const vector<int>& neighbors() { return _neighbors; }
+
+        // releases the memory held by the list of neighboring cell/particle ids
+        void releaseNeighbors() { vector<int>().swap(_neighbors); }
     };
 
+    // returns the largest float that is smaller than or equal to the specified value
+    float floatBelow(double x)
+    {
+        float f = static_cast<float>(x);
+        return f>x ? nextafter(f, -FLT_MAX) : f;
+    }
+
+    // returns the smallest float that is larger than or equal to the specified value
+    float floatAbove(double x)
+    {
+        float f = static_cast<float>(x);
+        return f<x ? nextafter(f, FLT_MAX) : f;
+    }
+
+    // returns the lower 21 bits of the specified value, spread out so that there are two zero bits between each bit
+    quint64 spreadBits(quint64 v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2)  & 0x1249249249249249ULL;
+        return v;
+    }
+
+    // returns the 21-bit integer grid coordinate corresponding to the specified position within the specified range
+    quint64 gridCoordinate(double x, double xmin, double xmax)
+    {
+        const double n = 2097152.;   // 2^21
+        return static_cast<quint64>(max(0., min(n-1., (x-xmin)/(xmax-xmin)*n)));
+    }
+
+    // returns the position of the specified point along a Morton (Z-order) curve through the specified box
+    quint64 mortonKey(Vec r, const Box& box)
+    {
+        return spreadBits(gridCoordinate(r.x(), box.xmin(), box.xmax()))
+            | (spreadBits(gridCoordinate(r.y(), box.ymin(), box.ymax())) << 1)
+            | (spreadBits(gridCoordinate(r.z(), box.zmin(), box.zmax())) << 2);
+    }
+
     // function to compare two points according to the specified axis (0,1,2)
     bool lessthan(Vec p1, Vec p2, int axis)
     {
@@ -108,14 +149,14 @@ namespace VoronoiMesh_Private
     class LessThan
     {
     private:
-        const vector<VoronoiCell*>& _cells;
+        const vector<Vec>& _particles;
         int _axis;
     public:
-        LessThan(const vector<VoronoiCell*>& cells, int depth) : _cells(cells), _axis(depth%3) { }
+        LessThan(const vector<Vec>& particles, int depth) : _particles(particles), _axis(depth%3) { }
         bool operator() (int m1, int m2)
         {
             if (m1==m2) return false;
-            return lessthan(_cells[m1]->particle(), _cells[m2]->particle(), _axis);
+            return lessthan(_particles[m1], _particles[m2], _axis);
         }
     };
 
@@ -123,7 +164,7 @@ namespace VoronoiMesh_Private
     class Node
     {
     private:
-        int _m;         // index in _cells to the particle defining the split at this node
+        int _m;         // index in _particles of the particle defining the split at this node
         int _axis;      // split axis for this node (0,1,2)
         Node* _up;      // ptr to the parent node
         Node* _left;    // ptr to the left child node
@@ -153,44 +194,44 @@ namespace VoronoiMesh_Private
         Node* right() const { return _right; }
 
         // returns the apropriate child for the specified query point
-        Node* child(Vec bfr, const vector<VoronoiCell*>& cells) const
-            { return lessthan(bfr, cells[_m]->particle(), _axis) ? _left : _right; }
+        Node* child(Vec bfr, const vector<Vec>& particles) const
+            { return lessthan(bfr, particles[_m], _axis) ? _left : _right; }
 
         // returns the other child than the one that would be apropriate for the specified query point
-        Node* otherChild(Vec bfr, const vector<VoronoiCell*>& cells) const
-            { return lessthan(bfr, cells[_m]->particle(), _axis) ? _right : _left; }
+        Node* otherChild(Vec bfr, const vector<Vec>& particles) const
+            { return lessthan(bfr, particles[_m], _axis) ? _right : _left; }
 
         // returns the squared distance from the query point to the split plane
-        double squaredDistanceToSplitPlane(Vec bfr, const vector<VoronoiCell*>& cells) const
+        double squaredDistanceToSplitPlane(Vec bfr, const vector<Vec>& particles) const
         {
             switch (_axis)
             {
             case 0:  // split on x
-                return sqr(cells[_m]->particle().x() - bfr.x());
+                return sqr(particles[_m].x() - bfr.x());
             case 1:  // split on y
-                return sqr(cells[_m]->particle().y() - bfr.y());
+                return sqr(particles[_m].y() - bfr.y());
             case 2:  // split on z
-                return sqr(cells[_m]->particle().z() - bfr.z());
+                return sqr(particles[_m].z() - bfr.z());
             default: // this should never happen
                 return 0;
             }
         }
 
         // returns the node in this subtree that represents the particle nearest to the query point
-        Node* nearest(Vec bfr, const vector<VoronoiCell*>& cells)
+        Node* nearest(Vec bfr, const vector<Vec>& particles)
         {
             // recursively descend the tree until a leaf node is reached, going left or right depending on
             // whether the specified point is less than or greater than the current node in the split dimension
             Node* current = this;
-            while (Node* child = current->child(bfr, cells)) current = child;
+            while (Node* child = current->child(bfr, particles)) current = child;
 
             // unwind the recursion, looking for the nearest node while climbing up
             Node* best = current;
-            double bestSD = cells[best->m()]->squaredDistanceTo(bfr);
+            double bestSD = (bfr-particles[best->m()]).norm2();
             while (true)
             {
                 // if the current node is closer than the current best, then it becomes the current best
-                double currentSD = cells[current->m()]->squaredDistanceTo(bfr);
+                double currentSD = (bfr-particles[current->m()]).norm2();
                 if (currentSD < bestSD)
                 {
                     best = current;
@@ -199,16 +240,16 @@ namespace VoronoiMesh_Private
 
                 // if there could be points on the other side of the splitting plane for the current node
                 // that are closer to the search point than the current best, then ...
-                double splitSD = current->squaredDistanceToSplitPlane(bfr, cells);
+                double splitSD = current->squaredDistanceToSplitPlane(bfr, particles);
                 if (splitSD < bestSD)
                 {
                     // move down the other branch of the tree from the current node looking for closer points,
                     // following the same recursive process as the entire search
-                    Node* other = current->otherChild(bfr, cells);
+                    Node* other = current->otherChild(bfr, particles);
                     if (other)
                     {
-                        Node* otherBest = other->nearest(bfr, cells);
-                        double otherBestSD = cells[otherBest->m()]->squaredDistanceTo(bfr);
+                        Node* otherBest = other->nearest(bfr, particles);
+                        double otherBestSD = (bfr-particles[otherBest->m()]).norm2();
                         if (otherBestSD < bestSD)
                         {
                             best = otherBest;
@@ -224,14 +265,111 @@ namespace VoronoiMesh_Private
             return best;
         }
     };
+
+    // class to compute the Voronoi cells in a number of slabs along the x-axis, using a separate Voro++ container
+    // for each slab so that the slabs can be processed in parallel; each container holds the particles in the slab
+    // plus a margin of particles on either side; a cell is accepted only if its security sphere (with twice the
+    // maximum vertex distance as radius) does not reach an artificial container wall, because only then is the cell
+    // guaranteed to be identical to the cell in the full tesselation; the other cells are recorded for recalculation
+    class SlabCalculator : public ParallelTarget
+    {
+    private:
+        const vector<Vec>& _particles;
+        vector<VoronoiCell>& _cells;
+        const Box& _extent;
+        int _nb;
+        int _numSlabs;
+        int _margin;
+        vector< pair<double,int> > _sorted;     // x-coordinate and index of each particle, sorted on x
+        vector< vector<int> > _failedv;         // for each slab, the indices of the cells not accepted
+
+    public:
+        // constructor sorts the particles on x and determines the number of slabs and the margin size; the number
+        // of slabs depends solely on the number of particles so that the result is independent of the thread count
+        SlabCalculator(const vector<Vec>& particles, vector<VoronoiCell>& cells, const Box& extent, int nb)
+            : _particles(particles), _cells(cells), _extent(extent), _nb(nb)
+        {
+            int n = particles.size();
+            _margin = static_cast<int>(3.*pow(n,2./3.));
+            _numSlabs = max(1, min(64, n/max(1,4*_margin)));
+            _failedv.resize(_numSlabs);
+            _sorted.resize(n);
+            for (int m=0; m<n; m++) _sorted[m] = make_pair(particles[m].x(), m);
+            sort(_sorted.begin(), _sorted.end());
+        }
+
+        // returns the number of slabs
+        int numSlabs() const { return _numSlabs; }
+
+        // computes the cells for the particles in the slab with the specified index
+        void body(size_t index)
+        {
+            int s = index;
+            int n = _sorted.size();
+            int begin = static_cast<int>(static_cast<qint64>(n)*s/_numSlabs);
+            int end = static_cast<int>(static_cast<qint64>(n)*(s+1)/_numSlabs);
+            int lo = max(0, begin-_margin);
+            int hi = min(n, end+_margin);
+
+            // determine the container walls along x, halfway between the first excluded particles and the
+            // particles in the container, or on the domain walls if there are no excluded particles on that side
+            double xa = lo==0 ? _extent.xmin() : 0.5*(_sorted[lo-1].first+_sorted[lo].first);
+            double xb = hi==n ? _extent.xmax() : 0.5*(_sorted[hi-1].first+_sorted[hi].first);
+            vector<int>& failed = _failedv[s];
+            if (xb <= xa)
+            {
+                for (int i=begin; i<end; i++) failed.push_back(_sorted[i].second);
+                return;
+            }
+
+            // add the particles to the container, recording the order of the particles in the slab itself;
+            // a particle in the slab that lies on the upper container wall would be discarded by the container
+            int nx = max(1, static_cast<int>(_nb*(xb-xa)/_extent.xwidth()+0.5));
+            voro::container con(xa, xb, _extent.ymin(), _extent.ymax(), _extent.zmin(), _extent.zmax(),
+                                nx, _nb, _nb, false,false,false, 8);
+            voro::particle_order po;
+            for (int i=lo; i<hi; i++)
+            {
+                int m = _sorted[i].second;
+                Vec r = _particles[m];
+                if (i<begin || i>=end) con.put(m, r.x(),r.y(),r.z());
+                else if (hi<n && r.x()>=xb) failed.push_back(m);
+                else con.put(po, m, r.x(),r.y(),r.z());
+            }
+
+            // compute the cells for the particles in the slab
+            voro::c_loop_order loop(con, po);
+            if (loop.start()) do
+            {
+                voro::voronoicell_neighbor fullcell;
+                bool ok = con.compute_cell(fullcell, loop);
+                double x = loop.x();
+                double security = ok ? sqrt(fullcell.max_radius_squared()) : 0.;
+                if (ok && (lo==0 || x-security > xa) && (hi==n || x+security < xb))
+                    _cells[loop.pid()].init(fullcell, _particles[loop.pid()]);
+                else
+                    failed.push_back(loop.pid());
+            }
+            while (loop.inc());
+        }
+
+        // returns the indices of the cells that were not accepted, in order of slab
+        vector<int> failed() const
+        {
+            vector<int> result;
+            for (int s=0; s<_numSlabs; s++) result.insert(result.end(), _failedv[s].begin(), _failedv[s].end());
+            return result;
+        }
+    };
 }
 
 using namespace VoronoiMesh_Private;
 
 ////////////////////////////////////////////////////////////////////
 
-VoronoiMesh::VoronoiMesh(VoronoiMeshFile* meshfile, QList<int> fieldIndices, const Box& extent)
-    : _extent(extent), _eps(1e-12 * extent.widths().norm()),
+VoronoiMesh::VoronoiMesh(VoronoiMeshFile* meshfile, QList<int> fieldIndices, const Box& extent,
+                         Parallel* parallel, bool spatialOrder)
+    : _extent(extent), _eps(1e-12 * extent.widths().norm()), _Nfields(0),
       _Ndistribs(0), _integratedDensity(0)
 {
     // create a list of indices (g) without duplicates, ignoring negative values
@@ -246,8 +384,8 @@ VoronoiMesh::VoronoiMesh(VoronoiMeshFile* meshfile, QList<int> fieldIndices, con
         }
     }
 
-    // reserve room for the required number of fields
-    _fieldvalues.resize(uniqueIndices.size());
+    // remember the number of fields
+    _Nfields = uniqueIndices.size();
 
     // read the particle records from the file, filling a temporary list of particle locations
     // and copying any required field values
@@ -263,33 +401,39 @@ VoronoiMesh::VoronoiMesh(VoronoiMeshFile* meshfile, QList<int> fieldIndices, con
             particles.push_back(r);
 
             // get and store the column values
-            int s = 0;
             foreach (int g, uniqueIndices)
             {
-                _fieldvalues[s++].push_back(meshfile->value(g));
+                _fieldvalues.push_back(meshfile->value(g));
             }
         }
     }
     meshfile->close();
 
     // construct the Voronoi tesselation
-    buildMesh(particles);
+    if (spatialOrder) sortSpatially(particles);
+    buildMesh(particles, parallel);
 }
 
 ////////////////////////////////////////////////////////////////////
 
-VoronoiMesh::VoronoiMesh(const std::vector<Vec> &particles, const Box &extent)
-    : _extent(extent), _eps(1e-12 * extent.widths().norm()),
+VoronoiMesh::VoronoiMesh(const std::vector<Vec> &particles, const Box &extent, Parallel* parallel, bool spatialOrder)
+    : _extent(extent), _eps(1e-12 * extent.widths().norm()), _Nfields(0),
       _Ndistribs(0), _integratedDensity(0)
 {
     // construct the Voronoi tesselation
-    buildMesh(particles);
+    if (spatialOrder)
+    {
+        vector<Vec> sorted(particles);
+        sortSpatially(sorted);
+        buildMesh(sorted, parallel);
+    }
+    else buildMesh(particles, parallel);
 }
 
 ////////////////////////////////////////////////////////////////////
 
-VoronoiMesh::VoronoiMesh(DustParticleInterface *dpi, const Box &extent)
-    : _extent(extent), _eps(1e-12 * extent.widths().norm()),
+VoronoiMesh::VoronoiMesh(DustParticleInterface *dpi, const Box &extent, Parallel* parallel, bool spatialOrder)
+    : _extent(extent), _eps(1e-12 * extent.widths().norm()), _Nfields(0),
       _Ndistribs(0), _integratedDensity(0)
 {
     // copy the particle locations into a temporary vector
@@ -302,12 +446,38 @@ VoronoiMesh::VoronoiMesh(DustParticleInterface *dpi, const Box &extent)
     }
 
     // construct the Voronoi tesselation
-    buildMesh(particles);
+    if (spatialOrder) sortSpatially(particles);
+    buildMesh(particles, parallel);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void VoronoiMesh::sortSpatially(std::vector<Vec>& particles)
+{
+    // sort the particle indices on their position along the Morton curve; ties are broken on index
+    int n = particles.size();
+    vector< pair<quint64,int> > keys(n);
+    for (int i=0; i<n; i++) keys[i] = make_pair(mortonKey(particles[i], _extent), i);
+    sort(keys.begin(), keys.end());
+
+    // apply the permutation to the particles and to the field values, remembering the new index of each particle
+    vector<Vec> sorted(n);
+    vector<double> fieldvalues(_fieldvalues.size());
+    _cellindices.resize(n);
+    for (int m=0; m<n; m++)
+    {
+        int i = keys[m].second;
+        _cellindices[i] = m;
+        sorted[m] = particles[i];
+        for (int s=0; s<_Nfields; s++) fieldvalues[m*_Nfields+s] = _fieldvalues[i*_Nfields+s];
+    }
+    particles.swap(sorted);
+    _fieldvalues.swap(fieldvalues);
 }
 
 ////////////////////////////////////////////////////////////////////
 
-void VoronoiMesh::buildMesh(const std::vector<Vec>& particles)
+void VoronoiMesh::buildMesh(const std::vector<Vec>& particles, Parallel* parallel)
 {
     // Cache some often used values
     _Ncells = particles.size();
@@ -315,63 +485,97 @@ void VoronoiMesh::buildMesh(const std::vector<Vec>& particles)
     _nb2 = _nb*_nb;
     _nb3 = _nb*_nb*_nb;
 
-    // Initialize the vector that will hold pointers to the cell objects that will stay around,
-    // using the serial number of the cell as index in the vector
-    _cells.resize(_Ncells);
+    // Initialize a temporary vector of cell objects, using the serial number of the cell as index in the vector
+    vector<VoronoiCell> cells(_Ncells);
+
+    // Compute the cells slab by slab in separate Voronoi containers, extracting and copying
+    // the relevant information to our temporary cell objects
+    SlabCalculator calculator(particles, cells, _extent, _nb);
+    if (parallel) parallel->call(&calculator, calculator.numSlabs());
+    else for (int s=0; s<calculator.numSlabs(); s++) calculator.body(s);
+
+    // Compute the cells that could not be verified within their slab in a temporary Voronoi container
+    // holding all particles, using the serial number of the cell as particle ID
+    vector<int> failed = calculator.failed();
+    if (!failed.empty())
+    {
+        vector<bool> isfailed(_Ncells);
+        for (unsigned int i=0; i<failed.size(); i++) isfailed[failed[i]] = true;
+
+        voro::container con(_extent.xmin(), _extent.xmax(), _extent.ymin(), _extent.ymax(), _extent.zmin(), _extent.zmax(),
+                            _nb, _nb, _nb, false,false,false, 8);
+        voro::particle_order po;
+        for (int m=0; m<_Ncells; m++)
+        {
+            Vec r = particles[m];
+            if (isfailed[m]) con.put(po, m, r.x(),r.y(),r.z());
+            else con.put(m, r.x(),r.y(),r.z());
+        }
+
+        voro::c_loop_order loop(con, po);
+        if (loop.start()) do
+        {
+            voro::voronoicell_neighbor fullcell;
+            bool ok = con.compute_cell(fullcell, loop);
+            if (!ok) throw FATALERROR("Can't compute Voronoi cell " + QString::number(loop.pid()));
+            cells[loop.pid()].init(fullcell, particles[loop.pid()]);
+        }
+        while (loop.inc());
+    }
 
-    // Add the specified particles to our cell vector AND to a temporary Voronoi container,
-    // using the serial number of the cell as particle ID
-    voro::container con(_extent.xmin(), _extent.xmax(), _extent.ymin(), _extent.ymax(), _extent.zmin(), _extent.zmax(),
-                        _nb, _nb, _nb, false,false,false, 8);
+    // Copy the information that stays around into compact arrays indexed on cell number;
+    // the bounding boxes are stored in single precision, rounded outwards
+    _particles = particles;
+    _centroids.resize(_Ncells);
+    _volumes.resize(_Ncells);
+    _boxes.resize(6*_Ncells);
     for (int m=0; m<_Ncells; m++)
     {
-        Vec r = particles[m];
-        _cells[m] = new VoronoiCell(r);  // these objects will be deleted by the destructor
-        con.put(m, r.x(),r.y(),r.z());
+        const VoronoiCell& cell = cells[m];
+        _centroids[m] = cell.centroid();
+        _volumes[m] = cell.volume();
+        _boxes[6*m]   = floatBelow(cell.xmin());
+        _boxes[6*m+1] = floatBelow(cell.ymin());
+        _boxes[6*m+2] = floatBelow(cell.zmin());
+        _boxes[6*m+3] = floatAbove(cell.xmax());
+        _boxes[6*m+4] = floatAbove(cell.ymax());
+        _boxes[6*m+5] = floatAbove(cell.zmax());
     }
 
-    // Initialize a vector of nb x nb x nb lists, each containing the cells overlapping a certain block in the domain
+    // Initialize a vector of nb x nb x nb lists, each containing the cells overlapping a certain block in the domain,
+    // and add each cell to the lists for all blocks it may overlap
+    // --> a precise intersection test is really slow and doesn't substantially accelerate whichcell()
     _blocklists.resize(_nb3);
-
-    // For each particle:
-    //   - compute the corresponding cell in the Voronoi tesselation
-    //   - extract and copy the relevant information to one of our own cell objects
-    //   - store the cell object in the vector indexed on cell number
-    //   - add the cell object to the lists for all blocks it overlaps
-    voro::c_loop_all loop(con);
-    if (loop.start()) do
-    {
-        // Compute the cell
-        voro::voronoicell_neighbor fullcell;
-        bool ok = con.compute_cell(fullcell, loop);
-        if (!ok) throw FATALERROR("Can't compute Voronoi cell " + QString::number(loop.pid()));
-
-        // Copy all relevant information to the cell object that will stay around
-        VoronoiCell* cell = _cells[loop.pid()];
-        cell->init(fullcell);
-
-        // Add the cell object to the lists for all blocks it may overlap
-        // --> a precise intersection test is really slow and doesn't substantially accelerate whichcell()
+    for (int m=0; m<_Ncells; m++)
+    {
+        Box box = extent(m);
         int i1,j1,k1, i2,j2,k2;
-        _extent.cellindices(i1,j1,k1, cell->rmin()-Vec(_eps,_eps,_eps), _nb,_nb,_nb);
-        _extent.cellindices(i2,j2,k2, cell->rmax()+Vec(_eps,_eps,_eps), _nb,_nb,_nb);
+        _extent.cellindices(i1,j1,k1, box.rmin()-Vec(_eps,_eps,_eps), _nb,_nb,_nb);
+        _extent.cellindices(i2,j2,k2, box.rmax()+Vec(_eps,_eps,_eps), _nb,_nb,_nb);
         for (int i=i1; i<=i2; i++)
             for (int j=j1; j<=j2; j++)
                 for (int k=k1; k<=k2; k++)
-                    _blocklists[i*_nb2+j*_nb+k].push_back(loop.pid());
+                    _blocklists[i*_nb2+j*_nb+k].push_back(m);
     }
-    while (loop.inc());
 
     // for each block that contains more than a predefined number of cells,
     // construct a search tree on the particle locations of the cells
     _blocktrees.resize(_nb3);
-    for (int b = 0; b<_nb3; b++)
+    if (parallel) parallel->call(this, &VoronoiMesh::buildBlockTree, _nb3);
+    else for (int b=0; b<_nb3; b++) buildBlockTree(b);
+
+    // build the flat neighbor table used for path construction, releasing the temporary neighbor lists
+    buildNeighbors(cells);
+}
+
+////////////////////////////////////////////////////////////////////
+
+void VoronoiMesh::buildBlockTree(size_t b)
+{
+    vector<int>& ids = _blocklists[b];
+    if (ids.size() > 5)
     {
-        vector<int>& ids = _blocklists[b];
-        if (ids.size() > 5)
-        {
-            _blocktrees[b] = buildTree(ids.begin(), ids.end(), 0);
-        }
+        _blocktrees[b] = buildTree(ids.begin(), ids.end(), 0);
     }
 }
 
@@ -382,7 +586,7 @@ Node* VoronoiMesh::buildTree(vector<int>::iterator first, vector<int>::iterator
     size_t length = last-first;
     if (length>0)
     {
-        LessThan compare(_cells, depth);
+        LessThan compare(_particles, depth);
         size_t median = length >> 1;
         nth_element(first, first+median, last, compare);
         return new Node(*(first+median), depth,
@@ -394,6 +598,58 @@ Node* VoronoiMesh::buildTree(vector<int>::iterator first, vector<int>::iterator
 
 ////////////////////////////////////////////////////////////////////
 
+void VoronoiMesh::buildNeighbors(vector<VoronoiCell>& cells)
+{
+    // determine the index of the first neighbor for each cell
+    _neighborbegin.resize(_Ncells+1);
+    _neighborbegin[0] = 0;
+    for (int m=0; m<_Ncells; m++) _neighborbegin[m+1] = _neighborbegin[m] + cells[m].neighbors().size();
+
+    // copy the neighbor indices and calculate the plane of the corresponding faces
+    _neighbors.resize(_neighborbegin[_Ncells]);
+    _planes.resize(_neighborbegin[_Ncells]);
+    for (int m=0; m<_Ncells; m++)
+    {
+        Vec pr = _particles[m];
+        const vector<int>& mv = cells[m].neighbors();
+        int n = mv.size();
+        for (int i=0; i<n; i++)
+        {
+            int mi = mv[i];
+            Vec normal;
+            double d;
+            if (mi>=0)
+            {
+                Vec pi = _particles[mi];
+                normal = pi - pr;
+                d = Vec::dot(normal, 0.5*(pi+pr));
+            }
+            else
+            {
+                switch (mi)
+                {
+                case -1: normal = Vec(-1,0,0); d = -_extent.xmin(); break;
+                case -2: normal = Vec( 1,0,0); d =  _extent.xmax(); break;
+                case -3: normal = Vec(0,-1,0); d = -_extent.ymin(); break;
+                case -4: normal = Vec(0, 1,0); d =  _extent.ymax(); break;
+                case -5: normal = Vec(0,0,-1); d = -_extent.zmin(); break;
+                case -6: normal = Vec(0,0, 1); d =  _extent.zmax(); break;
+                default: throw FATALERROR("Invalid neighbor ID");
+                }
+            }
+            _neighbors[_neighborbegin[m]+i] = mi;
+            Plane& plane = _planes[_neighborbegin[m]+i];
+            plane.nx = normal.x();
+            plane.ny = normal.y();
+            plane.nz = normal.z();
+            plane.d = d;
+        }
+        cells[m].releaseNeighbors();
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
 void VoronoiMesh::addDensityDistribution(int densityField, int densityMultiplierField, double densityFraction)
 {
     // verify indices
@@ -415,17 +671,25 @@ void VoronoiMesh::addDensityDistribution(int densityField, int densityMultiplier
     // update the integrated density (ignore cells with negative density)
     for (int m=0; m<_Ncells; m++)
     {
-        double density = _fieldvalues[densityField][m] * densityFraction;
-        if (densityMultiplierField >= 0) density *= _fieldvalues[densityMultiplierField][m];
-        if (density > 0) _integratedDensity += density*_cells[m]->volume();
+        double density = _fieldvalues[m*_Nfields+densityField] * densityFraction;
+        if (densityMultiplierField >= 0) density *= _fieldvalues[m*_Nfields+densityMultiplierField];
+        if (density > 0) _integratedDensity += density*_volumes[m];
     }
 }
 
 ////////////////////////////////////////////////////////////////////
 
+void VoronoiMesh::discardFieldValues()
+{
+    vector<double>().swap(_fieldvalues);
+    _storageIndices.clear();
+    _Nfields = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+
 VoronoiMesh::~VoronoiMesh()
 {
-    for (int m=0; m<_Ncells; m++) delete _cells[m];
     for (int b=0; b<_nb3; b++) delete _blocktrees[b];
 }
 
@@ -445,7 +709,7 @@ void VoronoiMesh::neighborStatistics(double &average, int &minimum, int &maximum
     qint64 totalNeighbors = 0;
     for (int m=0; m<_Ncells; m++)
     {
-        int ns = _cells[m]->neighbors().size();
+        int ns = _neighborbegin[m+1] - _neighborbegin[m];
         totalNeighbors += ns;
         minNeighbors = min(minNeighbors, ns);
         maxNeighbors = max(maxNeighbors, ns);
@@ -518,7 +782,7 @@ int VoronoiMesh::cellIndex(Position bfr) const
 
     // look for the closest particle in this block, using the search tree if there is one
     Node* tree = _blocktrees[b];
-    if (tree) return tree->nearest(bfr,_cells)->m();
+    if (tree) return tree->nearest(bfr,_particles)->m();
 
     // if there is no search tree, simply loop over the index list
     const vector<int>& ids = _blocklists[b];
@@ -527,7 +791,7 @@ int VoronoiMesh::cellIndex(Position bfr) const
     int n = ids.size();
     for (int i=0; i<n; i++)
     {
-        double idist = _cells[ids[i]]->squaredDistanceTo(bfr);
+        double idist = (bfr-_particles[ids[i]]).norm2();
         if (idist < mdist)
         {
             m = ids[i];
@@ -539,6 +803,14 @@ int VoronoiMesh::cellIndex(Position bfr) const
 
 ////////////////////////////////////////////////////////////////////
 
+int VoronoiMesh::cellIndexForParticle(int i) const
+{
+    if (i < 0 || i >= _Ncells) throw FATALERROR("Particle index out of range: " + QString::number(i));
+    return _cellindices.empty() ? i : _cellindices[i];
+}
+
+////////////////////////////////////////////////////////////////////
+
 double VoronoiMesh::volume() const
 {
     return _extent.volume();
@@ -549,7 +821,7 @@ double VoronoiMesh::volume() const
 double VoronoiMesh::volume(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return _cells[m]->volume();
+    return _volumes[m];
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -564,7 +836,8 @@ Box VoronoiMesh::extent() const
 Box VoronoiMesh::extent(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return _cells[m]->extent();
+    const float* box = &_boxes[6*m];
+    return Box(box[0], box[1], box[2], box[3], box[4], box[5]);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -572,7 +845,7 @@ Box VoronoiMesh::extent(int m) const
 Position VoronoiMesh::particlePosition(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return Position(_cells[m]->particle());
+    return Position(_particles[m]);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -580,7 +853,7 @@ Position VoronoiMesh::particlePosition(int m) const
 Position VoronoiMesh::centralPosition(int m) const
 {
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return Position(_cells[m]->centroid());
+    return Position(_centroids[m]);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -590,26 +863,27 @@ Position VoronoiMesh::randomPosition(Random* random, int m) const
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
 
     // get loop-invariant information about the cell
-    const Box& box = _cells[m]->extent();
-    const vector<int>& neighbors = _cells[m]->neighbors();
+    Box box = extent(m);
 
     // generate random points in the enclosing box until one happens to be inside the cell
     for (int i=0; i<10000; i++)
     {
         Vec r = random->position(box);
-        if (isPointClosestTo(r, m, neighbors)) return Position(r);
+        if (isPointClosestToNeighbors(r, m)) return Position(r);
     }
     throw FATALERROR("Can't find random position in cell");
 }
 
 //////////////////////////////////////////////////////////////////////
 
-bool VoronoiMesh::isPointClosestTo(Vec r, int m, const vector<int>& ids) const
+bool VoronoiMesh::isPointClosestToNeighbors(Vec r, int m) const
 {
-    double target = _cells[m]->squaredDistanceTo(r);
-    foreach (int id, ids)
+    double target = (r-_particles[m]).norm2();
+    int end = _neighborbegin[m+1];
+    for (int i=_neighborbegin[m]; i<end; i++)
     {
-        if (id>=0 && _cells[id]->squaredDistanceTo(r) < target) return false;
+        int id = _neighbors[i];
+        if (id>=0 && (r-_particles[id]).norm2() < target) return false;
     }
     return true;
 }
@@ -621,7 +895,7 @@ double VoronoiMesh::value(int g, int m) const
     int s = _storageIndices.value(g, -1);
     if (s < 0) throw FATALERROR("Field index out of range: " + QString::number(g));
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
-    return _fieldvalues[s][m];
+    return _fieldvalues[m*_Nfields+s];
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -631,7 +905,7 @@ double VoronoiMesh::value(int g, Position bfr) const
     int s = _storageIndices.value(g, -1);
     if (s < 0) throw FATALERROR("Field index out of range: " + QString::number(g));
     int m = cellIndex(bfr);
-    return m>=0 ? _fieldvalues[s][m] : 0;
+    return m>=0 ? _fieldvalues[m*_Nfields+s] : 0;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -639,11 +913,12 @@ double VoronoiMesh::value(int g, Position bfr) const
 double VoronoiMesh::density(int h, int m) const
 {
     if (!_integratedDensity) throw FATALERROR("There is no density field");
+    if (!_Nfields) throw FATALERROR("The field values have been discarded");
     if (h < 0 || h >= _Ndistribs) throw FATALERROR("Density distribution index out of range: " + QString::number(h));
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
 
-    double density = _fieldvalues[_densityFields[h]][m] * _densityFractions[h];
-    if (_densityMultiplierFields[h] >= 0) density *= _fieldvalues[_densityMultiplierFields[h]][m];
+    double density = _fieldvalues[m*_Nfields+_densityFields[h]] * _densityFractions[h];
+    if (_densityMultiplierFields[h] >= 0) density *= _fieldvalues[m*_Nfields+_densityMultiplierFields[h]];
     return density > 0 ? density : 0;
 }
 
@@ -660,13 +935,14 @@ double VoronoiMesh::density(int h, Position bfr) const
 double VoronoiMesh::density(int m) const
 {
     if (!_integratedDensity) throw FATALERROR("There is no density field");
+    if (!_Nfields) throw FATALERROR("The field values have been discarded");
     if (m < 0 || m >= _Ncells) throw FATALERROR("Cell index out of range: " + QString::number(m));
 
     double result = 0;
     for (int h=0; h<_Ndistribs; h++)
     {
-        double density = _fieldvalues[_densityFields[h]][m] * _densityFractions[h];
-        if (_densityMultiplierFields[h] >= 0) density *= _fieldvalues[_densityMultiplierFields[h]][m];
+        double density = _fieldvalues[m*_Nfields+_densityFields[h]] * _densityFractions[h];
+        if (_densityMultiplierFields[h] >= 0) density *= _fieldvalues[m*_Nfields+_densityMultiplierFields[h]];
         if (density > 0) result += density;
     }
     return result;
@@ -748,71 +1024,42 @@ void VoronoiMesh::path(DustGridPath* path) const
     int mr = cellIndex(r);
     if (mr<0) return path->clear();
 
+    // Cache the direction components
+    double kx = bfk.x();
+    double ky = bfk.y();
+    double kz = bfk.z();
+
     // Start the loop over cells/path segments until we leave the grid
     while (mr>=0)
     {
-        // get the particle position for this cell
-        Vec pr = _cells[mr]->particle();
-
         // initialize the smallest nonnegative intersection distance and corresponding index
         double sq = DBL_MAX;          // very large, but not infinity (so that infinite si values are discarded)
         const int NO_INDEX = -99;     // meaningless cell index
         int mq = NO_INDEX;
 
-        // loop over the list of neighbor indices
-        const vector<int>& mv = _cells[mr]->neighbors();
-        int n = mv.size();
-        for (int i=0; i<n; i++)
+        // loop over the faces of the current cell (neighboring cells and domain walls alike)
+        double rx = r.x();
+        double ry = r.y();
+        double rz = r.z();
+        int begin = _neighborbegin[mr];
+        int end = _neighborbegin[mr+1];
+        const Plane* planes = &_planes[0];
+        for (int i=begin; i<end; i++)
         {
-            int mi = mv[i];
-
-            // declare the intersection distance for this neighbor (init to a value that will be rejected)
-            double si = 0;
-
-            // --- intersection with neighboring cell
-            if (mi>=0)
-            {
-                // get the particle position for this neighbor
-                Vec pi = _cells[mi]->particle();
-
-                // calculate the (unnormalized) normal on the bisecting plane
-                Vec n = pi - pr;
-
-                // calculate the denominator of the intersection quotient
-                double ndotk = Vec::dot(n,bfk);
-
-                // if the denominator is negative the intersection distance is negative, so don't calculate it
-                if (ndotk > 0)
-                {
-                    // calculate a point on the bisecting plane
-                    Vec p = 0.5 * (pi + pr);
-
-                    // calculate the intersection distance
-                    si = Vec::dot(n,p-r) / ndotk;
-                }
-            }
-
-            // --- intersection with domain wall
-            else
+            // calculate the denominator of the intersection quotient;
+            // if it is not positive the intersection distance is negative, so don't calculate it
+            const Plane& plane = planes[i];
+            double ndotk = plane.nx*kx + plane.ny*ky + plane.nz*kz;
+            if (ndotk > 0)
             {
-                switch (mi)
+                // calculate the intersection distance, and remember the smallest nonnegative one
+                double si = (plane.d - (plane.nx*rx + plane.ny*ry + plane.nz*rz)) / ndotk;
+                if (si > 0 && si < sq)
                 {
-                case -1: si = (extent().xmin()-r.x())/bfk.x(); break;
-                case -2: si = (extent().xmax()-r.x())/bfk.x(); break;
-                case -3: si = (extent().ymin()-r.y())/bfk.y(); break;
-                case -4: si = (extent().ymax()-r.y())/bfk.y(); break;
-                case -5: si = (extent().zmin()-r.z())/bfk.z(); break;
-                case -6: si = (extent().zmax()-r.z())/bfk.z(); break;
-                default: throw FATALERROR("Invalid neighbor ID");
+                    sq = si;
+                    mq = _neighbors[i];
                 }
             }
-
-            // remember the smallest nonnegative intersection point
-            if (si > 0 && si < sq)
-            {
-                sq = si;
-                mq = mi;
-            }
         }
 
         // if no exit point was found, advance the current point by small distance and recalculate cell index
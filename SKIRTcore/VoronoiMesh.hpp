@@ -13,6 +13,7 @@
 #include "Position.hpp"
 class DustGridPath;
 class DustParticleInterface;
+class Parallel;
 class Random;
 class VoronoiMeshFile;
 namespace VoronoiMesh_Private { class VoronoiCell; class Node; }
@@ -60,22 +61,39 @@ public:
         variables in the file are ignored. The indices may be specified in any order, and the same
         index may be specified more than once. Negative values are ignored. The last argument \em
         extent specifies the extent of the domain as a box lined up with the coordinate axes.
-        Any particles located outside of the domain are discarded. */
-    VoronoiMesh(VoronoiMeshFile* meshfile, QList<int> fieldIndices, const Box& extent);
+        Any particles located outside of the domain are discarded. If a Parallel instance is
+        specified, it is used to construct the Voronoi tesselation in parallel (see buildMesh()).
+        If \em spatialOrder is true, the cells are numbered in the order of their particles along
+        a space-filling curve rather than in the order in which the particles were provided (see
+        sortSpatially()). */
+    VoronoiMesh(VoronoiMeshFile* meshfile, QList<int> fieldIndices, const Box& extent,
+                Parallel* parallel = 0, bool spatialOrder = false);
 
     /** This constructor obtains the particle coordinates from a DustParticleInterface instance.
         There are no field values associated with the particles. The last argument \em extent
         specifies the extent of the domain as a box lined up with the coordinate axes.
-        Any particles located outside of the domain are discarded. */
-    VoronoiMesh(DustParticleInterface* dpi, const Box& extent);
+        Any particles located outside of the domain are discarded. The optional arguments are used
+        as described for the first constructor. */
+    VoronoiMesh(DustParticleInterface* dpi, const Box& extent, Parallel* parallel = 0, bool spatialOrder = false);
 
     /** This constructor uses the particle coordinates specified as a vector. There are no field
         values associated with the particles. The last argument \em extent specifies the extent of
         the domain as a box lined up with the coordinate axes. The specified particle locations
-        are assumed to be inside the domain; no check is performed. */
-    VoronoiMesh(const std::vector<Vec>& particles, const Box& extent);
+        are assumed to be inside the domain; no check is performed. The optional arguments are used
+        as described for the first constructor. */
+    VoronoiMesh(const std::vector<Vec>& particles, const Box& extent, Parallel* parallel = 0,
+                bool spatialOrder = false);
 
 private:
+    /** This private function is called from the constructors when spatial ordering is requested,
+        before the tesselation is built. It sorts the specified particles on their position along a
+        Morton (Z-order) curve through the domain, so that cells close to each other in space are
+        usually also close to each other in memory. This reduces cache misses when tracing paths and
+        when processing per-cell data in other parts of the code. The field values (if any) are
+        permuted accordingly, and the new index of each particle is remembered so that clients can
+        still refer to cells in the original order through cellIndexForParticle(). */
+    void sortSpatially(std::vector<Vec>& particles);
+
     /** This private function is called from each constructor. Given a list of generating
         particles, it actually builds the Voronoi tesselation and stores the corresponding list of
         cells including any properties relevant for supporting the interrogation capabilities
@@ -83,11 +101,26 @@ private:
         discarded.
 
         The function performs the following steps:
-         - add the particles to a Voro++ container, and compute the Voronoi cells one by one;
+         - divide the domain in slabs along the x-axis, each holding the same number of particles;
+           add the particles of each slab, plus a margin of particles on either side, to a separate
+           Voro++ container, and compute the Voronoi cells of the particles in the slab one by one;
          - copy the relevant cell information (such as the list of neighboring cells) from the
            Voro++ data structures into our own;
+         - compute any cells that could not be verified within their slab (see below) in a Voro++
+           container holding all particles;
          - build a data structure that allows fast retrieval of a list of the Voronoi cells
-           possibly overlapping a given point in the domain (see below).
+           possibly overlapping a given point in the domain (see below);
+         - build the flat neighbor and face plane tables used by the path() function (see
+           buildNeighbors()).
+
+        The information that stays around after construction is kept in a structure-of-arrays
+        layout indexed on cell number: particle positions, centroids and volumes in double
+        precision, and bounding boxes in single precision (rounded outwards so that each box still
+        encloses its cell). The neighbor lists are stored in compressed row form, i.e. one flat
+        array with the neighbor indices of all cells and one array of offsets per cell, along with
+        a flat array holding the plane of the cell face corresponding to each neighbor. The
+        per-cell objects holding the information extracted from Voro++ are discarded at the end of
+        construction.
 
         To accelerate operation of the cellIndex() function, which is called quite frequently, the
         domain is partitioned yet again, this time using a linear cubodial grid. The cells in this
@@ -102,12 +135,38 @@ private:
         To further reduce the search time within blocks that overlaps with a large number of cells,
         this function builds a binary search tree on the cell particle locations for those blocks
         (see for example <a href="http://en.wikipedia.org/wiki/Kd-tree">en.wikipedia.org/wiki/Kd-tree</a>).
-    */
-    void buildMesh(const std::vector<Vec>& particles);
+
+        A cell computed in a slab container equals the cell in the full tesselation if the sphere
+        centered on its particle, with a radius of twice the largest distance to any of the cell's
+        vertices, does not cross one of the artificial container walls. Cells that fail this test
+        are recalculated in the full container. If a Parallel instance is specified, the slabs and
+        the block search trees are processed in parallel. The number of slabs and the margin size
+        depend only on the number of particles, so that the resulting tesselation does not depend
+        on the number of threads. */
+    void buildMesh(const std::vector<Vec>& particles, Parallel* parallel);
+
+    /** This private function builds the search tree for the block with the specified index, if
+        the block overlaps with more than a predefined number of cells. It serves as the body of
+        a parallelized loop over all blocks. */
+    void buildBlockTree(size_t b);
 
     /** This private function builds the binary search tree. TO DO: complete documentation. */
     VoronoiMesh_Private::Node* buildTree(std::vector<int>::iterator first, std::vector<int>::iterator last, int depth);
 
+    /** This private function copies the neighbor lists held by the specified temporary cell
+        objects into a single flat table, releasing the lists as it goes. The neighbor indices of
+        all cells are stored contiguously, grouped per cell, so that the path() function can scan
+        the neighbors of the current cell without following any pointers. A neighbor index is
+        either the index of a neighboring cell or the (negative) ID of a domain wall. Next to each
+        neighbor index, in a second table with the same layout, the function stores the plane of
+        the corresponding cell face. For a face shared with a neighboring cell \f$m_i\f$, this is
+        the (unnormalized) normal \f$\mathbf{n}=\mathbf{p}(m_i)-\mathbf{p}(m_r)\f$ on the
+        bisecting plane and the offset
+        \f$d=\mathbf{n}\cdot(\mathbf{p}(m_i)+\mathbf{p}(m_r))/2\f$. For a face on a domain wall,
+        it is the outward unit normal on the wall and the corresponding offset. Each face thus
+        takes 36 bytes. */
+    void buildNeighbors(std::vector<VoronoiMesh_Private::VoronoiCell>& cells);
+
 public:
     /** This function adds a density distribution accessed by functions such as density() and
         integratedDensity(). The first argument \em densityField specifies the index \f$g_d\f$ of
@@ -123,6 +182,12 @@ public:
         be accessable through index \f$h\f$ in order of addition. */
     void addDensityDistribution(int densityField, int densityMultiplierField = -1, double densityFraction = 1.);
 
+    /** This function releases the memory occupied by the field values, for use by clients that
+        need the field values only during setup (for example, to calculate a luminosity for each
+        cell). The integrated density remains available, but any subsequent call to one of the
+        functions returning a field value or a density value throws a fatal error. */
+    void discardFieldValues();
+
     /** The destructor releases the data structures allocated during construction. */
     ~VoronoiMesh();
 
@@ -152,6 +217,13 @@ public:
         search tree. */
     void treeStatistics(int& Ntrees, double& average, int& minimum, int& maximum) const;
 
+    /** This function returns the cell index \f$0\le m \le N_{cells}-1\f$ for the particle with
+        index \em i in the order in which the particles were provided to the constructor (after
+        discarding any particles outside of the domain). Unless spatial ordering was requested
+        during construction, the function simply returns \em i. If the index is out of range a
+        fatal error is thrown. */
+    int cellIndexForParticle(int i) const;
+
     /** This function returns the cell index \f$0\le m \le N_{cells}-1\f$ for the cell containing
         the specified point \f${\bf{r}}\f$. If the point is outside the domain, the function
         returns -1. By definition of a Voronoi tesselation, the closest particle position
@@ -203,11 +275,10 @@ public:
     Position randomPosition(Random* random, int m) const;
 
 private:
-    /** This function returns true if the specified point is closer to the particle
-        defining the cell with index \em m than to all of the particles defining the cells with the
-        indices in the list \em ids; otherwise it returns false. If the list \em ids contains the
-        neighbors of \em m then this function returns true if the point is inside cell \em m. */
-    bool isPointClosestTo(Vec r, int m, const std::vector<int> &ids) const;
+    /** This function returns true if the specified point is closer to the particle defining the
+        cell with index \em m than to all of the particles defining the neighboring cells of \em
+        m, in other words if the point is inside cell \em m; otherwise it returns false. */
+    bool isPointClosestToNeighbors(Vec r, int m) const;
 
 public:
     /** This function returns the value \f$F_g(m)\f$ of the specified field in the cell with given
@@ -350,6 +421,11 @@ public:
         position vectors for the wall plane in this last formula. For example, for the left wall
         with \f$m_i=-1\f$ one has \f$\mathbf{n}=(-1,0,0)\f$ and \f$\mathbf{p}=(x_\text{min},0,0)\f$
         so that \f[s_i=\frac{x_\text{min}-r_x}{k_x}.\f]
+
+        The normal \f$\mathbf{n}\f$ and the offset \f$d=\mathbf{n}\cdot\mathbf{p}\f$ of each
+        plane are precomputed by buildNeighbors(), so that the intersection distance is obtained
+        as \f$s_i=(d-\mathbf{n}\cdot\mathbf{r})/\mathbf{n}\cdot\mathbf{k}\f$ from a contiguous
+        table of face planes, without accessing the particle positions.
     */
     void path(DustGridPath* path) const;
 
@@ -362,7 +438,8 @@ private:
 
     // field values
     QHash<int,int> _storageIndices;             // key: field index g    value: storage index s
-    std::vector< std::vector<double> > _fieldvalues;   // indexed on s and m
+    int _Nfields;                               // limit for index s
+    std::vector<double> _fieldvalues;           // indexed on m*_Nfields+s
 
     // density distribution info
     int _Ndistribs;                             // limit for index h
@@ -376,10 +453,26 @@ private:
     int _nb;                                    // number of blocks in each dimension (limit for indices i,j,k)
     int _nb2;                                   // nb*nb
     int _nb3;                                   // nb*nb*nb
-    std::vector<VoronoiMesh_Private::VoronoiCell*> _cells;  // cell objects, indexed on m
+    std::vector<Vec> _particles;                // particle positions, indexed on m
+    std::vector<Vec> _centroids;                // centroid positions, indexed on m
+    std::vector<double> _volumes;               // cell volumes, indexed on m
+    std::vector<float> _boxes;                  // bounding boxes (xmin,ymin,zmin,xmax,ymax,zmax), indexed on 6*m
+    std::vector<int> _cellindices;              // cell index m for each original particle index, or empty if unsorted
     std::vector< std::vector<int> > _blocklists;            // list of cell indices per block, indexed on i*_nb2+j*_nb+k
     std::vector< VoronoiMesh_Private::Node* > _blocktrees;  // root node of search tree or null for each block,
                                                             // indexed on i*_nb2+j*_nb+k
+
+    // neighbor lists and face planes in compressed row form
+    std::vector<int> _neighbors;                // neighbor cell indices or domain wall IDs (negative) of all cells,
+                                                // grouped per cell
+    std::vector<int> _neighborbegin;            // index in _neighbors of the first neighbor for each cell,
+                                                // indexed on m (with an extra element at the end)
+    struct Plane
+    {
+        double nx, ny, nz;                      // (unnormalized) outward normal on the face
+        double d;                               // offset of the face plane, i.e. n.p for any point p on the plane
+    };
+    std::vector<Plane> _planes;                 // face plane for each entry in _neighbors
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -11,6 +11,7 @@
 #include "FilePaths.hpp"
 #include "Log.hpp"
 #include "NR.hpp"
+#include "ParallelFactory.hpp"
 #include "PhotonPackage.hpp"
 #include "Random.hpp"
 #include "Units.hpp"
@@ -48,7 +49,7 @@ void VoronoiStellarComp::setupSelfBefore()
 
     // import the Voronoi mesh
     _mesh = new VoronoiMesh(_meshfile, QList<int>() << _densityIndex << _metallicityIndex << _ageIndex,
-                             Box(-_xmax,-_ymax,-_zmax, _xmax,_ymax,_zmax));
+                             Box(-_xmax,-_ymax,-_zmax, _xmax,_ymax,_zmax), find<ParallelFactory>()->parallel());
     find<Log>()->info("Voronoi mesh data was successfully imported: " + QString::number(_mesh->Ncells()) + " cells.");
 
     // construct the library of SED models
@@ -84,6 +85,9 @@ void VoronoiStellarComp::setupSelfBefore()
         }
     }
 
+    // the field values are no longer needed; only the cell geometry is used for sampling positions
+    _mesh->discardFieldValues();
+
     // construct the permanent vectors _Xvv with the normalized cumulative luminosities (per wavelength bin)
     _Xvv.resize(Nlambda,0);
     for (int ell=0; ell<Nlambda; ell++)
@@ -20,15 +20,27 @@ QMAKE_CXXFLAGS_RELEASE -= -O2
 QMAKE_CXXFLAGS_RELEASE += -O3
 
 # include libraries internal to the project
-INCLUDEPATH += $$PWD/../Fundamentals $$PWD/../Discover $$PWD/../SKIRTcore
-DEPENDPATH += $$PWD/../Fundamentals $$PWD/../Discover $$PWD/../SKIRTcore
+INCLUDEPATH += $$PWD/../Fundamentals $$PWD/../Discover $$PWD/../SKIRTcore $$PWD/../MPIsupport
+DEPENDPATH += $$PWD/../Fundamentals $$PWD/../Discover $$PWD/../SKIRTcore $$PWD/../MPIsupport
 unix: LIBS += -L$$OUT_PWD/../Fundamentals/ -lfundamentals \
               -L$$OUT_PWD/../Discover/ -ldiscover \
+              -L$$OUT_PWD/../MPIsupport/ -lmpisupport \
               -L$$OUT_PWD/../SKIRTcore/ -lskirtcore
 unix: PRE_TARGETDEPS += $$OUT_PWD/../Fundamentals/libfundamentals.a \
                         $$OUT_PWD/../Discover/libdiscover.a \
+                        $$OUT_PWD/../MPIsupport/libmpisupport.a \
                         $$OUT_PWD/../SKIRTcore/libskirtcore.a
 
+# use MPI linker if available (invoke 'which' via bash in login script mode to honor PATHS on Mac OS X)
+MPI_COMPILER = $$system(bash -lc "'which mpiicpc'")
+isEmpty(MPI_COMPILER) {
+    MPI_COMPILER = $$system(bash -lc "'which mpicxx'")
+}
+!isEmpty(MPI_COMPILER) {
+    message (using MPI linker $$MPI_COMPILER)
+    QMAKE_LINK = $$MPI_COMPILER
+}
+
 # create a header file containing a reasonably unique description of the git version and
 # touch SkirtMain.cpp so it always gets recompiled to update the version number and time stamp
 A_QUOTE = "\'\"\'"
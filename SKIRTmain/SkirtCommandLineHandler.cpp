@@ -4,6 +4,7 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
@@ -11,13 +12,16 @@
 #include "CommandLineArguments.hpp"
 #include "Console.hpp"
 #include "ConsoleHierarchyCreator.hpp"
+#include "DustSystem.hpp"
 #include "FatalError.hpp"
 #include "FileLog.hpp"
 #include "FilePaths.hpp"
 #include "LatexHierarchyWriter.hpp"
 #include "MemoryStatistics.hpp"
+#include "MPICommunicator.hpp"
 #include "Parallel.hpp"
 #include "ParallelFactory.hpp"
+#include "Random.hpp"
 #include "Simulation.hpp"
 #include "SmileSchemaWriter.hpp"
 #include "SkirtCommandLineHandler.hpp"
@@ -31,7 +35,7 @@
 namespace
 {
     // the allowed options list, in the format consumed by the CommandLineArguments constructor
-    static const char* allowedOptions = "-t* -s* -b -i* -o* -k -r -x";
+    static const char* allowedOptions = "-t* -s* -d -b -c -i* -o* -m* -k -r -x";
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -132,6 +136,8 @@ int SkirtCommandLineHandler::doBatch()
     {
         // determine the number of parallel simulations
         _parallelSims = std::max(_args.intValue("-s"), 1);
+        if (_parallelSims > 1 && MPICommunicator::worldSize() > 1)
+            throw FATALERROR("Parallel simulations (-s) cannot be combined with multiple MPI processes");
 
         // perform a simulation for each ski file
         TimeLogger logger(&_console, "a set of " + QString::number(_skifiles.size()) + " simulations"
@@ -249,12 +255,40 @@ void SkirtCommandLineHandler::doSimulation(size_t index)
     simulation->filePaths()->setOutputPath((_args.value("-o").startsWith('/') ? "" : base + "/") + _args.value("-o"));
     // threads
     if (_args.intValue("-t") > 0) simulation->parallelFactory()->setMaxThreadCount(_args.intValue("-t"));
+    // checkpoints
+    simulation->setCheckpointing(_args.isPresent("-c"));
+    // cache for the sampled dust densities; the file name is a hash of the configuration determining the densities
+    DustSystem* ds = simulation->findChild<DustSystem*>();
+    if (_args.isPresent("-m") && ds && ds->dustDistribution() && ds->dustGridStructure())
+    {
+        QString densitycachepath = (_args.value("-m").startsWith('/') ? "" : base + "/") + _args.value("-m");
+        QDir().mkpath(densitycachepath);
+        XmlHierarchyWriter writer;
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(writer.serializeHierarchy(ds->dustDistribution()));
+        hash.addData(writer.serializeHierarchy(ds->dustGridStructure()));
+        hash.addData(writer.serializeHierarchy(simulation->random()));
+        hash.addData(QByteArray::number(ds->sampleCount()));
+        ds->setDensityCachePath(densitycachepath + "/" + QString(hash.result().toHex()) + ".dat");
+    }
+    // processes; all processes other than the root write their (setup) output with a distinct prefix
+    bool root = true;
+    if (MPICommunicator::worldSize() > 1)
+    {
+        MPICommunicator* comm = new MPICommunicator();
+        comm->setDataParallel(_args.isPresent("-d"));
+        simulation->setCommunicator(comm);
+        root = comm->isRoot();
+        if (!root) simulation->filePaths()->setOutputPrefix(skiinfo.completeBaseName()
+                                                            + "_proc" + QString::number(comm->rank()));
+    }
     // console
     FileLog* log = new FileLog();
     simulation->log()->setLinkedLog(log);
-    if (_parallelSims > 1 || _args.isPresent("-b")) simulation->log()->setLowestLevel(Log::Success);
+    if (_parallelSims > 1 || _args.isPresent("-b") || !root) simulation->log()->setLowestLevel(Log::Success);
 
     // output a ski file and a latex file reflecting this simulation for later reference
+    if (root)
     {
         XmlHierarchyWriter writer1;
         writer1.writeHierarchy(simulation.data(), simulation->filePaths()->output("parameters.xml"));
@@ -288,16 +322,19 @@ void SkirtCommandLineHandler::printHelp()
     _console.warning("To create a new ski file interactively:    skirt");
     _console.warning("To run a simulation with default options:  skirt <ski-filename>");
     _console.warning("");
-    _console.warning("  skirt [-b] [-s <simulations>] [-t <threads>]");
-    _console.warning("        [-k] [-i <dirpath>] [-o <dirpath>]");
+    _console.warning("  skirt [-b] [-s <simulations>] [-t <threads>] [-d] [-c]");
+    _console.warning("        [-k] [-i <dirpath>] [-o <dirpath>] [-m <dirpath>]");
     _console.warning("        [-r] {<filepath>}*");
     _console.warning("");
     _console.warning("  -b : forces brief console logging");
     _console.warning("  -s <simulations> : the number of parallel simulations per process");
     _console.warning("  -t <threads> : the number of parallel threads for each simulation");
+    _console.warning("  -d : divides the wavelengths rather than the photon packages over MPI processes");
+    _console.warning("  -c : saves checkpoints during the simulation and resumes from an existing checkpoint");
     _console.warning("  -k : makes the input/output paths relative to the ski file being processed");
     _console.warning("  -i <dirpath> : the relative or absolute path for simulation input files");
     _console.warning("  -o <dirpath> : the relative or absolute path for simulation output files");
+    _console.warning("  -m <dirpath> : the relative or absolute path for caching sampled dust (mass) densities across runs");
     _console.warning("  -r : causes recursive directory descent for all specified ski file paths");
     _console.warning("  <filepath> : the relative or absolute file path for a ski file");
     _console.warning("               (the filename may contain ? and * wildcards)");
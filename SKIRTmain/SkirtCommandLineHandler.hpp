@@ -22,8 +22,8 @@ result in a ski file, without actually performing the simulation. Otherwise, it
 simulations in the ski files specified on the command line according to the following syntax:
 
 \verbatim
-    skirt [-b] [-s <simulations>] [-t <threads>]
-          [-k] [-i <dirpath>] [-o <dirpath>]
+    skirt [-b] [-s <simulations>] [-t <threads>] [-d] [-c]
+          [-k] [-i <dirpath>] [-o <dirpath>] [-m <dirpath>]
           [-r] {<filepath>}*
 \endverbatim
 
@@ -34,10 +34,25 @@ and error messages. If there is only one simulation at a time, the console shows
 unless -b is present. The -s option specifies the number of simulations to be executed in
 parallel; the default value is one. The -t option specifies the number of parallel threads for
 each simulation; the default value is the number of logical cores on the computer running
-SKIRT. The -k option causes the simulation input/output paths to be relative to the ski file
-being processed, rather than to the current directory. The -i option specifies the absolute or
-relative path for simulation input files. The -o option specifies the absolute or relative path
-for simulation output files. The -r option causes recursive directory descent for all specified
+SKIRT. The -d option applies when SKIRT is launched as multiple MPI processes; it causes the
+wavelengths of a panchromatic simulation to be divided over the processes, rather than the
+photon packages for each wavelength, so that each process stores only its own part of the
+per-wavelength data structures. The -c option causes a panchromatic simulation to save a
+checkpoint file in the output directory after each photon shooting phase and each dust
+self-absorption cycle; if such a checkpoint file is present when the simulation starts, the
+simulation resumes after the phase or cycle recorded in the file. The -k option causes the
+simulation input/output paths to be relative to the ski file being processed, rather than to the
+current directory. The -i option specifies the absolute or relative path for simulation input
+files. The -o option specifies the absolute or relative path for simulation output files. The -m
+option specifies the absolute or relative path for a directory in which the dust (mass) densities
+of the cells obtained by random sampling are cached across simulation runs. The cache file name
+is a hash of the dust distribution, dust grid and random generator configuration, so that
+simulations with the same dust geometry (e.g. in a parameter study) skip the density sampling.
+Only these densities are cached: the dust grid structure is still constructed and the cell
+volumes are still calculated for every run, and densities provided directly by the dust grid are
+not cached. The hash does not cover the contents of any input files; the cache directory should
+be cleared when these files change.
+The -r option causes recursive directory descent for all specified
 \<filepath\> arguments, in other words all directories inside the specified base paths are
 searched for the specified filename (or filename pattern).
 
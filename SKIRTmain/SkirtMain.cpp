@@ -4,6 +4,7 @@
 ///////////////////////////////////////////////////////////////// */
 
 #include <QCoreApplication>
+#include "MasterSlaveManager.hpp"
 #include "SkirtCommandLineHandler.hpp"
 #include "RegisterSimulationItems.hpp"
 #include "SignalHandler.hpp"
@@ -15,6 +16,9 @@
 
 int main(int argc, char** argv)
 {
+    // initialize remote communication capability, if present
+    MasterSlaveManager::initialize(&argc, &argv);
+
     // construct application object for argument parsing and such,
     // but don't run the event loop because we don't need it
     QCoreApplication app(argc, argv);
@@ -30,7 +34,11 @@ int main(int argc, char** argv)
 
     // get and handle the command line arguments
     SkirtCommandLineHandler handler(app.arguments());
-    return handler.perform();
+    int status = handler.perform();
+
+    // finalize remote communication capability, if present
+    MasterSlaveManager::finalize();
+    return status;
 }
 
 //////////////////////////////////////////////////////////////////////